@@ -9,6 +9,7 @@
 #include "../src/constants.h"
 #include "../src/tboard.h"
 #include "../src/jcond.h"
+#include "../src/jdata.h"
 
 #include "minicoro.h"
 #include "utarray.h"
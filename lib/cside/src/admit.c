@@ -0,0 +1,97 @@
+/*
+ * Admission control of remote calls. The backlog is what the tasks on the board are
+ * expected to cost, from the CPU time their functions took so far (history_t.cost).
+ * Divided over the executors it says how long a new task waits before it runs, which
+ * is what a caller with a deadline cares about. The check is a read of a few counters,
+ * the message processor runs it for every REXEC.
+ */
+
+#include "admit.h"
+
+#define ADMIT_NS_PER_MS             1000000ULL
+
+void admit_init(admit_t *a, int maxtasks)
+{
+    atomic_init(&(a->backlog), 0);
+    a->maxtasks = maxtasks;
+    atomic_init(&(a->accepted), 0);
+    atomic_init(&(a->rejected), 0);
+    atomic_init(&(a->shed), 0);
+}
+
+// ms until a call limited to @limit tasks and @limit_ms of backlog would pass, 0 if now
+static int admit_wait(int tasks, int limit, uint64_t drain, uint64_t limit_ms, uint64_t cost, int execs)
+{
+    uint64_t over = 0;
+    int ms;
+
+    // the tasks above the limit have to complete first
+    if (tasks >= limit)
+        over = (uint64_t)(tasks - limit + 1) * cost / execs;
+    if (drain > limit_ms * ADMIT_NS_PER_MS && drain - limit_ms * ADMIT_NS_PER_MS > over)
+        over = drain - limit_ms * ADMIT_NS_PER_MS;
+    if (over == 0)
+        return 0;
+    ms = (int)(over / ADMIT_NS_PER_MS);
+    if (ms < ADMIT_RETRY_MIN_MS)
+        return ADMIT_RETRY_MIN_MS;
+    return ms > ADMIT_RETRY_MAX_MS ? ADMIT_RETRY_MAX_MS : ms;
+}
+
+int admit_check(admit_t *a, int tasks, int execs, uint64_t cost, bool batch)
+{
+    long backlog = atomic_load_explicit(&(a->backlog), memory_order_relaxed);
+    uint64_t drain;
+    int urgent, wait;
+
+    if (cost == 0)
+        cost = ADMIT_COST_DEFAULT;
+    if (execs < 1)
+        execs = 1;
+    drain = ((backlog > 0 ? (uint64_t)backlog : 0) + cost) / execs;
+
+    urgent = admit_wait(tasks, a->maxtasks - ADMIT_TASK_RESERVE, drain, ADMIT_RT_BACKLOG_MS, cost, execs);
+    wait = !batch ? urgent :
+        admit_wait(tasks, a->maxtasks * ADMIT_BATCH_SHARE / 100, drain, ADMIT_BATCH_BACKLOG_MS, cost, execs);
+    if (wait == 0)
+        atomic_fetch_add_explicit(&(a->accepted), 1, memory_order_relaxed);
+    else if (urgent == 0)
+        atomic_fetch_add_explicit(&(a->shed), 1, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(&(a->rejected), 1, memory_order_relaxed);
+    return wait;
+}
+
+uint64_t admit_charge(admit_t *a, uint64_t cost)
+{
+    if (cost == 0)
+        cost = ADMIT_COST_DEFAULT;
+    atomic_fetch_add_explicit(&(a->backlog), (long)cost, memory_order_relaxed);
+    return cost;
+}
+
+void admit_discharge(admit_t *a, uint64_t cost)
+{
+    atomic_fetch_sub_explicit(&(a->backlog), (long)cost, memory_order_relaxed);
+}
+
+void admit_update_cost(atomic_ulong *cost, uint64_t cpu)
+{
+    uint64_t c = atomic_load_explicit(cost, memory_order_relaxed);
+
+    // the first sample seeds the average
+    c = c == 0 ? cpu : c - (c >> ADMIT_COST_SHIFT) + (cpu >> ADMIT_COST_SHIFT);
+    atomic_store_explicit(cost, c > 0 ? c : 1, memory_order_relaxed);
+}
+
+void admit_print_stats(admit_t *a, FILE *fptr)
+{
+    long accepted = atomic_load(&(a->accepted));
+    long rejected = atomic_load(&(a->rejected));
+    long shed = atomic_load(&(a->shed));
+
+    if (accepted + rejected + shed == 0)
+        return;
+    fprintf(fptr, "Admission: %ld remote calls accepted, %ld rejected, %ld batch calls shed, %.3f ms backlog\n",
+        accepted, rejected, shed, (double)atomic_load(&(a->backlog)) / ADMIT_NS_PER_MS);
+}
@@ -0,0 +1,96 @@
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Admission control of remote calls. A REXEC is checked before it is acknowledged:
+ * once it is acknowledged the caller waits for a result, and a task we cannot create
+ * at that point only shows up as a timeout and a retry, which adds to the overload.
+ * Rejected calls get a NAK with a hint of when to try again instead.
+ */
+
+#define ADMIT_BATCH_BACKLOG_MS      250
+#define ADMIT_RT_BACKLOG_MS         1000
+#define ADMIT_BATCH_SHARE           50
+#define ADMIT_TASK_RESERVE          256
+#define ADMIT_COST_DEFAULT          100000
+#define ADMIT_COST_SHIFT            3
+#define ADMIT_RETRY_MIN_MS          50
+#define ADMIT_RETRY_MAX_MS          5000
+/**
+ * Configurable Macros
+ * @ADMIT_BATCH_BACKLOG_MS: batch calls are shed once the executors have more work than
+ *                          this ahead of them
+ * @ADMIT_RT_BACKLOG_MS:    same for SY and RT calls. They run before any batch work, so
+ *                          they can go on longer.
+ * @ADMIT_BATCH_SHARE:      percent of the task slots batch calls may fill
+ * @ADMIT_TASK_RESERVE:     task slots no remote call gets, for the local and internal tasks
+ * @ADMIT_COST_DEFAULT:     cost in ns of a task of a function that never completed one
+ * @ADMIT_COST_SHIFT:       the cost of a function is a moving average of the CPU time of
+ *                          its tasks, a new task weighs 1/2^ADMIT_COST_SHIFT
+ * @ADMIT_RETRY_MIN_MS:     bounds of the retry-after hint of a NAK
+ * @ADMIT_RETRY_MAX_MS:
+ */
+
+/**
+ * admit_t - Admission state of a task board (tboard_t.admit)
+ * @backlog:  estimated CPU time in ns of the tasks on the board, charged when a task is
+ *            added and given back when it completes. A parked task keeps its charge.
+ * @maxtasks: task slots of the board (MAX_TASKS)
+ * @accepted: remote calls admitted
+ * @rejected: remote calls turned away because the board is overloaded
+ * @shed:     batch calls turned away to keep room for SY and RT calls, which would
+ *            have been admitted
+ */
+typedef struct admit_t {
+    atomic_long backlog;
+    int maxtasks;
+    atomic_long accepted;
+    atomic_long rejected;
+    atomic_long shed;
+} admit_t;
+
+void admit_init(admit_t *a, int maxtasks);
+
+int admit_check(admit_t *a, int tasks, int execs, uint64_t cost, bool batch);
+/**
+ * admit_check() - Decides whether a remote call may create a task
+ * @a:     admission state
+ * @tasks: tasks on the board now (tboard_get_concurrent())
+ * @execs: executors working off the backlog
+ * @cost:  estimated CPU time in ns of the task, 0 if unknown
+ * @batch: the call is batch work, shed before SY and RT work
+ *
+ * A call is turned away when the task slots it may use are taken, or when the backlog
+ * would take longer than its priority allows to drain. Counts the outcome.
+ *
+ * Return: 0 if the call is admitted, otherwise the retry-after hint in ms, roughly the
+ *         time until the call would pass
+ */
+
+uint64_t admit_charge(admit_t *a, uint64_t cost);
+void admit_discharge(admit_t *a, uint64_t cost);
+/**
+ * admit_charge() - Adds a new task to the backlog, @cost 0 if unknown
+ *
+ * Return: what was charged, to be handed to admit_discharge() when the task completes
+ */
+
+void admit_update_cost(atomic_ulong *cost, uint64_t cpu);
+/**
+ * admit_update_cost() - Folds the CPU time @cpu of a completed task into the cost
+ *                       estimate @cost of its function (history_t.cost)
+ *
+ * Context: executor threads, racing updates may lose a sample
+ */
+
+void admit_print_stats(admit_t *a, FILE *fptr);
+/**
+ * admit_print_stats() - Prints the admission counters, nothing if no call was checked
+ */
+
+#endif
@@ -17,7 +17,7 @@ bool args_serialnum_valid(int serialnum) {
     return (serialnum > 0);
 }
 bool args_numexecutors_valid(int numexecutors) {
-    return (numexecutors >= 0);
+    return (numexecutors >= -1 && numexecutors <= MAX_SECONDARIES);
 }
 
 cnode_args_t *process_args(int argc, char **argv) {
@@ -29,12 +29,18 @@ cnode_args_t *process_args(int argc, char **argv) {
     args->snumber = DEFAULTS_SERIALNUM;
     args->appid = NULL;
     args->tags = NULL;
+    args->tracefile = NULL;
+    args->histfile = NULL;
+    args->topology = NULL;
+    args->sstacks = false;
+    args->wirewin = WIRE_WINDOW_US;
+    args->hedge = false;
     opterr = 0;
 
     int c;
 
     // parse the arguments..
-    while ((c = getopt (argc, argv, "p:a:n:g:t:x:")) != -1)
+    while ((c = getopt (argc, argv, "p:a:n:g:t:x:T:H:X:SW:D")) != -1)
     switch (c)
     {
         case 'a':
@@ -55,8 +61,26 @@ cnode_args_t *process_args(int argc, char **argv) {
         case 'x':
             args->nexecs = atoi(optarg);
         break;
+        case 'T':
+            args->tracefile = optarg;
+        break;
+        case 'H':
+            args->histfile = optarg;
+        break;
+        case 'X':
+            args->topology = optarg;
+        break;
+        case 'S':
+            args->sstacks = true;
+        break;
+        case 'W':
+            args->wirewin = atol(optarg);
+        break;
+        case 'D':
+            args->hedge = true;
+        break;
         default:
-            terminate_error(true, "Unknown input option\nUsage: program -a app_id [-t tag] [-g groupid] [-n num] [-p port] [-x executors]\n");
+            terminate_error(true, "Unknown input option\nUsage: program -a app_id [-t tag] [-g groupid] [-n num] [-p port] [-x executors] [-X topology|@file] [-S] [-W window_us] [-D] [-T tracefile] [-H histfile]\n");
     }
 
     // check validity
@@ -67,6 +67,27 @@ bool remote_async_call(tboard_t *t, char *cmd_func, char *fn_sig, ...)
         return remote_task_create_nb(t, cmd_func, level, "", NULL, 0);
 }
 
+/*
+ * Remote call that does not yield. The call is added to the group @fs, whose results
+ * are collected with await_all() or await_any(). It returns NULL on failure.
+ */
+future_t *remote_future_call(futures_t *fs, int level, char *cmd_func, char *fn_sig, ...)
+{
+    va_list args;
+    bool res;
+    arg_t *qargs = NULL;
+
+    if (strlen(fn_sig) > 0)
+    {
+        va_start(args, fn_sig);
+        res = command_qargs_alloc(fn_sig, &qargs, args);
+        va_end(args);
+        if (!res)
+            return NULL;
+    }
+    return future_issue(fs, cmd_func, level, fn_sig, qargs, strlen(fn_sig));
+}
+
 /*
  * This must be called from within a task.. not the main thread (outside the task)
  * On failure: this function returns NULL. Otherwise, it returns a pointer to an arg_t.
@@ -3,10 +3,12 @@
 
 #include "tboard.h"
 #include "command.h"
+#include "future.h"
 
 
 arg_t *remote_sync_call(tboard_t *t, char *cmd_func, char *fn_sig, ...);
 bool remote_async_call(tboard_t *t, char *cmd_func, char *fn_sig, ...);
+future_t *remote_future_call(futures_t *fs, int level, char *cmd_func, char *fn_sig, ...);
 void *local_sync_call(tboard_t *t, char *cmd_func, ...);
 void local_async_call(tboard_t *t, char *cmd_func, ...);
 
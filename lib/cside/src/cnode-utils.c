@@ -3,31 +3,30 @@
 
 void temp_schedule_inject(cnode_t *cn, int type)
 {
-    tboard_t *tb = cn->tboard;
+    sched_t s = {.len = 10000};
 
     switch (type) {
         case 0:
-            tb->sched.len = 10000;
-            tb->sched.rtslots = 1;
-            tb->sched.syslots = 0;
-            tb->sched.rtstarts[0] = 2000;
+            s.rtslots = 1;
+            s.rtstarts[0] = 2000;
+        break;
         case 1:
-            tb->sched.len = 10000;
-            tb->sched.rtslots = 0;
-            tb->sched.syslots = 1;
-            tb->sched.systarts[0] = 4000;
+            s.syslots = 1;
+            s.systarts[0] = 4000;
+        break;
         case 2:
-            tb->sched.len = 10000;
-            tb->sched.rtslots = 1;
-            tb->sched.syslots = 1;
-            tb->sched.rtstarts[0] = 2000;
-            tb->sched.systarts[0] = 4000;
+            s.rtslots = 1;
+            s.syslots = 1;
+            s.rtstarts[0] = 2000;
+            s.systarts[0] = 4000;
+        break;
         case 3:
-            tb->sched.len = 10000;
-            tb->sched.rtslots = 2;
-            tb->sched.syslots = 1;
-            tb->sched.rtstarts[0] = 2000;
-            tb->sched.rtstarts[0] = 6000;
-            tb->sched.systarts[0] = 4000;
+            s.rtslots = 2;
+            s.syslots = 1;
+            s.rtstarts[0] = 2000;
+            s.rtstarts[1] = 6000;
+            s.systarts[0] = 4000;
+        break;
     }
-}
\ No newline at end of file
+    tboard_put_schedule(cn->tboard, &s);
+}
@@ -8,7 +8,9 @@
 #include "multicast.h"
 #include "calls.h"
 #include "jcond.h"
+#include "jdata.h"
 #include <unistd.h>
+#include <signal.h>
 
 cnode_t *cn;
 
@@ -23,6 +25,8 @@ topics_t *cnode_create_topics(char *app)
     t->subtopics[tcnt++] = strdup(sbuf);
     sprintf(sbuf, "/%s/requests/down/c", app);
     t->subtopics[tcnt++] = strdup(sbuf);
+    sprintf(sbuf, "/%s/jdata/bcast/#", app);    // all broadcasters, see jdata.h
+    t->subtopics[tcnt++] = strdup(sbuf);
     t->length = tcnt;
 
     sprintf(sbuf, "/%s/requests/up", app);
@@ -54,8 +58,11 @@ server_t *cnode_create_mbroker(cnode_t *cn, enum levels level, char *server_id,
     else 
         serv->server_id = NULL;
     serv->state = SERVER_NOT_REGISTERED;
-    serv->mqtt = setup_mqtt_adapter(serv, level, host, port, topics, ntopics);
     serv->cnode = cn;
+    serv->caps = 0;
+    wire_batch_init(&(serv->wreq), serv, cn->topics->requesttopic);
+    wire_batch_init(&(serv->wrep), serv, cn->topics->replytopic);
+    serv->mqtt = setup_mqtt_adapter(serv, level, host, port, topics, ntopics);
     return serv;
 }
 
@@ -67,6 +74,10 @@ void cnode_recreate_mbroker(server_t *serv, enum levels level, char *server_id,
     else 
         serv->server_id = NULL;
     serv->state = SERVER_NOT_REGISTERED;
+    // a new connection, whatever is on the other end registers again
+    serv->caps = 0;
+    memset(&(serv->rtt), 0, sizeof(lathist_t));
+    atomic_store(&(serv->stagger), 0);
     serv->mqtt = setup_mqtt_adapter(serv, level, host, port, topics, ntopics);
 }
 
@@ -103,22 +114,13 @@ broker_info_t *cnode_scanj(int groupid, int port) {
 }
 
 void cnode_setup_jcond(char *dstr) {
-
-    char tagstr[1024];
-    // Initialize the jconditional
-    jcond_init();
-    jcond_eval_str("var jsys = {type: 'device'};");
-
-    if (dstr != NULL && strlen(dstr) > 0)
-    {
-        sprintf(tagstr, "jsys.tag = '%s';", dstr);
-        jcond_eval_str(tagstr);
-    }
-    jcond_eval_str("function jcondContext(a) { return eval(a); }");
+    // mujs is started by the first jcond that needs it, with jsys copied in
+    jcond_set_jsys("device", dstr);
 }
 
 cnode_t *cnode_init(int argc, char **argv){
     cnode_t *cn = (cnode_t *)calloc(1, sizeof(cnode_t));
+    exec_topo_t topo;
 
     // get arguments
     cn->args = process_args(argc, argv);
@@ -128,6 +130,9 @@ cnode_t *cnode_init(int argc, char **argv){
     }
 
     cn->topics = cnode_create_topics(cn->args->appid);
+    jdata_init(cn);
+    wire_init(cn->args->wirewin);
+    cn->icache = icache_alloc();
 
     // generate core
     cn->core = core_init(cn->args->port, cn->args->snumber);
@@ -142,12 +147,27 @@ cnode_t *cnode_init(int argc, char **argv){
         cnode_destroy(cn);
         terminate_error(true, "cannot find the device j server");
     }
+    // place the executors, one sExecutor per CPU we may use besides the pExecutor's
+    topo_init(&topo);
+    if (cn->args->topology != NULL && !topo_parse(&topo, cn->args->topology)) {
+        cnode_destroy(cn);
+        terminate_error(true, "invalid executor topology");
+    }
+    if (cn->args->nexecs < 0) {
+        cn->args->nexecs = topo_cpu_quota(&topo) - 1;
+        if (cn->args->nexecs > MAX_SECONDARIES)
+            cn->args->nexecs = MAX_SECONDARIES;
+    }
     // Start the taskboard 
-    cn->tboard = tboard_create(cn, cn->args->nexecs);
+    cn->tboard = tboard_create(cn, cn->args->nexecs, READY_QUEUE_TYPE);
     if ( cn->tboard == NULL ) {
         cnode_destroy(cn);
         terminate_error(true, "cannot create the task board");
     }
+    ((tboard_t *)cn->tboard)->histfile = cn->args->histfile;
+    ((tboard_t *)cn->tboard)->topo = topo;
+    ((tboard_t *)cn->tboard)->sstacks = cn->args->sstacks;
+    processor_init(cn->tboard);
     
     mqtt_lib_init();
 
@@ -164,6 +184,10 @@ cnode_t *cnode_init(int argc, char **argv){
     send_reg_msg(cn->devserv, cn->core->device_id, 0);
     
     cnode_setup_jcond(cn->args->tags);
+    // executor tracing is on from the start with -T, SIGUSR2 toggles it on a live node
+    trace_install_signal(SIGUSR2);
+    if (cn->args->tracefile != NULL)
+        trace_enable(true);
     tboard_start(cn->tboard);
     
     return cn;
@@ -196,6 +220,9 @@ void cnode_destroy(cnode_t *cn) {
         free(cn->devinfo);
     }
 
+    // push out what the loggers still hold before the connection goes
+    jdata_shutdown();
+
     // free MQTT server
     if (cn->devserv != NULL) {
         if (cn->devserv->mqtt != NULL){
@@ -205,6 +232,7 @@ void cnode_destroy(cnode_t *cn) {
         //free(cn->devserv);
     }
 
+    icache_free(cn->icache);
     free(cn);
 }
 
@@ -217,6 +245,13 @@ bool cnode_start(cnode_t *cn) {
 bool cnode_stop(cnode_t *cn) {
     // tboard_shutdown is going to block.. until another thread kills the tboard.
     tboard_shutdown(cn->tboard);
-    history_print_records(cn->tboard, stdout);
+    jdata_print_stats(stdout);
+    icache_print_stats(cn->icache, stdout);
+    if (cn->devserv != NULL) {
+        wire_print_stats(&(cn->devserv->wreq), "requests", stdout);
+        wire_print_stats(&(cn->devserv->wrep), "replies", stdout);
+    }
+    if (trace_used())
+        trace_dump_chrome(cn->args->tracefile != NULL ? cn->args->tracefile : TRACE_DEFAULT_FILE);
     return true;
 }
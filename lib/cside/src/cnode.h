@@ -4,6 +4,8 @@
 #include "tboard.h"
 #include "mqtt_adapter.h"
 #include "core.h"
+#include "wire.h"
+#include "icache.h"
 
 #define MAX_EDGE_SERVERS            16
 #define MAX_TOPICS                  16
@@ -31,6 +33,11 @@ typedef struct _server_t
     char *server_id;
     mqtt_adapter_t *mqtt;
     void *cnode;
+    int caps;               // WIRE_CAP_* the server accepted in REGISTER_ACK
+    wire_batch_t wreq;      // REXECs to the server (requests topic)
+    wire_batch_t wrep;      // replies to the calls it sent us (replies topic)
+    lathist_t rtt;          // REXEC to REXEC_RES, recorded by the pExecutor
+    atomic_long stagger;    // HEDGE_PERCENTILE of @rtt in microseconds, 0 until known
     // redis_adapter goes here 
 } server_t;
 
@@ -51,6 +58,12 @@ typedef struct cnode_args_t {
     int port;
     int snumber;
     int nexecs;
+    char *tracefile;    // -T: trace the executors from the start, dumped here at cnode_stop()
+    char *histfile;     // -H: per function latency histograms as JSON, written at shutdown
+    char *topology;     // -X: executor placement, e.g. "primary=auto rt pin" (see exec_topo_t)
+    bool sstacks;       // -S: every task runs on the shared stack of its executor (see sstack.h)
+    long wirewin;       // -W: batching window in microseconds, 0 for one publish per command (see wire.h)
+    bool hedge;         // -D: ALL_LEVELS requests reach the edge and cloud only if the device J is slow
 } cnode_args_t;
 
 
@@ -65,6 +78,7 @@ typedef struct cnode_t {
     server_t *cloudserv;
     broker_info_t *devinfo;
     int eservnum;
+    icache_t *icache;
     void *tboard;    
 } cnode_t;
 
@@ -56,6 +56,20 @@ internal_command_t *internal_command_new(command_t *cmd)
     return icmd;
 }
 
+/*
+ * Internal command straight from the decoded view. The arguments are decoded
+ * once into the internal command instead of going through a command_t and a clone.
+ */
+internal_command_t *internal_command_from_view(command_view_t *v)
+{
+    internal_command_t *icmd = (internal_command_t *)calloc(1, sizeof(internal_command_t));
+
+    icmd->cmd = v->cmd;
+    icmd->task_id = v->task_id;
+    icmd->args = command_view_args(v, 0);
+    return icmd;
+}
+
 void internal_command_free(internal_command_t *ic)
 {
     command_args_free(ic->args);
@@ -106,48 +120,80 @@ command_t *command_new(int cmd, int subcmd, char *fn_name, long int task_id, cha
         qargs = NULL;
 
     command_t *c = command_new_using_arg(cmd, subcmd, fn_name, task_id, node_id, fn_argsig, qargs);
+    // the encoded command does not refer to qargs, the nvoid_t args belong to the caller
+    for (int i = 0; i < len; i++)
+        if (qargs[i].type == STRING_TYPE)
+            free(qargs[i].val.sval);
+    free(qargs);
     return c;
 }
 
-command_t *command_new_using_arg(int cmd, int subcmd, char *fn_name, long int taskid, char *node_id, char *fn_argsig, arg_t *args)
+/*
+ * Commands are encoded into a per-thread scratch buffer first and then copied into
+ * an allocation of exactly the encoded size that trails the command_t. The scratch
+ * buffer grows when an encoding does not fit - tinycbor keeps counting the bytes it
+ * would have needed, so the second pass always fits - and is reused by the next
+ * command built on the same thread.
+ */
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+typedef struct _cmd_arena_t
+{
+    size_t size;
+    unsigned char data[];
+} cmd_arena_t;
+
+static void arena_key_create()
+{
+    pthread_key_create(&arena_key, free);
+}
+
+static cmd_arena_t *command_arena(size_t size)
+{
+    cmd_arena_t *a;
+
+    pthread_once(&arena_once, arena_key_create);
+    a = (cmd_arena_t *)pthread_getspecific(arena_key);
+    if (a == NULL || a->size < size) {
+        free(a);
+        if (size < CMD_ARENA_INITIAL_SIZE)
+            size = CMD_ARENA_INITIAL_SIZE;
+        a = (cmd_arena_t *)malloc(sizeof(cmd_arena_t) + size);
+        assert(a != NULL);
+        a->size = size;
+        pthread_setspecific(arena_key, a);
+    }
+    return a;
+}
+
+/*
+ * Encode the command into @buf. Returns the number of bytes written, or 0 with
+ * the number of missing bytes in @extra if @size was too small.
+ */
+static size_t command_encode(unsigned char *buf, size_t size, size_t *extra, int cmd, int subcmd, char *fn_name, 
+                             long int taskid, char *node_id, char *fn_argsig, arg_t *args)
 {
-    command_t *cmdo = (command_t *)calloc(1, sizeof(command_t));
     nvoid_t *nv;
     CborEncoder encoder, mapEncoder, arrayEncoder;
-    cbor_encoder_init(&encoder, cmdo->buffer, HUGE_CMD_STR_LEN, 0);
+    cbor_encoder_init(&encoder, buf, size, 0);
     cbor_encoder_create_map(&encoder, &mapEncoder, 7);
-    // store the fields into the structure and encode into the CBOR
-    // store and encode cmd
-    cmdo->cmd = cmd;
     cbor_encode_text_stringz(&mapEncoder, "cmd");
     cbor_encode_int(&mapEncoder, cmd);
-    // store and encode subcmd
-    cmdo->cmd = subcmd;
     cbor_encode_text_stringz(&mapEncoder, "subcmd");
     cbor_encode_int(&mapEncoder, subcmd);
-    // store and encode fn_name
-    COPY_STRING(cmdo->fn_name, fn_name, SMALL_CMD_STR_LEN);
     cbor_encode_text_stringz(&mapEncoder, "fn_name");
     cbor_encode_text_stringz(&mapEncoder, fn_name);
-    // store and encode task_id
-    cmdo->task_id = taskid;
     cbor_encode_text_stringz(&mapEncoder, "taskid");
     cbor_encode_uint(&mapEncoder, taskid);
-    // store and encode node_id
-    COPY_STRING(cmdo->node_id, node_id, LARGE_CMD_STR_LEN);
     cbor_encode_text_stringz(&mapEncoder, "nodeid");
     cbor_encode_text_stringz(&mapEncoder, node_id);
-    // store and encode fn_argsig
-    COPY_STRING(cmdo->fn_argsig, fn_argsig, SMALL_CMD_STR_LEN);
     cbor_encode_text_stringz(&mapEncoder, "fn_argsig");
     cbor_encode_text_stringz(&mapEncoder, fn_argsig);
-    // store and encode the args
     cbor_encode_text_stringz(&mapEncoder, "args");
     if (args == NULL) {
-        cmdo->args = NULL;
         cbor_encoder_create_array(&mapEncoder, &arrayEncoder, 0);
     } else {
-        cmdo->args = command_args_clone(args);
         cbor_encoder_create_array(&mapEncoder, &arrayEncoder, args[0].nargs);
         for (int i = 0; i < args[0].nargs; i++) {
             switch (args[i].type) {
@@ -159,11 +205,10 @@ command_t *command_new_using_arg(int cmd, int subcmd, char *fn_name, long int ta
                     cbor_encode_text_stringz(&arrayEncoder, args[i].val.sval);
                     break;
                 case INT_TYPE:
+                    cbor_encode_int(&arrayEncoder, args[i].val.ival);
+                    break;
                 case LONG_TYPE:
-                    if (args[i].val.ival < 0)
-                        cbor_encode_negative_int(&arrayEncoder, abs(args[i].val.ival));
-                    else
-                        cbor_encode_int(&arrayEncoder, args[i].val.ival);
+                    cbor_encode_int(&arrayEncoder, args[i].val.lval);
                     break;
                 case DOUBLE_TYPE:
                     cbor_encode_double(&arrayEncoder, args[i].val.dval);
@@ -176,14 +221,44 @@ command_t *command_new_using_arg(int cmd, int subcmd, char *fn_name, long int ta
     }
     cbor_encoder_close_container(&mapEncoder, &arrayEncoder);
     cbor_encoder_close_container(&encoder, &mapEncoder);
+    *extra = cbor_encoder_get_extra_bytes_needed(&encoder);
+    return *extra > 0 ? 0 : cbor_encoder_get_buffer_size(&encoder, buf);
+}
+
+/*
+ * The args are only encoded, the command does not keep a copy of them. The caller
+ * still owns @args.
+ */
+command_t *command_new_using_arg(int cmd, int subcmd, char *fn_name, long int taskid, char *node_id, char *fn_argsig, arg_t *args)
+{
+    cmd_arena_t *a = command_arena(0);
+    size_t len, extra;
+
+    len = command_encode(a->data, a->size, &extra, cmd, subcmd, fn_name, taskid, node_id, fn_argsig, args);
+    if (len == 0) {
+        // did not fit, grow the arena to the exact size and encode again
+        a = command_arena(a->size + extra);
+        len = command_encode(a->data, a->size, &extra, cmd, subcmd, fn_name, taskid, node_id, fn_argsig, args);
+    }
+
+    command_t *cmdo = (command_t *)malloc(sizeof(command_t) + len);
+    assert(cmdo != NULL);
+    memset(cmdo, 0, sizeof(command_t));
+    cmdo->cmd = cmd;
+    cmdo->subcmd = subcmd;
+    COPY_STRING(cmdo->fn_name, fn_name, SMALL_CMD_STR_LEN);
+    cmdo->task_id = taskid;
+    COPY_STRING(cmdo->node_id, node_id, LARGE_CMD_STR_LEN);
+    COPY_STRING(cmdo->fn_argsig, fn_argsig, SMALL_CMD_STR_LEN);
+    cmdo->args = NULL;
+    cmdo->buffer = cmdo->data;
+    memcpy(cmdo->buffer, a->data, len);
+    cmdo->length = len;
     cmdo->id = id++;
-    cmdo->refcount = 1;
-    pthread_mutex_init(&cmdo->lock, NULL);
-    cmdo->length = cbor_encoder_get_buffer_size(&encoder, cmdo->buffer);
+    atomic_init(&cmdo->refcount, 1);
     return cmdo;
 }
 
-
 /*
  * Command from CBOR data. If the fmt is non NULL, then we use
  * the specification in fmt to validate the parameter ordering.
@@ -205,7 +280,8 @@ command_t *command_from_data(char *fmt, void *data, int len)
     int result;
     double dresult;
 
-    command_t *cmd = (command_t *)calloc(1, sizeof(command_t));
+    command_t *cmd = (command_t *)calloc(1, sizeof(command_t) + len);
+    cmd->buffer = cmd->data;
     memcpy(cmd->buffer, data, len);
     cmd->length = len;
     cbor_parser_init(cmd->buffer, len, 0, &parser, &it);
@@ -230,6 +306,14 @@ command_t *command_from_data(char *fmt, void *data, int len)
                 cbor_value_get_int(&map, &result);
                 cmd->task_id = result;
             }
+        } else if (strcmp(keybuf, "deadline") == 0) {
+            if (cbor_value_get_type(&map) == CborDoubleType) {
+                cbor_value_get_double(&map, &dresult);
+                cmd->deadline = (long int)dresult;
+            } else {
+                cbor_value_get_int(&map, &result);
+                cmd->deadline = result;
+            }
         } else if (strcmp(keybuf, "nodeid") == 0) {
             length = LARGE_CMD_STR_LEN;
             if (cbor_value_is_text_string(&map)) 
@@ -292,8 +376,317 @@ command_t *command_from_data(char *fmt, void *data, int len)
         }
         cbor_value_advance(&map);
     }
-    cmd->refcount = 1;
-    pthread_mutex_init(&cmd->lock, NULL);
+    atomic_init(&cmd->refcount, 1);
+    cmd->id = id++;
+    return cmd;
+}
+
+
+/*
+ * The zero-copy decoder. Keys are interned by their length and first character
+ * (confirmed by one memcmp) instead of being copied out and strcmp'ed in turn.
+ */
+enum command_key_t {
+    CMD_KEY_UNKNOWN,
+    CMD_KEY_CMD,
+    CMD_KEY_SUBCMD,
+    CMD_KEY_FN_NAME,
+    CMD_KEY_TASKID,
+    CMD_KEY_NODEID,
+    CMD_KEY_FN_ARGSIG,
+    CMD_KEY_ARGS,
+    CMD_KEY_DEADLINE
+};
+
+#define KEY_IS(k, len, s)       ((len) == sizeof(s) - 1 && memcmp(k, s, sizeof(s) - 1) == 0)
+
+static enum command_key_t command_key_intern(const char *k, size_t len)
+{
+    switch (len) {
+        case 3:
+            return KEY_IS(k, len, "cmd") ? CMD_KEY_CMD : CMD_KEY_UNKNOWN;
+        case 4:
+            return KEY_IS(k, len, "args") ? CMD_KEY_ARGS : CMD_KEY_UNKNOWN;
+        case 6:
+            switch (k[0]) {
+                case 's':
+                    return KEY_IS(k, len, "subcmd") ? CMD_KEY_SUBCMD : CMD_KEY_UNKNOWN;
+                case 't':
+                    return KEY_IS(k, len, "taskid") ? CMD_KEY_TASKID : CMD_KEY_UNKNOWN;
+                case 'n':
+                    return KEY_IS(k, len, "nodeid") ? CMD_KEY_NODEID : CMD_KEY_UNKNOWN;
+            }
+            return CMD_KEY_UNKNOWN;
+        case 7:
+            return KEY_IS(k, len, "fn_name") ? CMD_KEY_FN_NAME : CMD_KEY_UNKNOWN;
+        case 8:
+            return KEY_IS(k, len, "deadline") ? CMD_KEY_DEADLINE : CMD_KEY_UNKNOWN;
+        case 9:
+            return KEY_IS(k, len, "fn_argsig") ? CMD_KEY_FN_ARGSIG : CMD_KEY_UNKNOWN;
+    }
+    return CMD_KEY_UNKNOWN;
+}
+
+/*
+ * Point into the CBOR buffer at the contents of a text or byte string. Only
+ * definite-length strings come in one piece; chunked strings return false.
+ */
+static bool cbor_value_borrow_string(const CborValue *value, const char **ptr, size_t *len)
+{
+    CborValue it = *value;
+    CborError err;
+
+    if (!cbor_value_is_length_known(&it) || cbor_value_begin_string_iteration(&it) != CborNoError)
+        return false;
+    if (cbor_value_is_text_string(&it))
+        err = cbor_value_get_text_string_chunk(&it, ptr, len, NULL);
+    else
+        err = cbor_value_get_byte_string_chunk(&it, (const uint8_t **)ptr, len, NULL);
+    return err == CborNoError && *ptr != NULL;
+}
+
+static bool command_view_borrow_str(const CborValue *value, const char **ptr, int *len)
+{
+    size_t l = 0;
+
+    if (!cbor_value_is_text_string(value)) { // e.g. a null node id
+        *ptr = "";
+        *len = 0;
+        return true;
+    }
+    if (!cbor_value_borrow_string(value, ptr, &l))
+        return false;
+    *len = (int)l;
+    return true;
+}
+
+static long int command_view_get_long(const CborValue *value)
+{
+    int64_t lval = 0;
+    double dval;
+
+    if (cbor_value_is_integer(value))
+        cbor_value_get_int64(value, &lval);
+    else if (cbor_value_is_double(value)) {
+        cbor_value_get_double(value, &dval);
+        lval = (int64_t)dval;
+    }
+    return lval;
+}
+
+/*
+ * Decode the command header in @data without copying it. Returns false if @data
+ * is not a command map or uses chunked strings in the header fields; those are
+ * left to command_from_data().
+ */
+bool command_view_init(command_view_t *v, const void *data, int len)
+{
+    CborValue it, map;
+    const char *key;
+    size_t klen;
+    enum command_key_t k;
+
+    memset(v, 0, sizeof(command_view_t));
+    v->fn_name = v->node_id = v->fn_argsig = "";
+    if (cbor_parser_init((const uint8_t *)data, len, 0, &v->parser, &it) != CborNoError ||
+        !cbor_value_is_map(&it) || cbor_value_enter_container(&it, &map) != CborNoError)
+        return false;
+
+    while (!cbor_value_at_end(&map)) {
+        k = CMD_KEY_UNKNOWN;
+        if (cbor_value_is_text_string(&map)) {
+            if (!cbor_value_borrow_string(&map, &key, &klen))
+                return false;
+            k = command_key_intern(key, klen);
+        }
+        if (cbor_value_advance(&map) != CborNoError || cbor_value_at_end(&map))
+            return false;
+        switch (k) {
+            case CMD_KEY_CMD:
+                v->cmd = (int)command_view_get_long(&map);
+            break;
+            case CMD_KEY_SUBCMD:
+                v->subcmd = (int)command_view_get_long(&map);
+            break;
+            case CMD_KEY_TASKID:
+                v->task_id = command_view_get_long(&map);
+            break;
+            case CMD_KEY_DEADLINE:
+                v->deadline = command_view_get_long(&map);
+            break;
+            case CMD_KEY_FN_NAME:
+                if (!command_view_borrow_str(&map, &v->fn_name, &v->fn_name_len))
+                    return false;
+            break;
+            case CMD_KEY_NODEID:
+                if (!command_view_borrow_str(&map, &v->node_id, &v->node_id_len))
+                    return false;
+            break;
+            case CMD_KEY_FN_ARGSIG:
+                if (!command_view_borrow_str(&map, &v->fn_argsig, &v->fn_argsig_len))
+                    return false;
+            break;
+            case CMD_KEY_ARGS:
+                if (cbor_value_is_array(&map)) {
+                    v->args = map;
+                    v->has_args = true;
+                }
+            break;
+            default:
+            break;
+        }
+        if (cbor_value_advance(&map) != CborNoError)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Materialise the args of the view. Strings are duplicated and byte strings are
+ * wrapped in a nvoid_t, so the result outlives the payload. @extra slots are added
+ * at the end for the caller to fill (they are counted in nargs).
+ * Returns NULL if there are no args and @extra is 0.
+ */
+arg_t *command_view_args(command_view_t *v, int extra)
+{
+    CborValue arr;
+    size_t nelems = 0;
+    const char *ptr;
+    size_t length;
+    int64_t lval;
+    double dval;
+    float fval;
+    arg_t *args;
+    int i = 0;
+
+    if (v->has_args && cbor_value_get_array_length(&v->args, &nelems) != CborNoError) {
+        // indefinite length array, count the elements
+        cbor_value_enter_container(&v->args, &arr);
+        while (!cbor_value_at_end(&arr) && cbor_value_advance(&arr) == CborNoError)
+            nelems++;
+    }
+    if (nelems + extra == 0)
+        return NULL;
+
+    args = (arg_t *)calloc(nelems + extra, sizeof(arg_t));
+    assert(args != NULL);
+    for (i = 0; i < (int)nelems + extra; i++)
+        args[i].nargs = nelems + extra;
+    if (nelems == 0)
+        return args;
+
+    i = 0;
+    cbor_value_enter_container(&v->args, &arr);
+    while (!cbor_value_at_end(&arr) && i < (int)nelems) {
+        switch (cbor_value_get_type(&arr)) {
+            case CborIntegerType:
+                cbor_value_get_int64(&arr, &lval);
+                if (lval == (int)lval) {
+                    args[i].type = INT_TYPE;
+                    args[i].val.ival = (int)lval;
+                } else {
+                    args[i].type = LONG_TYPE;
+                    args[i].val.lval = lval;
+                }
+            break;
+            case CborTextStringType:
+                args[i].type = STRING_TYPE;
+                if (cbor_value_borrow_string(&arr, &ptr, &length))
+                    args[i].val.sval = strndup(ptr, length);
+                else
+                    cbor_value_dup_text_string(&arr, &args[i].val.sval, &length, NULL);
+            break;
+            case CborByteStringType:
+                args[i].type = NVOID_TYPE;
+                if (cbor_value_borrow_string(&arr, &ptr, &length))
+                    args[i].val.nval = nvoid_new((void *)ptr, length);
+                else {
+                    uint8_t *buf = NULL;
+                    cbor_value_dup_byte_string(&arr, &buf, &length, NULL);
+                    args[i].val.nval = nvoid_new(buf, length);
+                    free(buf);
+                }
+            break;
+            case CborFloatType:
+                args[i].type = DOUBLE_TYPE;
+                cbor_value_get_float(&arr, &fval);
+                args[i].val.dval = fval;
+            break;
+            case CborDoubleType:
+                args[i].type = DOUBLE_TYPE;
+                cbor_value_get_double(&arr, &dval);
+                args[i].val.dval = dval;
+            break;
+            default:
+            break;
+        }
+        i++;
+        if (cbor_value_advance(&arr) != CborNoError)
+            break;
+    }
+    return args;
+}
+
+/*
+ * Copy a borrowed (not null terminated) string into a fixed size field,
+ * truncating like COPY_STRING does.
+ */
+void command_view_copy_str(char *dst, const char *src, int len, int size)
+{
+    if (len > size - 1)
+        len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/*
+ * Start iterating over the commands of a batch. Returns false if @data is not an
+ * array, i.e. a single command.
+ */
+bool command_batch_init(command_batch_t *b, const void *data, int len)
+{
+    CborValue it;
+
+    return cbor_parser_init((const uint8_t *)data, len, 0, &b->parser, &it) == CborNoError &&
+           cbor_value_is_array(&it) && cbor_value_enter_container(&it, &b->items) == CborNoError;
+}
+
+/*
+ * The bytes of the next command in the batch, to be decoded on their own with
+ * command_view_init() or command_from_data(). Returns false at the end of the batch
+ * or if it is malformed.
+ */
+bool command_batch_next(command_batch_t *b, const void **item, int *len)
+{
+    const uint8_t *start;
+
+    if (cbor_value_at_end(&b->items))
+        return false;
+    start = cbor_value_get_next_byte(&b->items);
+    if (cbor_value_advance(&b->items) != CborNoError)
+        return false;
+    *item = start;
+    *len = (int)(cbor_value_get_next_byte(&b->items) - start);
+    return true;
+}
+
+/*
+ * Command from the decoded view, for messages that outlive the payload (e.g. a
+ * REXEC whose task keeps the arguments). The raw bytes are not kept, so length is 0.
+ */
+command_t *command_from_view(command_view_t *v)
+{
+    command_t *cmd = (command_t *)calloc(1, sizeof(command_t));
+
+    cmd->cmd = v->cmd;
+    cmd->subcmd = v->subcmd;
+    cmd->task_id = v->task_id;
+    cmd->deadline = v->deadline;
+    command_view_copy_str(cmd->fn_name, v->fn_name, v->fn_name_len, SMALL_CMD_STR_LEN);
+    command_view_copy_str(cmd->node_id, v->node_id, v->node_id_len, LARGE_CMD_STR_LEN);
+    command_view_copy_str(cmd->fn_argsig, v->fn_argsig, v->fn_argsig_len, SMALL_CMD_STR_LEN);
+    cmd->args = command_view_args(v, 0);
+    atomic_init(&cmd->refcount, 1);
     cmd->id = id++;
     return cmd;
 }
@@ -301,18 +694,14 @@ command_t *command_from_data(char *fmt, void *data, int len)
 
 void command_hold(command_t *cmd)
 {
-    pthread_mutex_lock(&cmd->lock);
-    cmd->refcount++;
-    pthread_mutex_unlock(&cmd->lock);
+    atomic_fetch_add_explicit(&cmd->refcount, 1, memory_order_relaxed);
 }
 
 void command_free(command_t *cmd)
 {
     int nargs;
     int rc;
-    pthread_mutex_lock(&cmd->lock);
-    rc = --cmd->refcount;
-    pthread_mutex_unlock(&cmd->lock);
+    rc = atomic_fetch_sub_explicit(&cmd->refcount, 1, memory_order_acq_rel) - 1;
 
     // don't free the structure if some other thread could be referring to it.
     if (rc > 0)
@@ -475,7 +864,7 @@ void command_print(command_t *cmd)
     printf("\nCommand fn_argsig: %s\n", cmd->fn_argsig);
 
     printf("\nCommand buffer: ");
-    for (i = 0; i < (int)strlen((char *)cmd->buffer); i++)
+    for (i = 0; i < cmd->length; i++)
         printf("%x", (int)cmd->buffer[i]);
 
     command_arg_print(cmd->args);
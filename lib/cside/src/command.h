@@ -31,6 +31,7 @@ extern "C" {
 #include <tinycbor/cbor.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "nvoid.h"
 
 
@@ -50,6 +51,9 @@ typedef enum {
 #define LARGE_CMD_STR_LEN           128
 #define HUGE_CMD_STR_LEN            1024
 
+// initial size of the per-thread buffer commands are encoded into, it grows on demand
+#define CMD_ARENA_INITIAL_SIZE      256
+
 typedef struct _arg_t
 {
     int nargs;
@@ -73,6 +77,9 @@ typedef struct _arg_t
  * a CBOR formatted byte array is decoded into a CBOR item handle.
  * Also, information is extracted from the CBOR item and inserted into the
  * command structure at the decoding process.
+ * The CBOR bytes are stored right behind the structure (data[]) and sized exactly,
+ * so a command is a single allocation released by command_free(). Commands
+ * decoded with command_from_view() carry no bytes (buffer is NULL).
  */
 typedef struct _command_t
 {
@@ -85,14 +92,15 @@ typedef struct _command_t
     long int task_id;                           // Task identifier (a function in execution)
     char node_id[LARGE_CMD_STR_LEN];            // this can be the UUID4 of the node
     char fn_argsig[SMALL_CMD_STR_LEN];          // Argument signature of the functions - use fmask format
-    unsigned char buffer[HUGE_CMD_STR_LEN];     // CBOR byte array in raw byte form
+    unsigned char *buffer;                      // CBOR byte array in raw byte form (points to data)
     int length;                                 // length of the raw CBOR data
 
-    arg_t *args;                                // List of args
+    arg_t *args;                                // List of args (incoming commands only)
+    long int deadline;                          // REXEC: microseconds from arrival, 0 for none
 
-    int refcount;                               // Deallocation control
-    pthread_mutex_t lock;
+    atomic_int refcount;                        // Deallocation control
     long id;
+    unsigned char data[];
 } command_t;
 
 
@@ -104,15 +112,58 @@ typedef struct _internal_command_t
     int cmd;
     long int task_id;
     arg_t *args;
+    void *serv;             // server_t the reply came from
 } internal_command_t;
 
+/*
+ * A decoded view of an incoming command. The view borrows the CBOR bytes it was
+ * decoded from (e.g. the mosquitto message payload), so it is only valid while that
+ * buffer is - usually the duration of the message callback. The strings point into
+ * the payload and are NOT null terminated. The args array is left encoded until
+ * somebody that keeps the arguments asks for them with command_view_args().
+ * The view holds its own CborParser, so it must not be copied by value.
+ */
+typedef struct _command_view_t
+{
+    int cmd;
+    int subcmd;
+    long int task_id;
+    const char *fn_name;
+    int fn_name_len;
+    const char *node_id;
+    int node_id_len;
+    const char *fn_argsig;
+    int fn_argsig_len;
+    long int deadline;
+    bool has_args;
+    CborValue args;                             // positioned at the args array
+    CborParser parser;
+} command_view_t;
+
+/*
+ * Iterator over a batch of commands: a CBOR array of command maps, see wire.h.
+ * Like the view it borrows the bytes it was initialised with.
+ */
+typedef struct _command_batch_t
+{
+    CborValue items;
+    CborParser parser;
+} command_batch_t;
+
 internal_command_t *internal_command_new(command_t *cmd);
+internal_command_t *internal_command_from_view(command_view_t *v);
 void internal_command_free(internal_command_t *ic);
 
 command_t *command_new(int cmd, int subcmd, char *fn_name, 
                     long int task_id, char *node_id, char *fn_argsig, ...);
 command_t *command_new_using_arg(int cmd, int opt, char *fn_name, long int taskid, char *node_id, char *fn_argsig, arg_t *args);
 command_t *command_from_data(char *fn_argsig, void *data, int len);
+bool command_view_init(command_view_t *v, const void *data, int len);
+arg_t *command_view_args(command_view_t *v, int extra);
+void command_view_copy_str(char *dst, const char *src, int len, int size);
+command_t *command_from_view(command_view_t *v);
+bool command_batch_init(command_batch_t *b, const void *data, int len);
+bool command_batch_next(command_batch_t *b, const void **item, int *len);
 void command_hold(command_t *cmd);
 void command_free(command_t *cmd);
 bool command_qargs_alloc(const char *fmt, arg_t **rargs, va_list args);
@@ -27,8 +27,10 @@
 #define CmdNames_REXEC_ERR 5045
 #define CmdNames_REXEC_SYN 5050
 #define CmdNames_GET_REXEC_RES 5060
+#define CmdNames_REXEC_CANCEL 5080
 #define CmdNames_COND_FALSE 5810
 #define CmdNames_FUNC_NOT_FOUND 5820
+#define CmdNames_OVERLOAD 5830
 #define CmdNames_SET_JSYS 6000
 #define CmdNames_CLOSE_PORT 6200
 
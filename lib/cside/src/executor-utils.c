@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <assert.h>
 #include "tboard.h"
 #include "sleeping.h"
 
@@ -35,40 +37,67 @@ void dummy_next_timeout_event(void *arg)
 
 }
 
+void dummy_next_log_flush(void *arg)
+{
+
+}
+
+void dummy_next_wire_flush(void *arg)
+{
+
+}
+
+void dummy_next_future_timeout(void *arg)
+{
+
+}
+
 /*
- * This function is run to make a new schedule - from the one that is found 
- * in the taskboard - schedule object. The schedule has a specific length. 
- * At the end of the schedule - we put a TW_EVENT_INSTALL_SCHEDULE. For other 
- * types we install the proper event: TW_EVENT_RT_SCHEDULE, etc. 
+ * This function moves the schedule cursor to the next slot and arms the slot timer for
+ * it. The compiled schedule has a specific length, its last entry is the end of the
+ * epoch (a TW_EVENT_INSTALL_SCHEDULE). There we start the next epoch, with the schedule
+ * received from the controller meanwhile if there is one.
  *
- * IMPORTANT: at bootstrap, we install a default schedule. if the schedule is 
- * received from the controller, then we install it. 
- * PARAMS: taskboard and end time
+ * IMPORTANT: until a schedule is received from the controller there is none, and
+ * no slot timer is armed.
  */
-void install_next_schedule(tboard_t *tb, long int etime)
+void schedule_advance(tboard_t *tb)
 {
-    long int stime = getcurtime();
-    stime = etime > stime ? etime : stime;
-
-    pthread_mutex_lock(&tb->schmutex);
-    twheel_add_event(tb, TW_EVENT_INSTALL_SCHEDULE, NULL, stime + tb->sched.len);
-    for (int i  = 0; i < tb->sched.rtslots; i++)
-        twheel_add_event(tb, TW_EVENT_RT_SCHEDULE, NULL, stime + tb->sched.rtstarts[i]);
-    for (int i  = 0; i < tb->sched.syslots; i++)
-        twheel_add_event(tb, TW_EVENT_SY_SCHEDULE, NULL, stime + tb->sched.systarts[i]);
-    pthread_mutex_unlock(&tb->schmutex);
+    schedtab_t *next;
+    long int now, end = 0;
+
+    if (tb->sched != NULL && tb->schedpos < tb->sched->nslots) {
+        tb->schedpos++;
+    } else {
+        if (tb->sched != NULL)
+            end = tb->epoch + tb->sched->len;
+        if ((next = schedtab_take(&(tb->schednext))) != NULL) {
+            // nobody else reads the old table, we just left its last slot
+            free(tb->sched);
+            tb->sched = next;
+        }
+        if (tb->sched == NULL)
+            return;
+        // an epoch starts where the previous one ended, so the cycle keeps its phase,
+        // unless we fell behind by a whole epoch (stopped in a debugger, say)
+        now = getcurtime();
+        tb->epoch = end != 0 && now - end < tb->sched->len ? end : now;
+        tb->schedpos = 0;
+    }
+    twheel_arm_slot(tb, tb->sched->slots[tb->schedpos].type, tb->epoch + tb->sched->slots[tb->schedpos].start);
 }
 
 /*
- * This function waits for the SY slot time.. using busy waiting.. so we can
- * precisely start the SY task at that point. This function does not start the task 
- * or even set the execution mode. We just wait until the correct time. 
+ * This function waits for the slot start time @stime (us), the slot event fired a bit
+ * early. It sleeps and then spins on the clock so we can precisely start the slot at
+ * that point, and records how late we got there. This function does not start the task
+ * or even set the execution mode. We just wait until the correct time.
  */
-void wait_to_sy_slot(tboard_t *tb, void *arg, long int stime)
+void wait_to_slot(tboard_t *tb, int slot, long int stime)
 {
-    long int tremain = stime - getcurtime();
-    if (tremain > 0)
-        smart_sleep(&(tb->sleeper), tremain);
+    int64_t late = sleep_until(&(tb->sleeper), (int64_t)stime * 1000);
+
+    lathist_record(&(tb->slotlat[slot]), late);
 }
 
 /*
@@ -76,9 +105,8 @@ void wait_to_sy_slot(tboard_t *tb, void *arg, long int stime)
  */
 void process_sleep_event(tboard_t *t, void *arg)
 {
-    remote_task_t *rtask = NULL;
+    remote_task_t *rtask = rtable_remove(t->task_table, (long int)arg);
 
-    HASH_FIND_INT(t->task_table, ((long int *)arg), rtask);
     if (rtask != NULL)
     {
         if (rtask->calling_task != NULL)
@@ -88,22 +116,32 @@ void process_sleep_event(tboard_t *t, void *arg)
             // place parent task back to appropriate queue - should be batch
             task_place(t, rtask->calling_task);
         }
+        twheel_release_rtask(t, rtask);
     }
 }
 
+/*
+ * The timeout that expired is the one inside the remote task, @arg is the task id.
+ * Placed remote tasks are only freed on the pExecutor, which is running this, so
+ * finding the remote task in the table means it is alive.
+ */
 void process_timeout_event(tboard_t *t, void *arg)
 {
-    remote_task_t *rtask = NULL;
+    remote_task_t *rtask = rtable_find(t->task_table, (long int)arg);
 
-    if (arg != NULL) {
-        HASH_FIND_INT(t->task_table, ((long int *)arg), rtask);
-        if (rtask != NULL)
-        {
-            if (rtask->status == RTASK_ACK_PENDING || rtask->status == RTASK_RES_PENDING) {
-                rtask->retries--;
-                if (rtask->retries > 0) 
-                    remote_task_place(t, rtask);
+    if (rtask != NULL)
+    {
+        if (rtask->hedge == HEDGE_STAGGERED) {
+            // the device J is slower than usual, the others get the request as well
+            remote_task_hedge(t, rtask);
+            return;
+        }
+        if (rtask->status == RTASK_ACK_PENDING || rtask->status == RTASK_RES_PENDING) {
+            rtask->retries--;
+            if (rtask->retries > 0) {
+                twheel_timer_arm(t, &(rtask->timer), getcurtime() + REXEC_TIMEOUT);
+                remote_task_send(t, rtask->level, remote_task_command(t, rtask));
             }
         }
     }
-}
\ No newline at end of file
+}
@@ -1,14 +1,16 @@
 /* This controls the primary executor and secondary executor */
 
-#include <sys/time.h>
 #include "tboard.h"
 #include "queue/queue.h"
 #include "executor.h"
 #include <pthread.h>
 #include "constants.h"
+#include "jdata.h"
+#include "wire.h"
+#include "future.h"
 #include <assert.h> // assert()
 
-#include "tprofiler.h"
+#include "trace.h"
 
 enum execmodes_t {
     BATCH_MODE_EXEC = 1,
@@ -30,127 +32,179 @@ enum execmodes_t {
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);       \
 } while(0)
 
-#define conditional_wait(X, Y) do {                             \
-    pthread_mutex_lock(X);                                      \
-    pthread_cond_wait(Y, X);                                    \
-    pthread_mutex_unlock(X);                                    \
-} while (0)
-
-#define conditional_timedwait(X, Y, T) do {                     \
-    struct timespec __wait_time;                                \
-    pthread_mutex_lock(X);                                      \
-    convert_time_to_absolute(T, &__wait_time);                  \
-    pthread_cond_timedwait(Y, X, &__wait_time);                 \
-    pthread_mutex_unlock(X);                                    \
-} while (0);
-
-void convert_time_to_absolute(struct timespec *t, struct timespec *abt) 
-{
-    struct timeval tnow;
-    gettimeofday(&tnow, NULL);
-    abt->tv_sec = t->tv_sec + tnow.tv_sec;
-    abt->tv_nsec = t->tv_nsec + tnow.tv_usec * 1000;
-}
-
-
-void process_timing_wheel(tboard_t *tboard, enum execmodes_t *mode)
+void process_timing_wheel(tboard_t *tboard, enum execmodes_t *mode, long int *slot_end)
 {
     twheel_update_to_now(tboard);
     struct timeout *t = NULL;
+    struct timeout_cb slot;
     *mode = BATCH_MODE_EXEC;
 
+    // the first schedule starts as soon as it arrives, later ones at the end of an epoch
+    if (tboard->sched == NULL && atomic_load_explicit(&(tboard->schednext), memory_order_relaxed) != NULL)
+        schedule_advance(tboard);
     do {
         t = twheel_get_next(tboard);
         if (t != NULL) {
-            if (t->callback.fn == dummy_next_schedule) {
-                install_next_schedule(tboard, t->expires);
-            } else if (t->callback.fn == dummy_next_sy_slot) {
-                *mode = SYNC_MODE_EXEC;
-                wait_to_sy_slot(tboard, t->callback.arg, t->expires);
-                break;
-            } else if (t->callback.fn == dummy_next_rt_slot) {
-                *mode = RT_MODE_EXEC;
-                twheel_add_event(tboard, TW_EVENT_RT_CLOSE, NULL, t->expires + RT_SLOT_LEN);
-                break;
+            if (t == &(tboard->schedto)) {
+                // the slot timer moves on to the next slot right away
+                slot = t->callback;
+                schedule_advance(tboard);
+                if (slot.fn == dummy_next_sy_slot) {
+                    *mode = SYNC_MODE_EXEC;
+                    wait_to_slot(tboard, SLOTLAT_SY, (long int)slot.arg);
+                    break;
+                } else if (slot.fn == dummy_next_rt_slot) {
+                    *mode = RT_MODE_EXEC;
+                    wait_to_slot(tboard, SLOTLAT_RT, (long int)slot.arg);
+                    *slot_end = (long int)slot.arg + RT_SLOT_LEN;
+                    twheel_add_event(tboard, TW_EVENT_RT_CLOSE, NULL, *slot_end);
+                    break;
+                }
+                continue;   // end of the epoch
             } else if (t->callback.fn == dummy_close_rt_slot) {
                 *mode = BATCH_MODE_EXEC;
             } else if (t->callback.fn == dummy_next_sleep_event) {
                 process_sleep_event(tboard, t->callback.arg);
+                continue;   // these timers belong to a remote task or a logger
             } else if (t->callback.fn == dummy_next_timeout_event) {
                 process_timeout_event(tboard, t->callback.arg);
+                continue;
+            } else if (t->callback.fn == dummy_next_log_flush) {
+                jdata_log_deadline(t->callback.arg);
+                continue;
+            } else if (t->callback.fn == dummy_next_wire_flush) {
+                wire_deadline(t->callback.arg);
+                continue;
+            } else if (t->callback.fn == dummy_next_future_timeout) {
+                futures_expire(tboard, t->callback.arg);
+                continue;
             }
-            free(t);
+            twheel_put_event(tboard, t);
         }
     } while (t != NULL);
 }
 
-struct queue_entry *get_next_task(tboard_t *tboard, int etype, enum execmodes_t mode, int num, struct queue **q, pthread_mutex_t **mutex, pthread_cond_t **cond) 
+__thread exec_t *current_exec = NULL;
+
+void task_sequencer(tboard_t *tboard)
+{
+    task_t *task;
+
+    // tasks without a deadline sort after every deadline, in arrival order
+    while ((task = taskq_pop(&(tboard->pqueue_sy))) != NULL)
+        assert(dheap_push(&(tboard->syheap), task->deadline != 0 ? task->deadline : UINT64_MAX, task));
+    while ((task = taskq_pop(&(tboard->pqueue_rt))) != NULL)
+        assert(dheap_push(&(tboard->rtheap), task->deadline != 0 ? task->deadline : UINT64_MAX, task));
+}
+
+/*
+ * Steal a task from the top of another sExecutor's deque. Victims are visited
+ * starting at a random one so that thieves spread out.
+ */
+task_t *steal_task(tboard_t *tboard, exec_t *self)
 {
-    struct queue_entry *next = NULL; // queue entry of ready queue
+    task_t *next = NULL;
+    int n = tboard->sqs;
 
-    if (etype == PRIMARY_EXECUTOR) { // we're in pExec
-        // check if any primary tasks are waiting in primary ready queue
-        pthread_mutex_lock(&(tboard->pmutex));
-        *mutex = &(tboard->pmutex);
-        *cond = &(tboard->pcond);
+    // xorshift - rand() takes a lock in glibc
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 17;
+    self->seed ^= self->seed << 5;
+    int v = self->seed % n;
+    for (int i = 0; i < n && next == NULL; i++, v = (v + 1) % n) {
+        if (v != self->num)
+            next = wsdeque_steal(&(tboard->sdeque[v]));
+    }
+    return next;
+}
+
+task_t *get_next_task(tboard_t *tboard, exec_t *self, enum execmodes_t mode, long int slot_end, taskq_t **q)
+{
+    task_t *next = NULL; // next task to run
+
+    if (self->type == PRIMARY_EXECUTOR) { // we're in pExec
+        // check if any primary tasks are waiting in primary ready queue, SY and RT
+        // tasks are taken earliest deadline first
         switch (mode) {
             case SYNC_MODE_EXEC:
                 *q = &(tboard->pqueue_sy);
+                task_sequencer(tboard);
+                next = dheap_pop(&(tboard->syheap));
             break;
             case RT_MODE_EXEC:
                 *q = &(tboard->pqueue_rt);
+                task_sequencer(tboard);
+                next = dheap_pop(&(tboard->rtheap));
+                // an RT task is due by the end of the slot it starts in
+                if (next != NULL && next->deadline == 0)
+                    next->deadline = (uint64_t)slot_end * 1000;
             break;
             case BATCH_MODE_EXEC:
                 *q = &(tboard->pqueue_ba);
+                next = taskq_pop(*q);
             break;
         }
-        next = queue_peek_front(*q);
-        if (next)   // we found a primary task so we pop it
-            queue_pop_head(*q);
-        pthread_mutex_unlock(&(tboard->pmutex));
-    } else { // we're in sExec, check if any task exists
-        for (int i=0; i<tboard->sqs; i++) {
-            // lock appropriate mutex
-            pthread_mutex_lock(&(tboard->smutex[i]));
-            *q = &(tboard->squeue[i]);
-            next = queue_peek_front(*q);
-            if (next) { // found a task to run, pop it and stop searching
-                queue_pop_head(*q);
-                *mutex = &(tboard->smutex[i]);
-                *cond = &(tboard->scond[i]);
-                pthread_mutex_unlock(&(tboard->smutex[i]));
-                break;
-            }
-            pthread_mutex_unlock(&(tboard->smutex[i]));
+    } else { // we're in sExec: own deque, tasks on our shared stack, the injection queue, then steal
+        *q = &(tboard->sinject); // yielded tasks go to the back of the injection queue
+        if ((++self->ticks % SECONDARY_INJECT_POLL_INTERVAL) == 0) {
+            next = taskq_pop(&(tboard->shome[self->num]));
+            if (next == NULL)
+                next = taskq_pop(&(tboard->sinject));
         }
+        if (next == NULL)
+            next = wsdeque_pop(&(tboard->sdeque[self->num]));
+        if (next == NULL)
+            next = taskq_pop(&(tboard->shome[self->num]));
+        if (next == NULL)
+            next = taskq_pop(&(tboard->sinject));
+        if (next == NULL)
+            next = steal_task(tboard, self);
     }
     return next;
 }
 
-void process_next_task(tboard_t *tboard, int type, struct queue **q, struct queue_entry *next, pthread_mutex_t *mutex, pthread_cond_t *cond)
+void process_next_task(tboard_t *tboard, int type, taskq_t *q, task_t *task)
 {
-//    get_snapshot(0);
-    ////////// Get queue data, and swap context to function until task yields ///////////
-    task_t *task = ((task_t *)(next->data));
+    uint64_t start = trace_now(), wait = task->qtime != 0 ? start - task->qtime : 0;
+
+    history_record_wait(task, wait);
+    if (trace_on())
+        trace_emit(task->status == TASK_INITIALIZED ? TRACE_TASK_START : TRACE_TASK_RESUME, (uint64_t)task,
+                   task->fn.fn_name, wait / 1000);
+    ////////// Swap context to function until task yields ///////////
     task->status = TASK_RUNNING; // update status incase first run
-//    get_snapshot(1);
+    if (task->ss.shared)
+        sstack_enter(&(current_exec->sstack), task); // bring its frames back
+    current_exec->task = task;
     mco_resume(task->ctx); // swap context to task
-//    get_snapshot(2);
+    current_exec->task = NULL;
+    task->cpu_time += trace_now() - start;
+    // the stack runs into the coroutine header when it overflows, and the heap block
+    // below that is gone as well: nothing is safe to run anymore
+    if (!sstack_coro_intact(task->ctx)) {
+        tboard_err("process_next_task: Task %s overflowed its %zu byte stack.\n", task->fn.fn_name, task->ctx->stack_size);
+        abort();
+    }
 
     // check status of task
     int status = mco_status(task->ctx);
+    if (task->ss.shared)
+        sstack_leave(&(current_exec->sstack), task, status == MCO_DEAD);
+    trace_event(status == MCO_SUSPENDED ? TRACE_TASK_YIELD : TRACE_TASK_COMPLETE, task, task->fn.fn_name, 0);
     if (status == MCO_SUSPENDED) { // task yielded
-  //      get_snapshot(3);
         task->yields++; // increment # yields of specific task
-        task->hist->yields++; // increment total # yields in history hash table
-        struct queue_entry *e = NULL;
+        history_record_yield(task); // increment total # yields in history hash table
+        bool requeue = false;
         // check if task yielded with special instruction
         if (mco_get_bytes_stored(task->ctx) == sizeof(task_t)) {
             // indicative of blocking local task creation, so we must retrieve it
-            task_t *subtask = calloc(1, sizeof(task_t)); // freed on termination
+            task_t *subtask = taskpool_task_alloc(tboard->tpool); // freed on termination
             assert(mco_pop(task->ctx, subtask, sizeof(task_t)) == MCO_SUCCESS);
             // save issuing task_t object in subtask task_t object
             subtask->parent = task;
+            // it runs in place of its parent, and by the same deadline
+            if (subtask->deadline == 0)
+                subtask->deadline = task->deadline;
             // place task in appropriate queue corresponding to subtask->type
             task_place(tboard, subtask);
         } else if (mco_get_bytes_stored(task->ctx) == sizeof(remote_task_t)) {
@@ -159,43 +213,56 @@ void process_next_task(tboard_t *tboard, int type, struct queue **q, struct queu
             assert(mco_pop(task->ctx, rtask, sizeof(remote_task_t)) == MCO_SUCCESS);
             // task issuing task_t object in remote task object
             rtask->calling_task = task;
-            HASH_ADD_INT(tboard->task_table, task_id, rtask);
+            if (rtask->mode == TASK_MODE_SLEEPING)
+                twheel_timer_init(&(rtask->timer), TW_EVENT_BEGIN_JSLEEP, (void *)rtask->task_id);
+            else
+                twheel_timer_init(&(rtask->timer), TW_EVENT_REXEC_TIMEOUT, (void *)rtask->task_id);
 
             // if task is not blocking we wish to reinsert issuing task back into ready queue
             if (rtask->mode == TASK_MODE_REMOTE_NB)
-                e = queue_new_node(task);
-            // place remote task into appropriate message queue
-            if (rtask->mode != TASK_MODE_SLEEPING)
+                requeue = true;
+            if (!rtable_insert(tboard->task_table, rtask->task_id, rtask)) {
+                tboard_err("process_next_task: Remote task table is full, failing remote task %ld.\n", rtask->task_id);
+                if (rtask->mode != TASK_MODE_REMOTE_NB) {
+                    rtask->status = RTASK_ERROR;
+                    assert(mco_push(task->ctx, rtask, sizeof(remote_task_t)) == MCO_SUCCESS);
+                    requeue = true;
+                }
+                free(rtask);    // its timer was never armed
+            } else if (rtask->mode == TASK_MODE_SLEEPING)
+                twheel_timer_arm(tboard, &(rtask->timer), rtask->wake);
+            else
+                // place remote task into appropriate message queue
                 remote_task_place(tboard, rtask);
 
+        } else if (mco_get_bytes_stored(task->ctx) == sizeof(futures_t *)) {
+            // awaiting a group of futures, the pExecutor resumes the task
+            futures_t *fs;
+            assert(mco_pop(task->ctx, &fs, sizeof(futures_t *)) == MCO_SUCCESS);
+            futures_park(tboard, task, fs);
+        } else if (mco_get_bytes_stored(task->ctx) == sizeof(jdata_park_t)) {
+            // waiting for a broadcast value, jdata wakes the task
+            jdata_park_t p;
+            assert(mco_pop(task->ctx, &p, sizeof(jdata_park_t)) == MCO_SUCCESS);
+            jdata_park(tboard, task, &p);
         } else { // just a normal yield, so we create node to reinsert task into queue
-  //          get_snapshot(4);
-            e = queue_new_node(task);
-  //          get_snapshot(5);
+            requeue = true;
         }
 
-        if (e != NULL){
-     //       get_snapshot(6);
-            // reinsert task into queue it was taken out of
-            pthread_mutex_lock(mutex); // lock appropriate mutex
-            switch (task->type) {
-                case PRI_SYNC_TASK:
-                    queue_insert_tail(&(tboard->pqueue_sy), e);
-                break;
-                case PRI_REAL_TASK:
-                    queue_insert_tail(&(tboard->pqueue_rt), e);
-                break;
-                case PRI_BATCH_TASK:
-                    queue_insert_tail(&(tboard->pqueue_ba), e);
-            }
-            if(type == PRIMARY_EXECUTOR) pthread_cond_signal(cond); // we wish to wake secondary executors if they are asleep
-            pthread_mutex_unlock(mutex);
-    //        get_snapshot(7);
+        if (requeue) {
+            // reinsert task into queue it was taken out of, this executor is awake
+            // and will find it there. Its own queue if the frames are on our stack.
+            if (task->ss.home != NULL && task->ss.home->num >= 0)
+                q = &(tboard->shome[task->ss.home->num]);
+            task->qtime = trace_now();
+            taskq_push(q, task);
         }
     } else if (status == MCO_DEAD) { // task has terminated
         task->status = TASK_COMPLETED; // mark task as complete for history hash table
+        jdata_release_task(task);
         // record task execution statistics into history hash table
-        history_record_exec(tboard, task, &(task->hist)); 
+        history_record_exec(tboard, task);
+        admit_discharge(&(tboard->admit), task->cost);
 
         // check if task was blocking, if so we need to resume parent
         if (task->parent != NULL) { // blocking task just terminated, we wish to return parent to queue
@@ -222,14 +289,20 @@ void process_next_task(tboard_t *tboard, int type, struct queue **q, struct queu
         
         if (task->cmd_obj) 
             command_free((command_t *)task->cmd_obj);       // FIXME: THis is conflicting with release in the wrapper
-        mco_destroy(task->ctx);
+        mco_destroy(task->ctx);     // coroutine stack goes back to tboard->tpool
         // free task_t object
-        free(task);
+        taskpool_task_free(tboard->tpool, task);
     } else {
         printf("Unexpected status received: %d, will lose task.\n",status);
     }
 }
 
+/*
+ * Replies resolve a remote task by taking it out of the task table, so duplicate
+ * replies (ALL_LEVELS) find nothing. This runs on the pExecutor, which owns the
+ * timers and is the only one freeing placed remote tasks, so a remote task found
+ * in the table stays alive until we are done with it.
+ */
 void process_internal_command(tboard_t *t, internal_command_t *ic)
 {
     remote_task_t *rtask = NULL;    
@@ -237,89 +310,157 @@ void process_internal_command(tboard_t *t, internal_command_t *ic)
     switch (ic->cmd)
     {
     case CmdNames_REXEC_ACK:
-        HASH_FIND_INT(t->task_table, &(ic->task_id), rtask);
-        if (rtask != NULL)
-        {
-            rtask->status = RTASK_ACK_RECEIVED;
-            // blocking task - put back the timeout at a future time
-            if (rtask->mode == TASK_MODE_REMOTE) {
-                rtask->status = RTASK_RES_PENDING;
-                // TODO: args has a timeout value from remote - convert and add to the current time.
-                twheel_add_event(t, TW_EVENT_REXEC_TIMEOUT, clone_taskid(&(rtask->task_id)), getcurtime() + globals_Timeout_REXEC_ACK_TIMEOUT);
-            } else {
-                // if not blocking, remove it from the task table and destroy the remote task entry
-                HASH_DEL(t->task_table, rtask);
-                remote_task_destroy(rtask);
-            }
-        }
+        trace_event(TRACE_REXEC_ACK, ic->task_id, NULL, 0);
+        // blocking task - put back the timeout at a future time
+        rtask = rtable_find(t->task_table, ic->task_id);
+        if (rtask != NULL && (rtask->mode == TASK_MODE_REMOTE || rtask->mode == TASK_MODE_FUTURE)) {
+            rtask->status = RTASK_RES_PENDING;
+            // TODO: args has a timeout value from remote - convert and add to the current time.
+            // A staggered request keeps its timer, the ACK says nothing about the latency
+            if (rtask->hedge != HEDGE_STAGGERED)
+                twheel_timer_arm(t, &(rtask->timer), getcurtime() + globals_Timeout_REXEC_ACK_TIMEOUT);
+        } else if (rtask != NULL && (rtask = rtable_remove(t->task_table, ic->task_id)) != NULL)
+            // if not blocking, remove it from the task table and destroy the remote task entry
+            remote_task_destroy(t, rtask);
         internal_command_free(ic);
         break;
 
     case CmdNames_REXEC_RES:  
+        trace_event(TRACE_REXEC_RES, ic->task_id, NULL, 0);
         // find the task
-        HASH_FIND_INT(t->task_table, &(ic->task_id), rtask);
+        rtask = rtable_remove(t->task_table, ic->task_id);
+        // first reply wins, the servers still working on it are told to drop it
         if (rtask != NULL)
+            remote_task_answered(t, rtask, ic->serv);
+        if (rtask != NULL && rtask->mode == TASK_MODE_FUTURE)
+            futures_resolve(t, rtask, command_args_clone(ic->args));
+        else if (rtask != NULL)
         {
             rtask->data = command_args_clone(ic->args);
             rtask->data_size = 1;
-            if (rtask->calling_task != NULL)
+            if (rtask->mode == TASK_MODE_REMOTE && rtask->calling_task != NULL)
             {
                 rtask->status = RTASK_COMPLETED;
+                // the calling task gets its own copy of the remote task
                 assert(mco_push(rtask->calling_task->ctx, rtask, sizeof(remote_task_t)) == MCO_SUCCESS);
                 // place parent task back to appropriate queue
                 task_place(t, rtask->calling_task);
-            }
+                twheel_release_rtask(t, rtask);
+            } else
+                remote_task_destroy(t, rtask);
         }
         internal_command_free(ic);
         break;
 
     case CmdNames_REXEC_ERR:
+        trace_event(TRACE_REXEC_ERR, ic->task_id, NULL, 0);
         // find the task
-        HASH_FIND_INT(t->task_table, &(ic->task_id), rtask);
-        if (rtask != NULL)
+        rtask = rtable_remove(t->task_table, ic->task_id);
+        if (rtask != NULL && rtask->mode == TASK_MODE_FUTURE)
+            futures_resolve(t, rtask, NULL);
+        else if (rtask != NULL)
         {
-            if (rtask->calling_task != NULL)
+            if (rtask->mode == TASK_MODE_REMOTE && rtask->calling_task != NULL)
             {
                 rtask->status = RTASK_ERROR;
                 assert(mco_push(rtask->calling_task->ctx, rtask, sizeof(remote_task_t)) == MCO_SUCCESS);
                 // place parent task back to appropriate queue
                 task_place(t, rtask->calling_task);
+                twheel_release_rtask(t, rtask);
             }
             else {
-                // if not blocking, remove it from the task table and destroy the remote task entry
-                HASH_DEL(t->task_table, rtask);
-                remote_task_destroy(rtask);
+                // if not blocking, destroy the remote task entry
+                remote_task_destroy(t, rtask);
             }
         }
         internal_command_free(ic);
         break;
+
+    case FUTURE_CMD_WAIT:
+        // a task awaits its group of futures, the command is part of the group
+        futures_wait(t, ic);
+        break;
     }
 }
 
 void process_internal_queue(tboard_t *t)
 {
-    struct queue_entry *next = NULL;
-    pthread_mutex_lock(&t->iqmutex);
-    next = queue_peek_front(&t->iq);
-    if (next)
-        queue_pop_head(&t->iq);
-    pthread_mutex_unlock(&t->iqmutex);
+    internal_command_t *next = taskq_pop(&t->iq);
     if (next) 
-        process_internal_command(t, next->data);
+        process_internal_command(t, next);
+}
+
+bool executor_has_work(tboard_t *tboard, exec_t *self, taskq_t *q)
+{
+    if (self->type == PRIMARY_EXECUTOR) {
+        if (q == &(tboard->pqueue_sy) && dheap_size(&(tboard->syheap)) > 0)
+            return true;
+        if (q == &(tboard->pqueue_rt) && dheap_size(&(tboard->rtheap)) > 0)
+            return true;
+        // replies are handled at the top of the next pass
+        return !taskq_empty(q) || !taskq_empty(&(tboard->iq));
+    }
+    if (!taskq_empty(&(tboard->sinject)) || !taskq_empty(&(tboard->shome[self->num])))
+        return true;
+    for (int i = 0; i < tboard->sqs; i++)
+        if (!wsdeque_empty(&(tboard->sdeque[i])))
+            return true;
+    return false;
+}
+
+/*
+ * Park the executor until a producer wakes it up. The sleep flag is raised before the
+ * queues are checked one final time, and producers bump the futex word after pushing,
+ * so a push that races with parking is never lost. The pExecutor parks only until the
+ * next timer on the wheel expires, timers posted after it looked at the inbox wake it.
+ */
+void executor_park(tboard_t *tboard, exec_t *self, taskq_t *q)
+{
+    atomic_int *sleeping = &(tboard->psleep);
+    atomic_uint *wake = &(tboard->pwake);
+    long int timeout = -1;
+
+    if (self->type == SECONDARY_EXECUTOR) {
+        sleeping = &(tboard->ssleep[self->num]);
+        wake = &(tboard->swake[self->num]);
+    }
+
+    atomic_store_explicit(sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned int w = atomic_load_explicit(wake, memory_order_relaxed);
+    if (self->type == PRIMARY_EXECUTOR) {
+        twheel_update_to_now(tboard);
+        timeout = twheel_timeout(tboard);
+        if (timeout < 0 || timeout > PEXEC_MAX_PARK)
+            timeout = PEXEC_MAX_PARK;
+    }
+    if (timeout != 0 && !executor_has_work(tboard, self, q)) {
+        if (self->type == PRIMARY_EXECUTOR)
+            rtable_sweep(tboard->task_table);   // idle anyway, the table had its burst
+        trace_event(TRACE_EXEC_PARK, 0, NULL, 0);
+        tboard_wait_word(wake, w, timeout);
+        trace_event(TRACE_EXEC_UNPARK, 0, NULL, 0);
+    }
+    atomic_store_explicit(sleeping, 0, memory_order_relaxed);
 }
 
 void *executor(void *arg)
 {
     // get task board pointer and purpose from argument
-    exec_t args = *((exec_t *)arg);
-    tboard_t *tboard = args.tboard;
+    exec_t *self = (exec_t *)arg;
+    tboard_t *tboard = self->tboard;
     // determine behavior based on arguments
-    int type = args.type;
-    int num = args.num;
+    int type = self->type;
 
-    pthread_mutex_t *mutex = NULL; // mutex to lock for previous queue
-    pthread_cond_t *cond = NULL; // condition variable to signal after insertion
-    enum execmodes_t mode;
+    current_exec = self;
+    if (type == PRIMARY_EXECUTOR) {
+        trace_thread_name("pexec");
+        learn_sleeping(&(tboard->sleeper), 16);
+    } else
+        trace_thread_name("sexec-%d", self->num);
+
+    enum execmodes_t mode, last_mode = BATCH_MODE_EXEC;
+    long int slot_end = 0;
 
     // disable premature cancellation by tboard_kill() to ensure graceful terminations
     disable_thread_cancel();
@@ -327,36 +468,40 @@ void *executor(void *arg)
     while (true) {
         // create single cancellation point 
         set_thread_cancel_point_here();
-        // process the timing wheel events
-        process_timing_wheel(tboard, &mode);
-    //    mode = BATCH_MODE_EXEC;
-        if (mode == BATCH_MODE_EXEC)
+        // process the timing wheel events, sExecutors only run batch tasks
+        mode = BATCH_MODE_EXEC;
+        if (type == PRIMARY_EXECUTOR)
+            process_timing_wheel(tboard, &mode, &slot_end);
+        if (mode != last_mode) {
+            if (last_mode != BATCH_MODE_EXEC)
+                trace_event(TRACE_SLOT_EXIT, 0, NULL, last_mode);
+            if (mode != BATCH_MODE_EXEC)
+                trace_event(TRACE_SLOT_ENTER, 0, NULL, mode);
+            last_mode = mode;
+        }
+        // replies wake the pExecutor, it owns the timers of the remote tasks
+        if (mode == BATCH_MODE_EXEC && type == PRIMARY_EXECUTOR)
             process_internal_queue(tboard);
 
         //// define variables needed for each iteration
-        struct queue_entry *next = NULL; // queue entry of ready queue
-        // the following variables are to keep track of which secondary queue (if any)
-        // task is taken out of. This is important to track for pExec after taking a task
-        // out of a secondary queue when primary queue is empty
-        struct queue *q = NULL; // queue entry to reinsert task into after yielding
-    //    get_snapshot(0);
+        task_t *next = NULL; // next task from the ready queue
+        // the following variable keeps track of which queue the task is taken out of,
+        // so it can be reinserted there after yielding
+        taskq_t *q = NULL;
         // Fetch next task to run 
-        next = get_next_task(tboard, type, mode, num, &q, &mutex, &cond);
-    //    get_snapshot(1);
-    //    get_snapshot(2);
+        next = get_next_task(tboard, self, mode, slot_end, &q);
         if (next) { // TExec found a task to run
-    //        get_snapshot(3);
-            process_next_task(tboard, type, &q, next, mutex, cond);
-    //        get_snapshot(4);
-            free(next);
-    //        get_snapshot(5);
+            // more work than this sExecutor can do right now: get a parked peer going,
+            // which wakes the next one the same way if there is still more
+            if (type == SECONDARY_EXECUTOR &&
+                (!taskq_empty(&(tboard->sinject)) || !wsdeque_empty(&(tboard->sdeque[self->num]))))
+                tboard_wake_idle_secondary(tboard);
+            process_next_task(tboard, type, q, next);
         } else {
-            // empty queue, we sleep on appropriate condition variable until signal received
-            if (type == PRIMARY_EXECUTOR) {
-                conditional_timedwait(&(tboard->pmutex), &(tboard->pcond), &(pexec_timeout));
-            } else
-                conditional_wait(&(tboard->smutex[num]), &(tboard->scond[num]));
+            // the requests of this pass go out together, then we park until woken up
+            // (the pExecutor until its next timer)
+            remote_task_flush(tboard);
+            executor_park(tboard, self, q);
         }
- //       print_snapshot_summary(100000);
     }
 }
\ No newline at end of file
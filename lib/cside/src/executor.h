@@ -2,18 +2,17 @@
 #define __EXECUTOR_H_
 
 #include <time.h>
+
+#define PEXEC_MAX_PARK              100000
 /**
- * pexec_timeout - Timespec for primary task executor to timedwait on cond variable
- * 
- * Having primary task executor do timedwait instead of wait isn't necessary for most
- * purposes, however there is a specific rare race condition with worker-to-controller
- * tasks that could leave task board in a deadlock. The most elegant solution to this is
- * to have the primary executor do a timed-sleep so that TSeq can run occasionally when
- * all executors have no tasks to do
+ * PEXEC_MAX_PARK - Longest the primary task executor parks, in microseconds
+ *
+ * The primary executor parks until the next timer on the wheel expires or a producer
+ * wakes it, whichever comes first. It never parks longer than this though: there is a
+ * specific rare race condition with worker-to-controller tasks that could leave task
+ * board in a deadlock, and the most elegant solution to this is to have TSeq run
+ * occasionally even when all executors have no tasks to do. The schedule events keep
+ * the wheel busy anyway, so the cap rarely matters.
  */
-struct timespec pexec_timeout = {
-    .tv_sec = 0,
-    .tv_nsec = 500000
-};
 
-#endif
\ No newline at end of file
+#endif
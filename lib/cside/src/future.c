@@ -0,0 +1,179 @@
+/*
+ * Groups of futures, see future.h. The remote tasks of a group are ordinary REXECs
+ * in the task table, with TASK_MODE_FUTURE and no calling task. Their replies come
+ * through process_internal_command() like any other, which hands them to the group
+ * instead of resuming a task. The task awaiting the group is resumed by whatever
+ * completes the wait: the last reply it needs, or the timeout of the group.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include "future.h"
+
+futures_t *futures_create(tboard_t *t)
+{
+    futures_t *fs = (futures_t *)calloc(1, sizeof(futures_t));
+
+    assert(fs != NULL);
+    fs->tboard = t;
+    fs->first = -1;
+    fs->wait.cmd = FUTURE_CMD_WAIT;
+    twheel_timer_init(&(fs->timer), TW_EVENT_FUTURE_TIMEOUT, fs);
+    return fs;
+}
+
+void futures_destroy(futures_t *fs)
+{
+    if (fs == NULL)
+        return;
+    // the pExecutor has to let go of the pending calls first
+    if (!fs->settled && fs->n > 0)
+        await_all(fs, 0);
+    for (int i = 0; i < fs->n; i++)
+        command_args_free(fs->f[i].result);
+    free(fs);
+}
+
+future_t *future_issue(futures_t *fs, char *command, int level, char *fn_argsig, arg_t *args, int sizeof_args)
+{
+    remote_task_t *rtask;
+    future_t *f;
+    int length = strlen(command);
+
+    if (fs->settled || fs->n == FUTURES_MAX || length >= MAX_MSG_LENGTH) {
+        free(args);
+        return NULL;
+    }
+    rtask = (remote_task_t *)calloc(1, sizeof(remote_task_t));
+    assert(rtask != NULL);
+    rtask->task_id = mysnowflake_id();
+    rtask->status = TASK_INITIALIZED;
+    rtask->data = args;
+    rtask->data_size = sizeof_args;
+    rtask->mode = TASK_MODE_FUTURE;
+    rtask->retries = TASK_MAX_RETRIES;
+    rtask->level = level;
+    strcpy(rtask->fn_argsig, fn_argsig);
+    memcpy(rtask->command, command, length);
+    twheel_timer_init(&(rtask->timer), TW_EVENT_REXEC_TIMEOUT, (void *)rtask->task_id);
+
+    // the future is complete before a reply can find it through the task table
+    f = &(fs->f[fs->n]);
+    f->group = fs;
+    f->task_id = rtask->task_id;
+    f->status = FUTURE_PENDING;
+    f->result = NULL;
+    rtask->future = f;
+    if (!rtable_insert(fs->tboard->task_table, rtask->task_id, rtask)) {
+        tboard_err("future_issue: Remote task table is full, failing remote task %ld.\n", rtask->task_id);
+        free(args);
+        free(rtask);    // its timer was never armed
+        return NULL;
+    }
+    fs->n++;
+    remote_task_place(fs->tboard, rtask);
+    return f;
+}
+
+// park until the pExecutor decides the wait is over, see futures_park()
+static void futures_await(futures_t *fs, bool any, long int timeout)
+{
+    mco_result res;
+
+    fs->any = any;
+    fs->deadline = timeout > 0 ? getcurtime() + timeout : 0;
+    res = mco_push(mco_running(), &fs, sizeof(futures_t *));
+    assert(res == MCO_SUCCESS);
+    task_yield();
+}
+
+int await_all(futures_t *fs, long int timeout)
+{
+    if (!fs->settled)
+        futures_await(fs, false, timeout);
+    return fs->ok;
+}
+
+future_t *await_any(futures_t *fs, long int timeout)
+{
+    if (!fs->settled)
+        futures_await(fs, true, timeout);
+    return fs->first >= 0 ? &(fs->f[fs->first]) : NULL;
+}
+
+arg_t *future_value(future_t *f)
+{
+    return f != NULL && f->status == FUTURE_DONE ? f->result : NULL;
+}
+
+void futures_park(tboard_t *t, task_t *task, futures_t *fs)
+{
+    fs->task = task;
+    taskq_push(&(t->iq), &(fs->wait));
+    tboard_wake_primary(t);
+}
+
+static bool futures_met(futures_t *fs)
+{
+    return fs->done == fs->n || (fs->any && fs->ok > 0);
+}
+
+// ends the wait: nothing of the group stays with the pExecutor once the task runs
+static void futures_settle(tboard_t *t, futures_t *fs)
+{
+    remote_task_t *rtask;
+    task_t *task = fs->task;
+
+    twheel_timer_cancel(t, &(fs->timer));
+    for (int i = 0; i < fs->n; i++) {
+        if (fs->f[i].status != FUTURE_PENDING)
+            continue;
+        fs->f[i].status = FUTURE_CANCELLED;
+        if ((rtask = rtable_remove(t->task_table, fs->f[i].task_id)) != NULL) {
+            free(rtask->data);
+            twheel_release_rtask(t, rtask);
+        }
+    }
+    fs->settled = true;
+    fs->waiting = false;
+    fs->task = NULL;
+    task_place(t, task);
+}
+
+void futures_wait(tboard_t *t, internal_command_t *ic)
+{
+    futures_t *fs = (futures_t *)((char *)ic - offsetof(futures_t, wait));
+
+    fs->waiting = true;
+    if (fs->deadline == 0 || fs->deadline <= getcurtime() || futures_met(fs))
+        futures_settle(t, fs);
+    else
+        twheel_timer_arm(t, &(fs->timer), fs->deadline);
+}
+
+void futures_resolve(tboard_t *t, remote_task_t *rtask, arg_t *result)
+{
+    future_t *f = rtask->future;
+    futures_t *fs = f->group;
+
+    free(rtask->data);
+    twheel_release_rtask(t, rtask);
+    f->result = result;
+    f->status = result != NULL ? FUTURE_DONE : FUTURE_ERROR;
+    fs->done++;
+    if (result != NULL && fs->ok++ == 0)
+        fs->first = f - fs->f;
+    // replies that come in before the task awaits the group are only recorded
+    if (fs->waiting && futures_met(fs))
+        futures_settle(t, fs);
+}
+
+void futures_expire(tboard_t *t, void *arg)
+{
+    futures_t *fs = (futures_t *)arg;
+
+    if (fs->waiting)
+        futures_settle(t, fs);
+}
@@ -0,0 +1,148 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#include <stdbool.h>
+#include "tboard.h"
+#include "command.h"
+
+/*
+ * Parallel remote calls. A task issues its remote calls into a group of futures
+ * without yielding, each one a REXEC on its way right away, and then awaits all of
+ * them or the first result. The task parks once for the whole group and the pExecutor
+ * resumes it when the replies meet the condition or the wait times out, so N calls
+ * cost one round trip instead of N.
+ */
+
+#define FUTURES_MAX                 16
+#define FUTURE_TIMEOUT_US           1000000
+/**
+ * Configurable Macros
+ * @FUTURES_MAX:        remote calls a group of futures can hold
+ * @FUTURE_TIMEOUT_US:  wait the compiler puts on the groups it emits, in microseconds
+ */
+
+#define FUTURE_CMD_WAIT             (-1)    // internal command, parks a task on its group
+
+typedef enum {
+    FUTURE_PENDING,
+    FUTURE_DONE,
+    FUTURE_ERROR,
+    FUTURE_CANCELLED
+} future_status_t;
+
+struct futures_t;
+
+/**
+ * future_t - One remote call of a group
+ * @group:   the group it belongs to
+ * @task_id: id of its remote task
+ * @status:  FUTURE_PENDING until a REXEC_RES (DONE) or REXEC_ERR (ERROR) came in, or
+ *           the wait ended without it (CANCELLED)
+ * @result:  arguments of the REXEC_RES, owned by the group
+ */
+typedef struct future_t {
+    struct futures_t *group;
+    long int task_id;
+    future_status_t status;
+    arg_t *result;
+} future_t;
+
+/**
+ * futures_t - Group of futures a task awaits together
+ * @tboard:   task board the calls go through
+ * @n:        futures issued
+ * @done:     futures resolved, with a result or an error
+ * @ok:       futures resolved with a result
+ * @first:    index of the first result, -1 while there is none
+ * @any:      the wait ends with the first result instead of the last reply
+ * @deadline: end of the wait (getcurtime() based), 0 to collect what is there
+ * @settled:  the group was awaited, nothing is pending anymore
+ * @waiting:  the pExecutor took up the wait of @task, replies may end it now
+ * @task:     task parked on the group
+ * @wait:     what parks @task, posted to the internal queue
+ * @timer:    @deadline on the timing wheel (TW_EVENT_FUTURE_TIMEOUT)
+ * @f:        the futures
+ *
+ * The issuing task fills in the futures before their remote tasks enter the task
+ * table. From then until the task is resumed only the pExecutor touches the group,
+ * which lives on the heap because a task on a shared stack has no stack while parked.
+ */
+typedef struct futures_t {
+    tboard_t *tboard;
+    int n;
+    int done;
+    int ok;
+    int first;
+    bool any;
+    long int deadline;
+    bool settled;
+    bool waiting;
+    task_t *task;
+    internal_command_t wait;
+    twheel_timer_t timer;
+    future_t f[FUTURES_MAX];
+} futures_t;
+
+futures_t *futures_create(tboard_t *t);
+void futures_destroy(futures_t *fs);
+/**
+ * futures_create() - Allocates an empty group
+ * futures_destroy() - Frees @fs and the results in it. A group that was not awaited is
+ *                     awaited with no wait first, which cancels the pending calls.
+ *
+ * Context: within a task
+ */
+
+future_t *future_issue(futures_t *fs, char *command, int level, char *fn_argsig, arg_t *args, int sizeof_args);
+/**
+ * future_issue() - Sends a REXEC for @command and adds it to @fs, without yielding
+ * @level:  where the call goes, as in remote_task_send()
+ * @args:   the arguments, owned by the remote task from here on
+ *
+ * Return: the future, NULL if the group is full or was awaited already, or the task
+ *         table has no room
+ */
+
+int await_all(futures_t *fs, long int timeout);
+future_t *await_any(futures_t *fs, long int timeout);
+/**
+ * await_all() - Waits until every future of @fs is resolved
+ * await_any() - Waits for the first result in @fs, or until every future failed
+ * @timeout:  longest wait in microseconds, 0 only collects the replies that are in
+ *
+ * The task parks once for the group. When the wait ends the futures still pending are
+ * cancelled, late replies to them are dropped, so a group is awaited once.
+ *
+ * Return: await_all() the number of results, await_any() the future of the first
+ *         result or NULL if there is none
+ *
+ * Context: within a task
+ */
+
+arg_t *future_value(future_t *f);
+/**
+ * future_value() - Result of @f, NULL unless it is FUTURE_DONE. Freed with the group.
+ */
+
+void futures_park(tboard_t *t, task_t *task, futures_t *fs);
+/**
+ * futures_park() - Hands @task, which yielded to await @fs, to the pExecutor
+ *
+ * Context: executor that ran @task
+ */
+
+void futures_wait(tboard_t *t, internal_command_t *ic);
+void futures_resolve(tboard_t *t, remote_task_t *rtask, arg_t *result);
+void futures_expire(tboard_t *t, void *arg);
+/**
+ * futures_wait() - Starts the wait of a parked task (FUTURE_CMD_WAIT)
+ * futures_resolve() - Resolves the future of @rtask, taken out of the task table, with
+ *                     the arguments of its REXEC_RES, or NULL for a REXEC_ERR
+ * futures_expire() - Ends the wait of the group @arg whose timeout expired
+ *
+ * Whichever ends the wait cancels the pending futures and places the task.
+ *
+ * Context: pExecutor only
+ */
+
+#endif
@@ -8,35 +8,142 @@
 #include "history.h"
 #include <uthash.h>
 #include <string.h>
+#include <assert.h>
 
+// slot of the calling executor in history_t.exec, threads that are no executor share slot 0
+static inline int hist_slot()
+{
+    exec_t *e = current_exec;
+    return (e == NULL || e->type == PRIMARY_EXECUTOR) ? 0 : e->num + 1;
+}
 
-void history_record_exec(tboard_t *t, task_t *task, history_t **hist)
+static inline int hist_bucket(uint64_t v)
 {
-    pthread_mutex_lock(&(t->hmutex));
-    // check if function exists in hash table
-    HASH_FIND_STR(t->exec_hist, task->fn.fn_name, *hist);
-
-    if (*hist == NULL) { // does not exist, so we create it
-        *hist = calloc(1, sizeof(history_t));
-        (*hist)->fn_name = calloc(strlen(task->fn.fn_name)+1, sizeof(char));
-        strcpy((*hist)->fn_name, task->fn.fn_name);
-        (*hist)->mean_t = 0;
-        (*hist)->mean_yield = 0;
-        (*hist)->executions = 0;
-        (*hist)->completions = 0;
-        HASH_ADD_KEYPTR(hh, t->exec_hist, (*hist)->fn_name, strlen((*hist)->fn_name), *hist);
+    int msb;
+
+    if (v < HIST_SUB)
+        return (int)v;
+    if (v >= (1ULL << HIST_MAX_BITS))
+        v = (1ULL << HIST_MAX_BITS) - 1;
+    msb = 63 - __builtin_clzll(v);
+    // top HIST_SUB_BITS + 1 bits of v, the leading one picks the power of two
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + (int)(v >> (msb - HIST_SUB_BITS)) - HIST_SUB;
+}
+
+// largest value that lands in bucket @b
+static inline uint64_t hist_bucket_max(int b)
+{
+    int shift;
+
+    if (b < HIST_SUB)
+        return b;
+    shift = b / HIST_SUB - 1;
+    return (((uint64_t)(HIST_SUB + b % HIST_SUB) + 1) << shift) - 1;
+}
+
+#define hist_inc(a, n) \
+    atomic_store_explicit((a), atomic_load_explicit((a), memory_order_relaxed) + (n), memory_order_relaxed)
+
+void lathist_record(lathist_t *h, uint64_t v)
+{
+    hist_inc(&(h->counts[hist_bucket(v)]), 1);
+    hist_inc(&(h->count), 1);
+    hist_inc(&(h->sum), v);
+    if (v > atomic_load_explicit(&(h->max), memory_order_relaxed))
+        atomic_store_explicit(&(h->max), v, memory_order_relaxed);
+}
+
+static void lathist_merge(lathist_t *to, lathist_t *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        to->counts[i] += atomic_load_explicit(&(from->counts[i]), memory_order_relaxed);
+    to->count += atomic_load_explicit(&(from->count), memory_order_relaxed);
+    to->sum += atomic_load_explicit(&(from->sum), memory_order_relaxed);
+    if (atomic_load_explicit(&(from->max), memory_order_relaxed) > to->max)
+        to->max = atomic_load_explicit(&(from->max), memory_order_relaxed);
+}
+
+uint64_t lathist_percentile(const lathist_t *h, double p)
+{
+    unsigned long total = 0, rank, seen = 0;
+
+    // the bucket counts are the truth, the count may be a sample ahead of them
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        total += atomic_load_explicit(&(h->counts[i]), memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    rank = (unsigned long)(p / 100.0 * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&(h->counts[i]), memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t m = hist_bucket_max(i), max = atomic_load_explicit(&(h->max), memory_order_relaxed);
+            return (max != 0 && m > max) ? max : m;
+        }
     }
+    return atomic_load_explicit(&(h->max), memory_order_relaxed);
+}
 
-    
-    if(task->status == TASK_COMPLETED){ // if task is completed, we update specific values
-        // if old_mean = old_count / old_n, and new_mean = new_count / new_n = (old_count + count) / (old_count + 1)
-        // then new_mean = (old_mean*old_n + count) / (old_n + 1)
-        (*hist)->mean_t     = (((*hist)->mean_t)*((*hist)->completions) + task->cpu_time) / (((*hist)->completions) + 1);
-        (*hist)->mean_yield = (((*hist)->mean_yield)*((*hist)->completions) + task->yields) / (((*hist)->completions) + 1);
-        (*hist)->completions += 1; // increment completion count
+static exec_hist_t *history_slot(history_t *hist)
+{
+    int slot = hist_slot();
+    exec_hist_t *e = atomic_load_explicit(&(hist->exec[slot]), memory_order_acquire);
+
+    if (e == NULL) {
+        // only this executor fills its slot
+        e = (exec_hist_t *)calloc(1, sizeof(exec_hist_t));
+        assert(e != NULL);
+        atomic_store_explicit(&(hist->exec[slot]), e, memory_order_release);
+    }
+    return e;
+}
+
+history_t *history_get(tboard_t *t, const char *fn_name)
+{
+    history_t *hist;
+
+    pthread_mutex_lock(&(t->hmutex));
+    // check if function exists in hash table
+    HASH_FIND_STR(t->exec_hist, fn_name, hist);
+    if (hist == NULL) { // does not exist, so we create it
+        hist = calloc(1, sizeof(history_t));
+        assert(hist != NULL);
+        hist->fn_name = strdup(fn_name);
+        HASH_ADD_KEYPTR(hh, t->exec_hist, hist->fn_name, strlen(hist->fn_name), hist);
     }
-    // if task is incomplete, relevant values are added automatically in task board functions
     pthread_mutex_unlock(&(t->hmutex));
+    return hist;
+}
+
+void history_attach(tboard_t *t, task_t *task)
+{
+    task->hist = task->fn.hist != NULL ? task->fn.hist : history_get(t, task->fn.fn_name);
+    atomic_fetch_add_explicit(&(task->hist->executions), 1, memory_order_relaxed);
+    task->ctime = trace_now();
+}
+
+void history_record_wait(task_t *task, uint64_t wait)
+{
+    lathist_record(&(history_slot(task->hist)->qwait), wait);
+}
+
+void history_record_yield(task_t *task)
+{
+    hist_inc(&(history_slot(task->hist)->yields), 1);
+}
+
+void history_record_exec(tboard_t *t, task_t *task)
+{
+    (void)t;
+    exec_hist_t *e = history_slot(task->hist);
+
+    lathist_record(&(e->cpu), task->cpu_time);
+    admit_update_cost(&(task->hist->cost), task->cpu_time);
+    lathist_record(&(e->wall), trace_now() - task->ctime);
+    hist_inc(&(e->completions), 1);
+    if (task->deadline != 0 && trace_now() > task->deadline)
+        hist_inc(&(e->misses), 1);
 }
 
 
@@ -56,6 +163,9 @@ void history_destroy(tboard_t *t)
     HASH_ITER(hh, t->exec_hist, entry, temp) {
         // delete hash table index
         HASH_DEL(t->exec_hist, entry);
+        // free per executor histograms
+        for (int i = 0; i < HIST_SLOTS; i++)
+            free(atomic_load(&(entry->exec[i])));
         // free function name buffer
         free(entry->fn_name);
         // free hash table entry
@@ -85,16 +195,137 @@ void history_load_from_disk(tboard_t *t, FILE *fptr);
  * left the function here to await implementation
  */
 
+/*
+ * Sums the histograms and counters of all executors of @entry into @sum, the
+ * histograms are too big to live on the stack.
+ */
+static void history_merge(history_t *entry, exec_hist_t *sum)
+{
+    exec_hist_t *e;
+
+    memset(sum, 0, sizeof(exec_hist_t));
+    for (int i = 0; i < HIST_SLOTS; i++) {
+        if ((e = atomic_load_explicit(&(entry->exec[i]), memory_order_acquire)) == NULL)
+            continue;
+        lathist_merge(&(sum->qwait), &(e->qwait));
+        lathist_merge(&(sum->cpu), &(e->cpu));
+        lathist_merge(&(sum->wall), &(e->wall));
+        sum->yields += atomic_load_explicit(&(e->yields), memory_order_relaxed);
+        sum->completions += atomic_load_explicit(&(e->completions), memory_order_relaxed);
+        sum->misses += atomic_load_explicit(&(e->misses), memory_order_relaxed);
+    }
+}
+
+static void history_print_hist(FILE *fptr, const char *name, lathist_t *h)
+{
+    if (h->count == 0)
+        return;
+    fprintf(fptr, "  %-10s p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us  [%lu samples]\n", name,
+        lathist_percentile(h, 50) / 1000.0, lathist_percentile(h, 99) / 1000.0,
+        lathist_percentile(h, 99.9) / 1000.0, h->max / 1000.0, (unsigned long)h->count);
+}
+
 void history_print_records(tboard_t *t, FILE *fptr)
 {
     // Print records. Iterate them as specified by hash table library
     history_t *entry, *temp;
-    // lock mutex so no values are modified while iterating
+    exec_hist_t *sum = (exec_hist_t *)malloc(sizeof(exec_hist_t));
+
+    assert(sum != NULL);
+    // lock mutex so no entries are added while iterating
     pthread_mutex_lock(&(t->hmutex));
     HASH_ITER(hh, t->exec_hist, entry, temp) {
+        history_merge(entry, sum);
         // print values
-        fprintf(fptr, "History: task '%s' completed %d/%d times, yielding %.0f times (average %f) with mean execution CPU time of %.7f s\n", 
-            entry->fn_name, entry->completions, entry->executions, entry->yields, entry->mean_yield, entry->mean_t / CLOCKS_PER_SEC);
+        fprintf(fptr, "History: task '%s' completed %lu/%ld times, yielding %lu times (average %.2f)",
+            entry->fn_name, (unsigned long)sum->completions, (long)atomic_load(&(entry->executions)),
+            (unsigned long)sum->yields, sum->completions > 0 ? (double)sum->yields / sum->completions : 0.0);
+        if (sum->misses > 0)
+            fprintf(fptr, ", %lu deadline misses", (unsigned long)sum->misses);
+        fprintf(fptr, "\n");
+        history_print_hist(fptr, "queue wait", &(sum->qwait));
+        history_print_hist(fptr, "cpu time", &(sum->cpu));
+        history_print_hist(fptr, "wall time", &(sum->wall));
+    }
+    pthread_mutex_unlock(&(t->hmutex));
+    free(sum);
+}
+
+void history_print_slots(tboard_t *t, FILE *fptr)
+{
+    if (t->slotlat[SLOTLAT_SY].count + t->slotlat[SLOTLAT_RT].count == 0)
+        return;
+    fprintf(fptr, "Slot starts: lateness\n");
+    history_print_hist(fptr, "SY slots", &(t->slotlat[SLOTLAT_SY]));
+    history_print_hist(fptr, "RT slots", &(t->slotlat[SLOTLAT_RT]));
+}
+
+static void history_json_hist(FILE *fptr, const char *name, lathist_t *h, history_t *entry, int which)
+{
+    lathist_t *eh;
+    exec_hist_t *e;
+    bool first = true;
+
+    fprintf(fptr, "\"%s\":{\"count\":%lu,\"mean_ns\":%.0f,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"max_ns\":%lu,\"executors\":{",
+        name, (unsigned long)h->count, h->count > 0 ? (double)h->sum / h->count : 0.0,
+        (unsigned long)lathist_percentile(h, 50), (unsigned long)lathist_percentile(h, 99),
+        (unsigned long)lathist_percentile(h, 99.9), (unsigned long)h->max);
+    for (int i = 0; i < HIST_SLOTS; i++) {
+        if ((e = atomic_load_explicit(&(entry->exec[i]), memory_order_acquire)) == NULL)
+            continue;
+        eh = which == 0 ? &(e->qwait) : (which == 1 ? &(e->cpu) : &(e->wall));
+        if (atomic_load(&(eh->count)) == 0)
+            continue;
+        fprintf(fptr, "%s\"%d\":{\"count\":%lu,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu}", first ? "" : ",",
+            i, (unsigned long)atomic_load(&(eh->count)), (unsigned long)lathist_percentile(eh, 50),
+            (unsigned long)lathist_percentile(eh, 99), (unsigned long)lathist_percentile(eh, 99.9));
+        first = false;
+    }
+    fprintf(fptr, "},\"buckets\":[");
+    first = true;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->counts[i] == 0)
+            continue;
+        fprintf(fptr, "%s[%lu,%u]", first ? "" : ",", (unsigned long)hist_bucket_max(i), (unsigned)h->counts[i]);
+        first = false;
+    }
+    fprintf(fptr, "]}");
+}
+
+void history_dump_json(tboard_t *t, FILE *fptr)
+{
+    history_t *entry, *temp;
+    exec_hist_t *sum = (exec_hist_t *)malloc(sizeof(exec_hist_t));
+    bool first = true;
+
+    assert(sum != NULL);
+    fprintf(fptr, "{\"executor_slots\":\"0 is the pExecutor, i+1 is sExecutor i\",\"functions\":[");
+    pthread_mutex_lock(&(t->hmutex));
+    HASH_ITER(hh, t->exec_hist, entry, temp) {
+        history_merge(entry, sum);
+        fprintf(fptr, "%s\n{\"name\":\"%s\",\"executions\":%ld,\"completions\":%lu,\"yields\":%lu,\"deadline_misses\":%lu,",
+            first ? "" : ",", entry->fn_name, (long)atomic_load(&(entry->executions)),
+            (unsigned long)sum->completions, (unsigned long)sum->yields, (unsigned long)sum->misses);
+        history_json_hist(fptr, "qwait", &(sum->qwait), entry, 0);
+        fprintf(fptr, ",");
+        history_json_hist(fptr, "cpu", &(sum->cpu), entry, 1);
+        fprintf(fptr, ",");
+        history_json_hist(fptr, "wall", &(sum->wall), entry, 2);
+        fprintf(fptr, "}");
+        first = false;
     }
     pthread_mutex_unlock(&(t->hmutex));
-}
\ No newline at end of file
+    fprintf(fptr, "\n]}\n");
+    free(sum);
+}
+
+bool history_dump(tboard_t *t, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+        return false;
+    history_dump_json(t, fp);
+    fclose(fp);
+    return true;
+}
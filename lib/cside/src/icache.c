@@ -1,23 +1,36 @@
+/*
+ * Duplicate REXEC cache, see icache.h. A generation is an open addressed table of
+ * fixed width keys, so a call costs neither an allocation nor a string key. Calls
+ * are looked up in every generation, newest first, and always go into the current
+ * one. Emptying a generation drops the results it holds.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 #include "icache.h"
-#include <stdio.h>
-#include <stdbool.h>
-#include "uthash.h"
 
-void clean_icache(struct id_entry *t)
+#define ICACHE_MASK                 (ICACHE_GEN_SLOTS - 1)
+
+// murmur3 finalizer over both halves of the key
+static inline unsigned long icache_hash(icache_key_t *k)
 {
-    struct id_entry *cur, *tmp;
-    HASH_ITER(hh, t, cur, tmp) {
-        HASH_DEL(t, cur);
-        free(cur);
-    }
+    uint64_t x = (uint64_t)k->task_id ^ (k->node * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
 }
 
-void switch_icache(icache_t *ic)
+uint64_t icache_node_hash(const char *node_id)
 {
-    ic->curtab = (ic->curtab + 1) % 3;
-    int cleantab = (ic->curtab - 2) % 3;
-    clean_icache(ic->tables[cleantab]);
-    ic->tables[cleantab] = NULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (const unsigned char *p = (const unsigned char *)node_id; *p != '\0'; p++)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    return h;
 }
 
 icache_t *icache_alloc()
@@ -27,45 +40,157 @@ icache_t *icache_alloc()
         perror("icache_alloc");
         exit(1);
     }
-    // calloc should have done the 0 inii, so the following is redundant
-    ic->curtab = 0;
-    ic->nelems = 0;
-    ic->tables[0] = NULL;
-    ic->tables[1] = NULL;
-    ic->tables[2] = NULL;
-
+    // calloc left every slot ICACHE_NEW
+    pthread_mutex_init(&(ic->lock), NULL);
     return ic;
 }
 
-bool icache_insert(icache_t *ic, long int task_id, char *node_id)
+static void icache_clear_gen(icache_gen_t *g)
+{
+    for (int i = 0; i < ICACHE_GEN_SLOTS; i++)
+        if (g->slots[i].res != NULL)
+            command_free(g->slots[i].res);
+    memset(g, 0, sizeof(icache_gen_t));
+}
+
+void icache_free(icache_t *ic)
+{
+    if (ic == NULL)
+        return;
+    for (int i = 0; i < ICACHE_GENS; i++)
+        icache_clear_gen(&(ic->gens[i]));
+    pthread_mutex_destroy(&(ic->lock));
+    free(ic);
+}
+
+// the entry of @k in @g, or the free slot it would take (NULL if there is none)
+static icache_entry_t *icache_probe(icache_gen_t *g, icache_key_t *k, bool *found)
+{
+    unsigned long h = icache_hash(k);
+    icache_entry_t *e;
+
+    *found = false;
+    for (int i = 0; i < ICACHE_GEN_SLOTS; i++) {
+        e = &(g->slots[(h + i) & ICACHE_MASK]);
+        if (e->state == ICACHE_NEW)
+            return e;
+        if (e->key.task_id == k->task_id && e->key.node == k->node) {
+            *found = true;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// the entry of @k in any generation, called with the lock held
+static icache_entry_t *icache_lookup(icache_t *ic, icache_key_t *k)
 {
-    char buf[1024];
-    sprintf(buf, "%lu%s", task_id, node_id);
-    struct id_entry *entry = (struct id_entry *)calloc(1, sizeof(struct id_entry));
-    strncpy(entry->id, buf, 128);
-    HASH_ADD_STR(ic->tables[ic->curtab], id, entry);
-    ic->nelems++;
-    if (ic->nelems > MAX_ICACHE_ELEMS) {
-        ic->nelems = 0;
-        switch_icache(ic);
+    icache_entry_t *e;
+    bool found;
+
+    for (int i = 0; i < ICACHE_GENS; i++) {
+        e = icache_probe(&(ic->gens[(ic->curtab + ICACHE_GENS - i) % ICACHE_GENS]), k, &found);
+        if (found)
+            return e;
     }
-    return true;
+    return NULL;
 }
 
-bool icache_lookup(icache_t *ic, long int task_id, char *node_id)
+static icache_state_t icache_answer(icache_t *ic, icache_entry_t *e, command_t **res)
 {
-    struct id_entry *entry = NULL;
-    char buf[1024];
-    sprintf(buf, "%lu%s", task_id, node_id);
-    HASH_FIND_STR(ic->tables[ic->curtab], buf, entry);
-    if (entry) 
-        return true;
-    else {
-        int prevtab = (ic->curtab - 1) % 3;
-        HASH_FIND_STR(ic->tables[prevtab], buf, entry);
-        if (entry)
-            return true;
-        else 
-            return false;
+    *res = NULL;
+    if (e->state == ICACHE_RUNNING)
+        ic->dups++;
+    else if (e->state == ICACHE_DONE) {
+        ic->replays++;
+        if ((*res = e->res) != NULL)
+            command_hold(*res);
     }
+    return e->state;
+}
+
+icache_state_t icache_claim(icache_t *ic, long int task_id, const char *node_id, command_t **res)
+{
+    icache_key_t k = {task_id, icache_node_hash(node_id)};
+    icache_entry_t *e;
+    icache_gen_t *g;
+    icache_state_t state;
+    bool found;
+
+    pthread_mutex_lock(&(ic->lock));
+    e = icache_lookup(ic, &k);
+    if (e != NULL && e->state != ICACHE_DROPPED) {
+        state = icache_answer(ic, e, res);
+        pthread_mutex_unlock(&(ic->lock));
+        return state;
+    }
+    g = &(ic->gens[ic->curtab]);
+    if (g->count >= ICACHE_GEN_ELEMS) {
+        // the oldest generation is forgotten and starts over as the current one
+        ic->curtab = (ic->curtab + 1) % ICACHE_GENS;
+        g = &(ic->gens[ic->curtab]);
+        icache_clear_gen(g);
+    }
+    // a call dropped earlier gets its slot back
+    e = icache_probe(g, &k, &found);
+    assert(e != NULL);
+    if (!found)
+        g->count++;
+    e->key = k;
+    e->state = ICACHE_RUNNING;
+    e->res = NULL;
+    pthread_mutex_unlock(&(ic->lock));
+    *res = NULL;
+    return ICACHE_NEW;
+}
+
+icache_state_t icache_find(icache_t *ic, long int task_id, const char *node_id, command_t **res)
+{
+    icache_key_t k = {task_id, icache_node_hash(node_id)};
+    icache_entry_t *e;
+    icache_state_t state = ICACHE_NEW;
+
+    *res = NULL;
+    pthread_mutex_lock(&(ic->lock));
+    e = icache_lookup(ic, &k);
+    if (e != NULL && e->state != ICACHE_DROPPED)
+        state = icache_answer(ic, e, res);
+    pthread_mutex_unlock(&(ic->lock));
+    return state;
+}
+
+void icache_complete(icache_t *ic, long int task_id, const char *node_id, command_t *res)
+{
+    icache_key_t k = {task_id, icache_node_hash(node_id)};
+    icache_entry_t *e;
+
+    pthread_mutex_lock(&(ic->lock));
+    e = icache_lookup(ic, &k);
+    if (e != NULL && e->state == ICACHE_RUNNING) {
+        e->state = ICACHE_DONE;
+        if ((e->res = res) != NULL)
+            command_hold(res);
+    }
+    pthread_mutex_unlock(&(ic->lock));
+}
+
+void icache_drop(icache_t *ic, long int task_id, const char *node_id)
+{
+    icache_key_t k = {task_id, icache_node_hash(node_id)};
+    icache_entry_t *e;
+
+    pthread_mutex_lock(&(ic->lock));
+    // the slot stays taken, the probes of other calls may run through it
+    e = icache_lookup(ic, &k);
+    if (e != NULL && e->state == ICACHE_RUNNING)
+        e->state = ICACHE_DROPPED;
+    pthread_mutex_unlock(&(ic->lock));
+}
+
+void icache_print_stats(icache_t *ic, FILE *fptr)
+{
+    if (ic == NULL || ic->dups + ic->replays == 0)
+        return;
+    fprintf(fptr, "Duplicate REXECs: %ld acknowledged while running, %ld answered with the stored result\n",
+        ic->dups, ic->replays);
 }
@@ -1,26 +1,118 @@
 #ifndef __REQUEST_ICACHE_H__
 #define __REQUEST_ICACHE_H__
 
-#include "uthash.h"
+#include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include "command.h"
 
-#define MAX_ICACHE_ELEMS            512
+/*
+ * Cache of the REXECs this node accepted, so that a retransmitted REXEC (the caller
+ * timed out waiting, see process_timeout_event()) is not executed a second time. A
+ * duplicate of a call still running is acknowledged again, a duplicate of a completed
+ * call gets the stored REXEC_RES replayed. The cache is three generations of fixed
+ * size: once the current one fills up the oldest is emptied and becomes the current
+ * one, so a call is remembered for at least one generation worth of calls.
+ */
 
-struct id_entry {
-    char id[128];
-    UT_hash_handle hh;
-};
+#define ICACHE_GEN_SLOTS            1024
+#define ICACHE_GEN_ELEMS            512
+/**
+ * Configurable Macros
+ * @ICACHE_GEN_SLOTS:   slots of a generation, a power of two
+ * @ICACHE_GEN_ELEMS:   calls a generation takes before the next one is started. At
+ *                      most half the slots, so probes stay short.
+ */
 
+#define ICACHE_GENS                 3
+
+typedef enum {
+    ICACHE_NEW,             // not seen before, or forgotten already
+    ICACHE_RUNNING,         // accepted, the result is not in yet
+    ICACHE_DONE,            // completed, REXEC_RES stored (none for calls without result)
+    ICACHE_DROPPED          // slot of a call that was turned away
+} icache_state_t;
+
+/**
+ * icache_key_t - Fixed width key of a call
+ * @task_id: task id given by the caller
+ * @node:    hash of the node id of the caller, see icache_node_hash()
+ */
+typedef struct icache_key_t {
+    long int task_id;
+    uint64_t node;
+} icache_key_t;
+
+/**
+ * icache_entry_t - A call in a generation
+ * @state: ICACHE_NEW for a free slot
+ * @res:   REXEC_RES to replay, the cache holds a reference
+ */
+typedef struct icache_entry_t {
+    icache_key_t key;
+    icache_state_t state;
+    command_t *res;
+} icache_entry_t;
+
+typedef struct icache_gen_t {
+    int count;
+    icache_entry_t slots[ICACHE_GEN_SLOTS];
+} icache_gen_t;
+
+/**
+ * icache_t - Duplicate REXEC cache of a node (cnode_t.icache)
+ * @lock:    the message processors of all servers and the executors completing calls
+ *           use the cache
+ * @curtab:  generation new calls go into
+ * @gens:    the generations
+ * @dups:    duplicates acknowledged while the call was running
+ * @replays: duplicates answered with the stored result
+ */
 typedef struct _icache_t
 {
+    pthread_mutex_t lock;
     int curtab;
-    struct id_entry *tables[3];
-    int nelems;
+    icache_gen_t gens[ICACHE_GENS];
+    long dups;
+    long replays;
 } icache_t;
 
 icache_t *icache_alloc();
-bool icache_insert(icache_t *ic, long int task_id, char *node_id);
-bool icache_lookup(icache_t *ic, long int task_id, char *node_id);
 void icache_free(icache_t *ic);
 
+uint64_t icache_node_hash(const char *node_id);
+/**
+ * icache_node_hash() - 64-bit FNV-1a hash of a node id, the node part of the key
+ */
+
+icache_state_t icache_claim(icache_t *ic, long int task_id, const char *node_id, command_t **res);
+/**
+ * icache_claim() - Looks up a REXEC and takes it on if it is new
+ * @res:  ICACHE_DONE: the REXEC_RES to replay, with a reference for the caller, or NULL
+ *
+ * Return: ICACHE_NEW if the call was not known and is now ICACHE_RUNNING, otherwise
+ *         the state of the earlier one
+ */
+
+icache_state_t icache_find(icache_t *ic, long int task_id, const char *node_id, command_t **res);
+/**
+ * icache_find() - Same as icache_claim() without taking on a new call (GET_REXEC_RES)
+ */
+
+void icache_complete(icache_t *ic, long int task_id, const char *node_id, command_t *res);
+void icache_drop(icache_t *ic, long int task_id, const char *node_id);
+/**
+ * icache_complete() - Stores the REXEC_RES of a claimed call, taking a reference to it
+ * icache_drop() - Forgets a claimed call that was not executed after all (NAK, overload)
+ *                 or failed, so that a retry runs it
+ *
+ * Calls that were forgotten in the meantime are left alone.
+ */
+
+void icache_print_stats(icache_t *ic, FILE *fptr);
+/**
+ * icache_print_stats() - Prints the duplicates answered from the cache, nothing if none
+ */
+
 #endif
@@ -1,11 +1,23 @@
 #include "jcond.h"
 #include <mujs.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 js_State *J = NULL;
 condition_t *jcondtbl = NULL;
 
+// mujs is not thread safe, the message processors and the executors share the state
+pthread_mutex_t jcond_lock = PTHREAD_MUTEX_INITIALIZER;
+// bumped whenever jsys may have changed, 0 is never current
+atomic_long jsys_epoch = 1;
+// fn of a jcond that does not compile
+const char jcond_broken[] = "";
+
+static const char jsys_default_type[] = "device";
+jsys_t jsys = {jsys_default_type, NULL};
+
 void print(js_State *J)
 {
     const char *name = js_tostring(J, 1);
@@ -13,17 +25,64 @@ void print(js_State *J)
     js_pushundefined(J);
 }
 
-void jcond_init()
+// the jsys object of the mujs state, called with jcond_lock held
+static void jcond_mirror_jsys()
+{
+    char buf[strlen(jsys.type) + (jsys.tag != NULL ? strlen(jsys.tag) : 0) + 64];
+
+    if (jsys.tag != NULL)
+        sprintf(buf, "var jsys = {type: '%s', tag: '%s'};", jsys.type, jsys.tag);
+    else
+        sprintf(buf, "var jsys = {type: '%s'};", jsys.type);
+    js_dostring(J, buf);
+}
+
+// called with jcond_lock held
+static void jcond_start()
 {
+    if (J != NULL)
+        return;
     J = js_newstate(NULL, NULL, JS_STRICT);
 
     js_newcfunction(J, print, "console_log", 1);
     js_setglobal(J, "console_log");
+    jcond_mirror_jsys();
+    js_dostring(J, "function jcondContext(a) { return eval(a); }");
+}
+
+void jcond_init()
+{
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
+    pthread_mutex_unlock(&jcond_lock);
+}
+
+void jcond_set_jsys(const char *type, const char *tag)
+{
+    pthread_mutex_lock(&jcond_lock);
+    if (jsys.type != jsys_default_type)
+        free((char *)jsys.type);
+    free((char *)jsys.tag);
+    jsys.type = strdup(type);
+    jsys.tag = tag != NULL && tag[0] != '\0' ? strdup(tag) : NULL;
+    if (J != NULL)
+        jcond_mirror_jsys();
+    pthread_mutex_unlock(&jcond_lock);
+    jcond_jsys_changed();
 }
 
 void jcond_eval_str(const char *s)
 {
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
     js_dostring(J, s);
+    pthread_mutex_unlock(&jcond_lock);
+    jcond_jsys_changed();
+}
+
+void jcond_jsys_changed()
+{
+    atomic_fetch_add(&jsys_epoch, 1);
 }
 
 
@@ -34,11 +93,14 @@ char *jcond_eval_str_str(const char *s)
     char *res;
 
     char buf[strlen(s) + 32];
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
     sprintf(buf, "var __jrval = eval(%s)", s);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = strdup((char *)js_tostring(J, -1));
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcond_lock);
 
     return res;
 }
@@ -47,11 +109,14 @@ int jcond_eval_bool(const char *s)
 {
     int res;
     char buf[strlen(s) + 32];
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
     sprintf(buf, "var __jrval = eval(%s)", s);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_toboolean(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcond_lock);
 
     return res;
 }
@@ -61,11 +126,14 @@ int jcond_eval_int(const char *s)
     int res;
 
     char buf[strlen(s) + 32];
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
     sprintf(buf, "var __jrval = eval(%s)", s);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_toint32(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcond_lock);
 
     return res;
 }
@@ -75,37 +143,109 @@ double jcond_eval_double(const char *s)
     double res;
 
     char buf[strlen(s) + 32];
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
     sprintf(buf, "var __jrval = eval(%s)", s);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_tonumber(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcond_lock);
 
     return res;
 }
 
 void jcond_free()
 {
-    js_freestate(J);
+    condition_t *c, *tmp;
+
+    // the references go with the state
+    HASH_ITER(hh, jcondtbl, c, tmp) {
+        c->fn = NULL;
+        atomic_store(&(c->cached), 0);
+    }
+    if (J != NULL)
+        js_freestate(J);
+    J = NULL;
+}
+
+// compiles the expression of @c once, called with jcond_lock held
+static void jcond_compile(condition_t *c)
+{
+    char buf[strlen(c->cond) + 3];
+
+    if (c->fn != NULL || J == NULL)
+        return;
+    // an expression statement, so the script returns its value
+    sprintf(buf, "(%s)", c->cond);
+    if (js_ploadstring(J, c->cond_name, buf)) {
+        printf("jcond %s does not compile: %s\n", c->cond_name, js_trystring(J, -1, "error"));
+        js_pop(J, 1);
+        c->fn = jcond_broken;
+        return;
+    }
+    c->fn = js_ref(J);
+}
+
+static bool jcond_run(condition_t *c)
+{
+    long epoch;
+    bool res = false;
+
+    pthread_mutex_lock(&jcond_lock);
+    // a result computed before a concurrent jsys change is stale right away
+    epoch = atomic_load(&jsys_epoch);
+    jcond_start();
+    jcond_compile(c);
+    if (c->fn != NULL && c->fn != jcond_broken) {
+        js_getregistry(J, c->fn);
+        js_pushundefined(J);
+        if (js_pcall(J, 0) == 0)
+            res = js_toboolean(J, -1);
+        js_pop(J, 1);
+    }
+    atomic_store(&(c->cached), (epoch << 1) | res);
+    pthread_mutex_unlock(&jcond_lock);
+    return res;
 }
 
 bool jcond_evaluate(const char *cnd)
 {
     condition_t *c;
-    if (strlen(cnd) == 0)
+    long cached;
+
+    if (cnd[0] == '\0')
         return true;
     HASH_FIND_STR(jcondtbl, cnd, c);
     // if cnd not found - this is an error - return false
-    if (c) 
-        return jcond_eval_bool(c->cond);
-    else
+    if (c == NULL)
         return false;
+    if (c->pred != NULL)
+        return c->pred();
+    cached = atomic_load(&(c->cached));
+    if ((cached >> 1) == atomic_load(&jsys_epoch))
+        return cached & 1;
+    return jcond_run(c);
 }
 
 void jcond_define(const char *label, const char *cstr)
 {
-    condition_t *centry = (condition_t *)malloc(sizeof(condition_t));
+    condition_t *centry = (condition_t *)calloc(1, sizeof(condition_t));
     centry->cond_name = strdup(label);
     centry->cond = strdup(cstr);
+    atomic_init(&(centry->cached), 0);
+    // only a jcond the compiler could not translate needs mujs
+    pthread_mutex_lock(&jcond_lock);
+    jcond_start();
+    jcond_compile(centry);
+    pthread_mutex_unlock(&jcond_lock);
+    HASH_ADD_STR(jcondtbl, cond_name, centry);
+}
+
+void jcond_define_native(const char *label, jcond_pred_t pred)
+{
+    condition_t *centry = (condition_t *)calloc(1, sizeof(condition_t));
+    centry->cond_name = strdup(label);
+    centry->pred = pred;
     HASH_ADD_STR(jcondtbl, cond_name, centry);
 }
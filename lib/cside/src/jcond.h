@@ -3,11 +3,38 @@
 
 #include <mujs.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <uthash.h>
 
+/**
+ * jsys_t - The jsys fields of this node, what native jconds look at
+ * @type: node type, "device" on a C node
+ * @tag:  tag given on the command line, NULL for none (undefined in JavaScript)
+ */
+typedef struct jsys_t {
+    const char *type;
+    const char *tag;
+} jsys_t;
+
+extern jsys_t jsys;
+
+typedef bool (*jcond_pred_t)();
+
+/**
+ * condition_t - A jcond registered by jcond_define() or jcond_define_native()
+ * @cond_name: label the functions refer to it by (function_t.cond)
+ * @cond:      the JavaScript expression, NULL for a native one
+ * @pred:      the C predicate the compiler translated the expression into, or NULL
+ * @fn:        registry reference of the compiled expression, NULL until it compiled
+ * @cached:    last result, as (jsys epoch << 1) | result. Stale once jsys changed.
+ */
 typedef struct {
     const char *cond_name;
     const char *cond;
+    jcond_pred_t pred;
+    const char *fn;
+    atomic_long cached;
     UT_hash_handle hh;
 } condition_t;
 
@@ -16,6 +43,11 @@ typedef struct {
 void print(js_State *J);
 
 void jcond_init();
+/**
+ * jcond_init() - Starts the mujs state, with jsys mirrored into it. Anything that
+ *                needs mujs starts it, so a node with native jconds only never does.
+ */
+
 void jcond_eval_str(const char *s);
 char *jcond_eval_str_str(const char *s);
 int jcond_eval_bool(const char *s);
@@ -24,5 +56,37 @@ double jcond_eval_double(const char *s);
 void jcond_free();
 bool jcond_evaluate(const char *cnd);
 void jcond_define(const char *label, const char *cstr);
+/**
+ * jcond_define() - Registers a jcond and compiles its expression into a mujs function
+ * jcond_evaluate() - Result of the jcond labelled @cnd, true for no label, false for
+ *                    an unknown one or one that does not compile
+ *
+ * A jcond only looks at jsys, so its result is kept until jsys changes and most
+ * evaluations are a load and a compare, without entering mujs.
+ */
+
+void jcond_define_native(const char *label, jcond_pred_t pred);
+/**
+ * jcond_define_native() - Registers a jcond the compiler translated into @pred
+ */
+
+void jcond_set_jsys(const char *type, const char *tag);
+/**
+ * jcond_set_jsys() - Sets the jsys fields, in mujs too if it was started
+ *
+ * Context: setup, before the executors and message processors evaluate jconds
+ */
+
+// JavaScript == on two jsys fields or string literals, undefined included
+static inline bool jcond_streq(const char *a, const char *b)
+{
+    return a == NULL || b == NULL ? a == b : strcmp(a, b) == 0;
+}
+
+void jcond_jsys_changed();
+/**
+ * jcond_jsys_changed() - Makes the kept results stale. jcond_eval_str() calls it, as
+ *                        any script may modify jsys.
+ */
 
 #endif
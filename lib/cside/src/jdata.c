@@ -0,0 +1,1096 @@
+/*
+ * Logger and broadcaster runtime for the jdata constructs emitted by the compiler.
+ *
+ * Logger writes are encoded straight into a per-stream ring and published as one
+ * CBOR array once enough of them have accumulated, or when the flush deadline set
+ * on the timing wheel passes, so a sensor sampled at a high rate does not cost one
+ * MQTT publish per value. While the broker is behind (too many publishes in flight)
+ * batches are held back, and a full ring blocks the writer, drops its oldest values
+ * or thins them out, depending on the stream policy. Blocked writers park until the
+ * MQTT client reports enough publishes completed.
+ *
+ * Broadcast values are decoded once by the MQTT callback thread into an immutable
+ * snapshot that is published with a pointer swap. Readers only load atomics, and take
+ * a reference on the snapshot they are handed that they keep until they read the same
+ * broadcaster again. A snapshot is retired when its ring slot is reused and no reader
+ * holds it, and freed once no reader is between loading a slot and taking its reference.
+ * Readers waiting for the next value park on the broadcaster and are woken by the
+ * MQTT callback thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <minicoro.h>
+#include <tinycbor/cbor.h>
+#include "jdata.h"
+#include "cnode.h"
+#include "tboard.h"
+
+static cnode_t *jnode = NULL;
+static char *log_prefix = NULL;         // /<app>/jdata/log/
+static char *bcast_prefix = NULL;       // /<app>/jdata/bcast/
+
+static jamlogger_t *loggers = NULL;
+static jambroadcaster_t *broadcasters = NULL;
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+static __thread bcast_hold_t *thread_holds = NULL;     // readers outside of tasks
+static jdata_waitq_t log_waitq;                         // writers held back by JDATA_LOG_BLOCK
+
+
+//////////////////////////////////////////
+///////////// Wait queues ////////////////
+//////////////////////////////////////////
+
+static void jdata_waitq_init(jdata_waitq_t *wq)
+{
+    pthread_mutex_init(&(wq->lock), NULL);
+    pthread_cond_init(&(wq->cond), NULL);
+    atomic_init(&(wq->waiting), 0);
+    wq->tasks = NULL;
+    wq->ntasks = wq->size = 0;
+}
+
+static void jdata_waitq_destroy(jdata_waitq_t *wq)
+{
+    pthread_mutex_destroy(&(wq->lock));
+    pthread_cond_destroy(&(wq->cond));
+    free(wq->tasks);
+}
+
+/*
+ * Waiters announce themselves in @waiting before they check their condition, wakers
+ * change the condition before they look at @waiting: one of the two sees the other.
+ */
+static void jdata_waitq_enter(jdata_waitq_t *wq)
+{
+    atomic_fetch_add(&(wq->waiting), 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+// wakes everybody waiting on @wq, called after the condition changed
+static void jdata_waitq_wake(jdata_waitq_t *wq)
+{
+    task_t **tasks;
+    int n;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(wq->waiting), memory_order_relaxed) == 0)
+        return;
+    pthread_mutex_lock(&(wq->lock));
+    tasks = wq->tasks;
+    n = wq->ntasks;
+    wq->tasks = NULL;
+    wq->ntasks = wq->size = 0;
+    atomic_fetch_sub(&(wq->waiting), n);
+    pthread_cond_broadcast(&(wq->cond));
+    pthread_mutex_unlock(&(wq->lock));
+    for (int i = 0; i < n; i++)
+        task_place(jnode->tboard, tasks[i]);
+    free(tasks);
+}
+
+void jdata_park(tboard_t *t, task_t *task, jdata_park_t *p)
+{
+    jdata_waitq_t *wq = p->wq;
+
+    pthread_mutex_lock(&(wq->lock));
+    jdata_waitq_enter(wq);
+    if (p->ready(p->arg)) {
+        atomic_fetch_sub(&(wq->waiting), 1);
+        pthread_mutex_unlock(&(wq->lock));
+        task_place(t, task);
+        return;
+    }
+    if (wq->ntasks == wq->size) {
+        wq->size = wq->size > 0 ? wq->size * 2 : 8;
+        wq->tasks = (task_t **)realloc(wq->tasks, wq->size * sizeof(task_t *));
+        assert(wq->tasks != NULL);
+    }
+    wq->tasks[wq->ntasks++] = task;
+    pthread_mutex_unlock(&(wq->lock));
+}
+
+/*
+ * Waits on @wq until @ready holds, or at least until the next wakeup: callers check
+ * their condition again. A task yields and the executor parks it (jdata_park()) once
+ * it is off its stack, a thread outside of tasks blocks on the condition variable.
+ */
+static void jdata_waitq_wait(jdata_waitq_t *wq, bool (*ready)(void *), void *arg)
+{
+    jdata_park_t p = {.wq = wq, .ready = ready, .arg = arg};
+
+    if (mco_running() != NULL) {
+        if (mco_push(mco_running(), &p, sizeof(jdata_park_t)) != MCO_SUCCESS)
+            tboard_err("jdata_waitq_wait: Failed to push to mco storage interface.\n");
+        task_yield();
+        return;
+    }
+    pthread_mutex_lock(&(wq->lock));
+    jdata_waitq_enter(wq);
+    while (!ready(arg))
+        pthread_cond_wait(&(wq->cond), &(wq->lock));
+    atomic_fetch_sub(&(wq->waiting), 1);
+    pthread_mutex_unlock(&(wq->lock));
+}
+
+
+void jdata_init(void *cnode)
+{
+    char buf[256];
+
+    jnode = (cnode_t *)cnode;
+    snprintf(buf, sizeof(buf), "/%s/jdata/log/", jnode->args->appid);
+    log_prefix = strdup(buf);
+    snprintf(buf, sizeof(buf), "/%s/jdata/bcast/", jnode->args->appid);
+    bcast_prefix = strdup(buf);
+    jdata_waitq_init(&log_waitq);
+}
+
+
+//////////////////////////////////////////
+/////////////// Loggers //////////////////
+//////////////////////////////////////////
+
+static char *jdata_key(char *ns, char *name)
+{
+    char *key = (char *)malloc(strlen(ns) + strlen(name) + 2);
+    assert(key != NULL);
+    sprintf(key, "%s/%s", ns, name);
+    return key;
+}
+
+// creates the stream @key, called with the registry write locked
+static jamlogger_t *jamlogger_new(char *key)
+{
+    jamlogger_t *l = (jamlogger_t *)calloc(1, sizeof(jamlogger_t));
+    assert(l != NULL);
+    l->key = key;
+    l->topic = (char *)malloc(strlen(log_prefix) + strlen(key) + 1);
+    sprintf(l->topic, "%s%s", log_prefix, key);
+    pthread_mutex_init(&(l->lock), NULL);
+    twheel_timer_init(&(l->timer), TW_EVENT_LOG_FLUSH, l);
+    l->policy = JDATA_LOG_BACKPRESSURE;
+    l->size = JDATA_LOG_INITIAL_BUFSIZE;
+    l->buf = (uint8_t *)malloc(l->size);
+    assert(l->buf != NULL);
+    HASH_ADD_KEYPTR(hh, loggers, l->key, strlen(l->key), l);
+    return l;
+}
+
+// looks up the stream @ns/@name, @create makes it if it does not exist yet
+static jamlogger_t *jamlogger_find(char *ns, char *name, bool create)
+{
+    jamlogger_t *l;
+    char kbuf[LARGE_CMD_STR_LEN];
+    char *key = kbuf;
+
+    // the common case (the stream exists) does not allocate
+    if (snprintf(kbuf, sizeof(kbuf), "%s/%s", ns, name) >= (int)sizeof(kbuf))
+        key = jdata_key(ns, name);
+    pthread_rwlock_rdlock(&registry_lock);
+    HASH_FIND_STR(loggers, key, l);
+    pthread_rwlock_unlock(&registry_lock);
+    if (l == NULL && create) {
+        pthread_rwlock_wrlock(&registry_lock);
+        HASH_FIND_STR(loggers, key, l);
+        if (l == NULL)
+            l = jamlogger_new(key == kbuf ? strdup(key) : key);
+        pthread_rwlock_unlock(&registry_lock);
+    }
+    if (key != kbuf && (l == NULL || l->key != key))
+        free(key);
+    return l;
+}
+
+#define jamlogger_get(ns, name)     jamlogger_find(ns, name, true)
+
+// CBOR initial byte(s) for major type @major with argument @val
+static size_t cbor_put_head(uint8_t *p, int major, uint64_t val)
+{
+    major <<= 5;
+    if (val < 24) {
+        p[0] = major | val;
+        return 1;
+    } else if (val <= 0xff) {
+        p[0] = major | 24;
+        p[1] = val;
+        return 2;
+    } else if (val <= 0xffff) {
+        p[0] = major | 25;
+        p[1] = val >> 8;
+        p[2] = val;
+        return 3;
+    } else if (val <= 0xffffffffUL) {
+        p[0] = major | 26;
+        for (int i = 0; i < 4; i++)
+            p[1 + i] = val >> (8 * (3 - i));
+        return 5;
+    }
+    p[0] = major | 27;
+    for (int i = 0; i < 8; i++)
+        p[1 + i] = val >> (8 * (7 - i));
+    return 9;
+}
+
+static size_t cbor_put_text(uint8_t *p, const char *s)
+{
+    size_t len = strlen(s);
+    size_t n = cbor_put_head(p, 3, len);
+    memcpy(p + n, s, len);
+    return n + len;
+}
+
+/*
+ * The buffered values of a stream sit back to back in buf[head, used). offs is a
+ * ring with the start of each of them, offs[first] being the oldest, so the oldest
+ * value can be dropped by moving head forward. The free space in front of head is
+ * reclaimed when the buffer runs out of room at the back.
+ */
+#define log_off(l, i)       ((l)->offs[((l)->first + (i)) % JDATA_LOG_RING_SIZE])
+#define log_end(l, i)       ((i) + 1 < (l)->count ? log_off(l, (i) + 1) : (l)->used)
+
+// makes room for @need bytes after used, called with the stream lock held
+static void jamlogger_make_room(jamlogger_t *l, size_t need)
+{
+    if (l->head > 0) {
+        memmove(l->buf, l->buf + l->head, l->used - l->head);
+        for (int i = 0; i < l->count; i++)
+            log_off(l, i) -= l->head;
+        l->used -= l->head;
+        l->head = 0;
+    }
+    if (l->size - l->used < need) {
+        l->size = l->size * 2 > l->used + need ? l->size * 2 : l->used + need;
+        l->buf = (uint8_t *)realloc(l->buf, l->size);
+        assert(l->buf != NULL);
+    }
+}
+
+static void jamlogger_reset(jamlogger_t *l)
+{
+    l->head = l->used = 0;
+    l->first = l->count = 0;
+    l->deadline = 0;
+}
+
+// JDATA_LOG_DROP_OLDEST, called with the stream lock held
+static void jamlogger_drop_oldest(jamlogger_t *l)
+{
+    l->head = log_end(l, 0);
+    l->first = (l->first + 1) % JDATA_LOG_RING_SIZE;
+    l->count--;
+    l->seq++;
+    l->stats.drops++;
+    if (l->count == 0)
+        jamlogger_reset(l);
+}
+
+// JDATA_LOG_DOWNSAMPLE: keeps every other buffered value, called with the stream lock held
+static void jamlogger_thin(jamlogger_t *l)
+{
+    size_t w = l->head, start, len;
+    int kept = 0;
+
+    for (int i = 0; i < l->count; i += 2) {
+        start = log_off(l, i);
+        len = log_end(l, i) - start;
+        memmove(l->buf + w, l->buf + start, len);
+        log_off(l, kept) = w;
+        w += len;
+        kept++;
+    }
+    l->stats.drops += l->count - kept;
+    l->count = kept;
+    l->used = w;
+}
+
+/*
+ * Turns the buffered values into a batch message and empties the buffer.
+ * Must be called with the stream lock held. Returns NULL if nothing is buffered.
+ */
+static uint8_t *jamlogger_take_batch(jamlogger_t *l, size_t *len, int *count)
+{
+    char *nodeid = jnode->core->device_id;
+    uint8_t *msg, *p;
+
+    *count = l->count;
+    if (l->count == 0)
+        return NULL;
+    // map(3) + 3 keys + nodeid + seq + array head, all bounded by the 9 byte heads
+    msg = (uint8_t *)malloc(64 + strlen(nodeid) + l->used - l->head);
+    assert(msg != NULL);
+    p = msg;
+    p += cbor_put_head(p, 5, 3);
+    p += cbor_put_text(p, "nodeid");
+    p += cbor_put_text(p, nodeid);
+    p += cbor_put_text(p, "seq");
+    p += cbor_put_head(p, 0, l->seq);
+    p += cbor_put_text(p, "values");
+    p += cbor_put_head(p, 4, l->count);
+    memcpy(p, l->buf + l->head, l->used - l->head);
+    p += l->used - l->head;
+    *len = p - msg;
+
+    l->seq = l->written;
+    jamlogger_reset(l);
+    return msg;
+}
+
+static void jamlogger_publish(jamlogger_t *l, uint8_t *msg, size_t len, int count)
+{
+    server_t *s = jnode->devserv;
+
+    if (s != NULL && s->mqtt != NULL && s->state == SERVER_REGISTERED) {
+        // mosquitto copies the payload, so the batch can go right away
+        mqtt_publish(s->mqtt, l->topic, msg, len, NULL, 0);
+        pthread_mutex_lock(&(l->lock));
+        l->stats.values += count;
+        l->stats.bytes += len;
+        l->stats.batches++;
+        pthread_mutex_unlock(&(l->lock));
+    } else {
+        pthread_mutex_lock(&(l->lock));
+        l->stats.drops += count;
+        pthread_mutex_unlock(&(l->lock));
+    }
+    free(msg);
+}
+
+// the broker is not keeping up with what we publish
+static bool jdata_congested()
+{
+    server_t *s = jnode->devserv;
+
+    return s != NULL && s->mqtt != NULL && s->state == SERVER_REGISTERED &&
+           atomic_load_explicit(&(s->mqtt->inflight), memory_order_relaxed) >= JDATA_LOG_MAX_INFLIGHT;
+}
+
+static bool jdata_log_ready(void *arg)
+{
+    (void)arg;
+    return !jdata_congested();
+}
+
+void jdata_log_resume()
+{
+    if (jnode != NULL && !jdata_congested())
+        jdata_waitq_wake(&log_waitq);
+}
+
+// arms the flush deadline when the first value goes into the buffer, called with the stream lock held
+static void jamlogger_arm(jamlogger_t *l)
+{
+    tboard_t *tb = jnode->tboard;
+
+    if (l->deadline != 0 || tb == NULL)
+        return;
+    l->deadline = getcurtime() + JDATA_LOG_FLUSH_INTERVAL;
+    twheel_timer_arm(tb, &(l->timer), l->deadline);
+}
+
+/*
+ * Frees a slot in the ring before a value is appended, applying the stream policy
+ * while the broker is behind. Called and returns with the stream lock held.
+ */
+static void jamlogger_overflow(jamlogger_t *l)
+{
+    uint8_t *msg;
+    size_t mlen;
+    int count;
+
+    while (l->count >= JDATA_LOG_RING_SIZE) {
+        if (!jdata_congested()) {
+            msg = jamlogger_take_batch(l, &mlen, &count);
+            pthread_mutex_unlock(&(l->lock));
+            jamlogger_publish(l, msg, mlen, count);
+            pthread_mutex_lock(&(l->lock));
+            continue;
+        }
+        switch (l->policy) {
+            case JDATA_LOG_BLOCK:
+                l->stats.stalls++;
+                pthread_mutex_unlock(&(l->lock));
+                jdata_waitq_wait(&log_waitq, jdata_log_ready, NULL);
+                pthread_mutex_lock(&(l->lock));
+                break;
+            case JDATA_LOG_DOWNSAMPLE:
+                jamlogger_thin(l);
+                break;
+            default:
+                jamlogger_drop_oldest(l);
+        }
+    }
+}
+
+/*
+ * Encoders for the value types. Each is called twice at most: if the value does
+ * not fit in the remaining buffer, the buffer is grown by what tinycbor reports
+ * missing and the value is encoded again.
+ */
+typedef struct log_value_t {
+    char type;
+    union {
+        long lval;
+        double dval;
+        char *sval;
+    } val;
+} log_value_t;
+
+static void encode_value(CborEncoder *e, log_value_t *v)
+{
+    switch (v->type) {
+        case 'i':
+            cbor_encode_int(e, v->val.lval);
+            break;
+        case 'f':
+            cbor_encode_float(e, (float)v->val.dval);
+            break;
+        case 'd':
+            cbor_encode_double(e, v->val.dval);
+            break;
+        case 's':
+            if (v->val.sval != NULL)
+                cbor_encode_text_stringz(e, v->val.sval);
+            else
+                cbor_encode_null(e);
+            break;
+        default:
+            cbor_encode_null(e);
+    }
+}
+
+static size_t encode_entry(uint8_t *buf, size_t size, size_t *extra, char **names, log_value_t *vals, int n)
+{
+    CborEncoder encoder, mapEncoder;
+
+    cbor_encoder_init(&encoder, buf, size, 0);
+    if (names == NULL)
+        encode_value(&encoder, &vals[0]);
+    else {
+        cbor_encoder_create_map(&encoder, &mapEncoder, n);
+        for (int i = 0; i < n; i++) {
+            cbor_encode_text_stringz(&mapEncoder, names[i]);
+            encode_value(&mapEncoder, &vals[i]);
+        }
+        cbor_encoder_close_container(&encoder, &mapEncoder);
+    }
+    *extra = cbor_encoder_get_extra_bytes_needed(&encoder);
+    return *extra > 0 ? 0 : cbor_encoder_get_buffer_size(&encoder, buf);
+}
+
+static void jamlogger_append(char *ns, char *name, char **names, log_value_t *vals, int n)
+{
+    jamlogger_t *l = jamlogger_get(ns, name);
+    uint8_t *msg = NULL;
+    size_t len, extra, mlen = 0;
+    int count = 0;
+
+    pthread_mutex_lock(&(l->lock));
+    if (l->count >= JDATA_LOG_RING_SIZE)
+        jamlogger_overflow(l);
+    len = encode_entry(l->buf + l->used, l->size - l->used, &extra, names, vals, n);
+    if (len == 0) {
+        jamlogger_make_room(l, l->size - l->used + extra);
+        len = encode_entry(l->buf + l->used, l->size - l->used, &extra, names, vals, n);
+    }
+    l->offs[(l->first + l->count) % JDATA_LOG_RING_SIZE] = l->used;
+    l->used += len;
+    l->count++;
+    l->written++;
+    // while the broker is behind, values stay in the ring until it fills up
+    if ((l->count >= JDATA_LOG_BATCH_SIZE || l->used - l->head >= JDATA_LOG_BATCH_BYTES) && !jdata_congested())
+        msg = jamlogger_take_batch(l, &mlen, &count);
+    else
+        jamlogger_arm(l);
+    pthread_mutex_unlock(&(l->lock));
+
+    if (msg != NULL)
+        jamlogger_publish(l, msg, mlen, count);
+}
+
+void jamdata_log_to_server_int(char *ns, char *name, int value)
+{
+    log_value_t v = {.type = 'i', .val.lval = value};
+    jamlogger_append(ns, name, NULL, &v, 1);
+}
+
+void jamdata_log_to_server_float(char *ns, char *name, float value)
+{
+    log_value_t v = {.type = 'f', .val.dval = value};
+    jamlogger_append(ns, name, NULL, &v, 1);
+}
+
+void jamdata_log_to_server_double(char *ns, char *name, double value)
+{
+    log_value_t v = {.type = 'd', .val.dval = value};
+    jamlogger_append(ns, name, NULL, &v, 1);
+}
+
+void jamdata_log_to_server_string(char *ns, char *name, char *value)
+{
+    log_value_t v = {.type = 's', .val.sval = value};
+    jamlogger_append(ns, name, NULL, &v, 1);
+}
+
+void jamdata_log_to_server(char *ns, char *name, char *fmt, ...)
+{
+    va_list args;
+    int n = strlen(fmt);
+    char *names[n > 0 ? n : 1];
+    log_value_t vals[n > 0 ? n : 1];
+
+    va_start(args, fmt);
+    for (int i = 0; i < n; i++) {
+        names[i] = va_arg(args, char *);
+        vals[i].type = fmt[i];
+        switch (fmt[i]) {
+            case 'i':
+                vals[i].val.lval = va_arg(args, int);
+                break;
+            case 'f':
+            case 'd':
+                vals[i].val.dval = va_arg(args, double);
+                break;
+            case 's':
+                vals[i].val.sval = va_arg(args, char *);
+                break;
+            default:
+                vals[i].val.lval = va_arg(args, long);
+        }
+    }
+    va_end(args);
+    jamlogger_append(ns, name, names, vals, n);
+}
+
+void jamdata_flush(char *ns, char *name)
+{
+    jamlogger_t *l = jamlogger_get(ns, name);
+    uint8_t *msg;
+    size_t mlen;
+    int count;
+
+    pthread_mutex_lock(&(l->lock));
+    msg = jamlogger_take_batch(l, &mlen, &count);
+    pthread_mutex_unlock(&(l->lock));
+    if (msg != NULL)
+        jamlogger_publish(l, msg, mlen, count);
+}
+
+void jamdata_log_policy(char *ns, char *name, int policy)
+{
+    jamlogger_t *l = jamlogger_get(ns, name);
+
+    pthread_mutex_lock(&(l->lock));
+    l->policy = policy;
+    pthread_mutex_unlock(&(l->lock));
+}
+
+void jdata_log_deadline(void *arg)
+{
+    jamlogger_t *l = (jamlogger_t *)arg;
+    uint8_t *msg = NULL;
+    size_t mlen;
+    int count;
+    long now = getcurtime();
+
+    pthread_mutex_lock(&(l->lock));
+    // stale deadlines (the batch went out on size) are ignored
+    if (l->deadline != 0 && l->deadline <= now) {
+        if (jdata_congested()) {
+            l->deadline = 0;
+            jamlogger_arm(l);
+        } else
+            msg = jamlogger_take_batch(l, &mlen, &count);
+    }
+    pthread_mutex_unlock(&(l->lock));
+    if (msg != NULL)
+        jamlogger_publish(l, msg, mlen, count);
+}
+
+bool jamdata_log_stats(char *ns, char *name, jamlogger_stats_t *st)
+{
+    jamlogger_t *l = jamlogger_find(ns, name, false);
+
+    if (l == NULL)
+        return false;
+    pthread_mutex_lock(&(l->lock));
+    *st = l->stats;
+    pthread_mutex_unlock(&(l->lock));
+    return true;
+}
+
+void jdata_print_stats(FILE *fp)
+{
+    jamlogger_t *l, *tmp;
+    jamlogger_stats_t st;
+
+    pthread_rwlock_rdlock(&registry_lock);
+    if (loggers != NULL)
+        fprintf(fp, "%-32s %10s %12s %8s %8s %8s\n", "logger", "values", "bytes", "batches", "drops", "stalls");
+    HASH_ITER(hh, loggers, l, tmp) {
+        pthread_mutex_lock(&(l->lock));
+        st = l->stats;
+        pthread_mutex_unlock(&(l->lock));
+        fprintf(fp, "%-32s %10lu %12lu %8lu %8lu %8lu\n", l->key, st.values, st.bytes, st.batches, st.drops, st.stalls);
+    }
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+
+//////////////////////////////////////////
+///////////// Broadcasters ///////////////
+//////////////////////////////////////////
+
+jambroadcaster_t *jambroadcaster_init(int mode, char *ns, char *name)
+{
+    jambroadcaster_t *b;
+    size_t nslen = strlen(ns);
+    bool record = nslen > 5 && strcmp(ns + nslen - 5, ".cbor") == 0;
+    char *plain = strndup(ns, record ? nslen - 5 : nslen);
+    char *key = jdata_key(plain, name);
+
+    free(plain);
+    pthread_rwlock_wrlock(&registry_lock);
+    HASH_FIND_STR(broadcasters, key, b);
+    if (b == NULL) {
+        b = (jambroadcaster_t *)calloc(1, sizeof(jambroadcaster_t));
+        assert(b != NULL);
+        b->key = key;
+        b->mode = mode;
+        b->record = record;
+        pthread_mutex_init(&(b->lock), NULL);
+        jdata_waitq_init(&(b->wait));
+        HASH_ADD_KEYPTR(hh, broadcasters, b->key, strlen(b->key), b);
+    } else
+        free(key);
+    pthread_rwlock_unlock(&registry_lock);
+    return b;
+}
+
+bool jdata_is_bcast_topic(const char *topic)
+{
+    return bcast_prefix != NULL && strncmp(topic, bcast_prefix, strlen(bcast_prefix)) == 0;
+}
+
+/*
+ * Walks a CBOR value and flattens it into fields. With @fields == NULL it only
+ * counts fields and string bytes, so the snapshot can be allocated in one piece.
+ */
+static CborError bcast_flatten(CborValue *it, bcast_field_t *fields, int *nfields, char **strs, size_t *strbytes)
+{
+    CborValue inner;
+    CborError err;
+    bcast_field_t f = {.type = BCAST_TYPE_INT};
+    int64_t lval;
+    double dval;
+    float fval;
+    bool bval;
+    size_t len;
+
+    switch (cbor_value_get_type(it)) {
+        case CborMapType:
+        case CborArrayType:
+            if ((err = cbor_value_enter_container(it, &inner)) != CborNoError)
+                return err;
+            while (!cbor_value_at_end(&inner)) {
+                if (cbor_value_is_map(it) && (err = cbor_value_advance(&inner)) != CborNoError) // skip the key
+                    return err;
+                if ((err = bcast_flatten(&inner, fields, nfields, strs, strbytes)) != CborNoError)
+                    return err;
+            }
+            return cbor_value_leave_container(it, &inner);
+        case CborIntegerType:
+            cbor_value_get_int64(it, &lval);
+            f.val.lval = lval;
+            break;
+        case CborBooleanType:
+            cbor_value_get_boolean(it, &bval);
+            f.val.lval = bval;
+            break;
+        case CborFloatType:
+            cbor_value_get_float(it, &fval);
+            f.type = BCAST_TYPE_DOUBLE;
+            f.val.dval = fval;
+            break;
+        case CborDoubleType:
+            cbor_value_get_double(it, &dval);
+            f.type = BCAST_TYPE_DOUBLE;
+            f.val.dval = dval;
+            break;
+        case CborTextStringType:
+            f.type = BCAST_TYPE_STRING;
+            if ((err = cbor_value_calculate_string_length(it, &len)) != CborNoError)
+                return err;
+            if (fields != NULL) {
+                size_t n = len + 1;
+                f.val.sval = *strs;
+                cbor_value_copy_text_string(it, *strs, &n, NULL);
+                (*strs)[len] = '\0';
+                *strs += len + 1;
+            }
+            *strbytes += len + 1;
+            break;
+        default:
+            f.val.lval = 0;
+    }
+    if (fields != NULL)
+        fields[*nfields] = f;
+    (*nfields)++;
+    return cbor_value_advance(it);
+}
+
+static bcast_value_t *bcast_value_new(const void *data, int len)
+{
+    CborParser parser;
+    CborValue it, first;
+    bcast_value_t *v;
+    bcast_field_t f;
+    int nfields = 0;
+    size_t strbytes = 0;
+    char *strs;
+
+    if (cbor_parser_init((const uint8_t *)data, len, 0, &parser, &it) != CborNoError)
+        return NULL;
+    first = it;
+    if (bcast_flatten(&first, NULL, &nfields, NULL, &strbytes) != CborNoError)
+        return NULL;
+
+    if (cbor_value_is_map(&it) || cbor_value_is_array(&it)) {
+        v = (bcast_value_t *)malloc(sizeof(bcast_value_t) + nfields * sizeof(bcast_field_t) + strbytes);
+        assert(v != NULL);
+        atomic_init(&(v->refs), 1);
+        v->type = BCAST_TYPE_RECORD;
+        v->nfields = 0;
+        strs = v->data + nfields * sizeof(bcast_field_t);
+        bcast_flatten(&it, (bcast_field_t *)v->data, &(v->nfields), &strs, &strbytes);
+        return v;
+    }
+
+    // a scalar, data holds just the value
+    v = (bcast_value_t *)malloc(sizeof(bcast_value_t) + (strbytes > sizeof(double) ? strbytes : sizeof(double)));
+    assert(v != NULL);
+    atomic_init(&(v->refs), 1);
+    v->nfields = 0;
+    strs = v->data;
+    bcast_flatten(&it, &f, &(v->nfields), &strs, &strbytes);
+    v->type = f.type;
+    if (f.type == BCAST_TYPE_DOUBLE)
+        *(double *)(v->data) = f.val.dval;
+    else if (f.type == BCAST_TYPE_INT)
+        *(long *)(v->data) = f.val.lval;
+    return v;
+}
+
+// drops a reference to @v, the last one retires it
+static void bcast_put(jambroadcaster_t *b, bcast_value_t *v)
+{
+    if (v == NULL || atomic_fetch_sub_explicit(&(v->refs), 1, memory_order_acq_rel) != 1)
+        return;
+    pthread_mutex_lock(&(b->lock));
+    v->next = b->retired;
+    b->retired = v;
+    pthread_mutex_unlock(&(b->lock));
+}
+
+// frees the retired snapshots of @b unless a reader may still be looking at one
+static void bcast_reclaim(jambroadcaster_t *b)
+{
+    bcast_value_t *v, *next;
+
+    pthread_mutex_lock(&(b->lock));
+    if (b->retired == NULL || atomic_load(&(b->readers)) != 0) {
+        pthread_mutex_unlock(&(b->lock));
+        return;
+    }
+    v = b->retired;
+    b->retired = NULL;
+    pthread_mutex_unlock(&(b->lock));
+    for (; v != NULL; v = next) {
+        next = v->next;
+        free(v);
+    }
+}
+
+/*
+ * Takes a reference on the snapshot of version @ver, NULL if its slot was reused in the
+ * meantime. @readers keeps the snapshot from being freed between the load and the
+ * reference, a snapshot whose count already dropped to 0 is not taken back.
+ */
+static bcast_value_t *bcast_get(jambroadcaster_t *b, long ver)
+{
+    bcast_value_t *v;
+    int refs;
+
+    atomic_fetch_add(&(b->readers), 1);
+    v = atomic_load(&(b->slots[ver % JDATA_BCAST_HISTORY]));
+    if (v != NULL && v->version == ver) {
+        refs = atomic_load_explicit(&(v->refs), memory_order_relaxed);
+        do {
+            if (refs == 0) {
+                v = NULL;
+                break;
+            }
+        } while (!atomic_compare_exchange_weak_explicit(&(v->refs), &refs, refs + 1,
+                                                        memory_order_acquire, memory_order_relaxed));
+    } else
+        v = NULL;
+    atomic_fetch_sub_explicit(&(b->readers), 1, memory_order_release);
+    return v;
+}
+
+// the caller holds @v until it reads @b again
+static void bcast_hold(jambroadcaster_t *b, bcast_value_t *v)
+{
+    exec_t *e = current_exec;
+    bcast_hold_t **holds = e != NULL && e->task != NULL ? &(e->task->bcast) : &thread_holds;
+    bcast_hold_t *h;
+
+    for (h = *holds; h != NULL && h->b != b; h = h->next)
+        ;
+    if (h == NULL) {
+        h = (bcast_hold_t *)calloc(1, sizeof(bcast_hold_t));
+        assert(h != NULL);
+        h->b = b;
+        h->next = *holds;
+        *holds = h;
+    }
+    bcast_put(b, h->v);
+    h->v = v;
+}
+
+void jdata_release_task(task_t *task)
+{
+    bcast_hold_t *h, *next;
+
+    for (h = task->bcast; h != NULL; h = next) {
+        next = h->next;
+        bcast_put(h->b, h->v);
+        free(h);
+    }
+    task->bcast = NULL;
+}
+
+// a BCAST_RETURNS_NEXT reader has something to read
+static bool bcast_ready(void *arg)
+{
+    jambroadcaster_t *b = (jambroadcaster_t *)arg;
+
+    return atomic_load(&(b->latest)) > atomic_load(&(b->seen));
+}
+
+void jdata_bcast_receive(const char *topic, const void *data, int len)
+{
+    jambroadcaster_t *b;
+    bcast_value_t *v, *old;
+    long ver, cur;
+
+    pthread_rwlock_rdlock(&registry_lock);
+    HASH_FIND_STR(broadcasters, topic + strlen(bcast_prefix), b);
+    pthread_rwlock_unlock(&registry_lock);
+    if (b == NULL || (v = bcast_value_new(data, len)) == NULL)
+        return;
+
+    ver = atomic_fetch_add_explicit(&(b->versions), 1, memory_order_relaxed) + 1;
+    v->version = ver;
+    old = atomic_exchange(&(b->slots[ver % JDATA_BCAST_HISTORY]), v);
+    bcast_put(b, old);
+    bcast_reclaim(b);
+    // with several brokers delivering, only move forward
+    cur = atomic_load_explicit(&(b->latest), memory_order_relaxed);
+    while (cur < ver && !atomic_compare_exchange_weak_explicit(&(b->latest), &cur, ver,
+                                                             memory_order_release, memory_order_relaxed))
+        ;
+    if (b->mode == BCAST_RETURNS_NEXT)
+        jdata_waitq_wake(&(b->wait));
+}
+
+void *get_bcast_next_value(jambroadcaster_t *b)
+{
+    bcast_value_t *v;
+    long ver, seen;
+
+    if (b == NULL)
+        return NULL;
+    for (;;) {
+        ver = atomic_load_explicit(&(b->latest), memory_order_acquire);
+        if (b->mode == BCAST_RETURNS_NEXT) {
+            seen = atomic_load_explicit(&(b->seen), memory_order_relaxed);
+            if (ver <= seen) {
+                jdata_waitq_wait(&(b->wait), bcast_ready, b);
+                continue;
+            }
+            if (!atomic_compare_exchange_strong(&(b->seen), &seen, ver))
+                continue;
+        } else if (ver == 0)
+            return NULL;
+        // NULL when @ver was overwritten by a newer value, which is read instead
+        if ((v = bcast_get(b, ver)) != NULL) {
+            bcast_hold(b, v);
+            return v->data;
+        }
+    }
+}
+
+#define bcast_header(p)     ((bcast_value_t *)((char *)(p) - offsetof(bcast_value_t, data)))
+
+static double bcast_field_double(bcast_field_t *f)
+{
+    switch (f->type) {
+        case BCAST_TYPE_DOUBLE:
+            return f->val.dval;
+        case BCAST_TYPE_STRING:
+            return atof(f->val.sval);
+        default:
+            return f->val.lval;
+    }
+}
+
+static bcast_field_t bcast_scalar(void *value)
+{
+    bcast_value_t *v = bcast_header(value);
+    bcast_field_t f = {.type = v->type};
+
+    switch (v->type) {
+        case BCAST_TYPE_DOUBLE:
+            f.val.dval = *(double *)value;
+            break;
+        case BCAST_TYPE_STRING:
+            f.val.sval = (char *)value;
+            break;
+        case BCAST_TYPE_RECORD:
+            if (v->nfields > 0)
+                return ((bcast_field_t *)value)[0];
+            f.type = BCAST_TYPE_INT;
+            f.val.lval = 0;
+            break;
+        default:
+            f.val.lval = *(long *)value;
+    }
+    return f;
+}
+
+int get_bcast_int(void *value)
+{
+    if (value == NULL)
+        return 0;
+    bcast_field_t f = bcast_scalar(value);
+    return f.type == BCAST_TYPE_INT ? (int)f.val.lval : (int)bcast_field_double(&f);
+}
+
+float get_bcast_float(void *value)
+{
+    if (value == NULL)
+        return 0;
+    bcast_field_t f = bcast_scalar(value);
+    return (float)bcast_field_double(&f);
+}
+
+double get_bcast_double(void *value)
+{
+    if (value == NULL)
+        return 0;
+    bcast_field_t f = bcast_scalar(value);
+    return bcast_field_double(&f);
+}
+
+char *get_bcast_char(void *value)
+{
+    if (value == NULL)
+        return NULL;
+    bcast_field_t f = bcast_scalar(value);
+    return f.type == BCAST_TYPE_STRING ? f.val.sval : NULL;
+}
+
+void jamdata_decode(char *fmt, void *value, int count, void *dst, ...)
+{
+    va_list args;
+    bcast_value_t *v;
+    bcast_field_t *fields, f;
+    int nfields;
+    char *p;
+
+    if (value == NULL)
+        return;
+    v = bcast_header(value);
+    if (v->type == BCAST_TYPE_RECORD) {
+        fields = (bcast_field_t *)value;
+        nfields = v->nfields;
+    } else {
+        f = bcast_scalar(value);
+        fields = &f;
+        nfields = 1;
+    }
+
+    va_start(args, dst);
+    for (int i = 0; i < count && fmt[i] != '\0'; i++) {
+        p = (char *)dst + va_arg(args, size_t);
+        if (i >= nfields)
+            continue;
+        switch (fmt[i]) {
+            case 'i':
+                *(int *)p = fields[i].type == BCAST_TYPE_INT ? (int)fields[i].val.lval : (int)bcast_field_double(&fields[i]);
+                break;
+            case 'f':
+                *(float *)p = (float)bcast_field_double(&fields[i]);
+                break;
+            case 'd':
+                *(double *)p = bcast_field_double(&fields[i]);
+                break;
+            case 's':
+                *(char **)p = fields[i].type == BCAST_TYPE_STRING ? fields[i].val.sval : NULL;
+                break;
+        }
+    }
+    va_end(args);
+}
+
+
+void jdata_shutdown()
+{
+    jamlogger_t *l, *ltmp;
+    jambroadcaster_t *b, *btmp;
+    bcast_hold_t *h, *hnext;
+    uint8_t *msg;
+    size_t mlen;
+    int count;
+
+    pthread_rwlock_wrlock(&registry_lock);
+    HASH_ITER(hh, loggers, l, ltmp) {
+        pthread_mutex_lock(&(l->lock));
+        msg = jamlogger_take_batch(l, &mlen, &count);
+        pthread_mutex_unlock(&(l->lock));
+        if (msg != NULL)
+            jamlogger_publish(l, msg, mlen, count);
+        HASH_DEL(loggers, l);
+        pthread_mutex_destroy(&(l->lock));
+        free(l->buf);
+        free(l->topic);
+        free(l->key);
+        free(l);
+    }
+    // snapshots held by tasks that never terminated are left to them
+    for (h = thread_holds; h != NULL; h = hnext) {
+        hnext = h->next;
+        bcast_put(h->b, h->v);
+        free(h);
+    }
+    thread_holds = NULL;
+    HASH_ITER(hh, broadcasters, b, btmp) {
+        HASH_DEL(broadcasters, b);
+        for (int i = 0; i < JDATA_BCAST_HISTORY; i++)
+            bcast_put(b, atomic_load(&(b->slots[i])));
+        bcast_reclaim(b);
+        pthread_mutex_destroy(&(b->lock));
+        jdata_waitq_destroy(&(b->wait));
+        free(b->key);
+        free(b);
+    }
+    pthread_rwlock_unlock(&registry_lock);
+    jdata_waitq_destroy(&log_waitq);
+    free(log_prefix);
+    free(bcast_prefix);
+    log_prefix = bcast_prefix = NULL;
+}
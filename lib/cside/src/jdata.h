@@ -0,0 +1,364 @@
+#ifndef __JDATA_H__
+#define __JDATA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <uthash.h>
+#include "tboard.h"
+
+/*
+ * C side of the JAMScript data (jdata) constructs. Loggers stream values from the
+ * C node up to the J node, broadcasters carry values from the J side down to the
+ * C node. Both travel over the MQTT adapter of the device server:
+ *
+ *   /<app>/jdata/log/<ns>/<name>       logger batches (C -> J)
+ *   /<app>/jdata/bcast/<ns>/<name>     broadcast values (J -> C)
+ *
+ * A logger batch is a CBOR map {nodeid: str, seq: uint, values: [v0, v1, ...]} where
+ * seq is the sequence number of v0 within the stream, so dropped values show up as gaps
+ * (values of a downsampled batch are not consecutive). Structured values are maps of
+ * field name to value. A broadcast payload is the CBOR value itself.
+ */
+
+#define BCAST_RETURNS_NEXT          1
+#define BCAST_RETURNS_LAST          2
+
+#define JDATA_LOG_BLOCK             1
+#define JDATA_LOG_DROP_OLDEST       2
+#define JDATA_LOG_DOWNSAMPLE        3
+
+#define JDATA_LOG_BATCH_SIZE        64
+#define JDATA_LOG_BATCH_BYTES       4096
+#define JDATA_LOG_FLUSH_INTERVAL    100000
+#define JDATA_LOG_RING_SIZE         1024
+#define JDATA_LOG_MAX_INFLIGHT      32
+#define JDATA_LOG_BACKPRESSURE      JDATA_LOG_DROP_OLDEST
+#define JDATA_LOG_INITIAL_BUFSIZE   512
+#define JDATA_BCAST_HISTORY         16
+/**
+ * Configurable Macros
+ * @JDATA_LOG_BATCH_SIZE:       a logger stream is flushed when this many values are buffered
+ * @JDATA_LOG_BATCH_BYTES:      ... or when the encoded values take this many bytes
+ * @JDATA_LOG_FLUSH_INTERVAL:   ... or at the latest this many microseconds after the first
+ *                              value went into the buffer (timing wheel deadline)
+ * @JDATA_LOG_RING_SIZE:        number of values a stream holds while the broker is behind
+ * @JDATA_LOG_MAX_INFLIGHT:     the broker is behind when this many publishes are not yet
+ *                              completed by the MQTT client
+ * @JDATA_LOG_BACKPRESSURE:     default policy applied to a full ring while the broker is
+ *                              behind, see jamdata_log_policy()
+ * @JDATA_LOG_INITIAL_BUFSIZE:  initial size of the per-stream buffer, it grows on demand
+ * @JDATA_BCAST_HISTORY:        number of broadcast snapshots kept per broadcaster, readers
+ *                              hold on to the ones they were handed (see get_bcast_next_value())
+ */
+
+typedef enum {
+    BCAST_TYPE_INT,
+    BCAST_TYPE_DOUBLE,
+    BCAST_TYPE_STRING,
+    BCAST_TYPE_RECORD
+} bcast_type_t;
+
+/**
+ * bcast_field_t - One (flattened) field of a structured broadcast value
+ */
+typedef struct bcast_field_t {
+    bcast_type_t type;
+    union {
+        long lval;
+        double dval;
+        char *sval;
+    } val;
+} bcast_field_t;
+
+/**
+ * bcast_value_t - Immutable snapshot of a broadcast value
+ * @version: position of the value in the broadcast stream (starts at 1)
+ * @refs:    one for the ring slot, one per reader holding the value
+ * @next:    link in the retired list of the broadcaster once @refs dropped to 0
+ * @type:    type of the value
+ * @nfields: number of bcast_field_t in @data for BCAST_TYPE_RECORD
+ * @data:    the value handed out to readers: a long, a double, a null terminated string,
+ *           or an array of @nfields bcast_field_t followed by the strings they point to
+ *
+ * Snapshots are built by the MQTT callback thread and published by swapping a pointer,
+ * so readers never take a lock.
+ */
+typedef struct bcast_value_t {
+    long version;
+    atomic_int refs;
+    struct bcast_value_t *next;
+    bcast_type_t type;
+    int nfields;
+    char data[] __attribute__((aligned(8)));
+} bcast_value_t;
+
+/**
+ * jdata_waitq_t - Tasks and threads waiting in the jdata runtime
+ * @lock:    protects everything below
+ * @cond:    threads outside of tasks wait on this
+ * @waiting: tasks and threads on the queue, wakers skip the lock while it is 0
+ * @tasks:   parked tasks, placed back in their ready queues by the next wakeup
+ * @ntasks:  number of @tasks
+ * @size:    room in @tasks
+ */
+typedef struct jdata_waitq_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int waiting;
+    task_t **tasks;
+    int ntasks;
+    int size;
+} jdata_waitq_t;
+
+/**
+ * jdata_park_t - What a task waiting in the jdata runtime yields with
+ * @wq:    queue the task waits on
+ * @ready: what the task waits for, checked again under the queue lock
+ * @arg:   argument of @ready
+ *
+ * The executor tells it apart from the other yields by its size (see jdata_park()).
+ */
+typedef struct jdata_park_t {
+    jdata_waitq_t *wq;
+    bool (*ready)(void *arg);
+    void *arg;
+} jdata_park_t;
+
+_Static_assert(sizeof(jdata_park_t) != sizeof(void *), "jdata_park_t must not look like a futures_t * yield");
+
+/**
+ * jambroadcaster_t - Receiving end of a broadcaster
+ * @key:      "<ns>/<name>", registry key
+ * @mode:     BCAST_RETURNS_NEXT or BCAST_RETURNS_LAST
+ * @record:   values are structures (namespace ends in ".cbor")
+ * @versions: last version handed to a writer
+ * @latest:   newest version published in @slots
+ * @seen:     newest version returned by a BCAST_RETURNS_NEXT read
+ * @readers:  readers between loading a slot and taking their reference
+ * @slots:    ring of the last JDATA_BCAST_HISTORY snapshots, indexed by version
+ * @lock:     protects @retired
+ * @retired:  snapshots nobody holds, freed once no reader is between load and reference
+ * @wait:     BCAST_RETURNS_NEXT readers waiting for a new value
+ */
+typedef struct jambroadcaster_t {
+    char *key;
+    int mode;
+    bool record;
+    atomic_long versions;
+    atomic_long latest;
+    atomic_long seen;
+    atomic_int readers;
+    _Atomic(bcast_value_t *) slots[JDATA_BCAST_HISTORY];
+    pthread_mutex_t lock;
+    bcast_value_t *retired;
+    jdata_waitq_t wait;
+    UT_hash_handle hh;
+} jambroadcaster_t;
+
+/**
+ * bcast_hold_t - Snapshot a reader was handed last by one broadcaster
+ * @b:    the broadcaster
+ * @v:    the snapshot, referenced until the reader reads @b again or terminates
+ * @next: next broadcaster the reader holds a value of
+ */
+typedef struct bcast_hold_t {
+    jambroadcaster_t *b;
+    bcast_value_t *v;
+    struct bcast_hold_t *next;
+} bcast_hold_t;
+
+/**
+ * jamlogger_stats_t - Counters of a logger stream
+ * @values:  values published
+ * @bytes:   bytes published
+ * @batches: batches published
+ * @drops:   values dropped, by the backpressure policy or because there was no
+ *           connection to the server
+ * @stalls:  times a writer was held back by JDATA_LOG_BLOCK
+ */
+typedef struct jamlogger_stats_t {
+    unsigned long values;
+    unsigned long bytes;
+    unsigned long batches;
+    unsigned long drops;
+    unsigned long stalls;
+} jamlogger_stats_t;
+
+/**
+ * jamlogger_t - Sending end of a logger stream
+ * @key:      "<ns>/<name>", registry key
+ * @topic:    MQTT topic the batches are published on
+ * @lock:     protects everything below
+ * @policy:   JDATA_LOG_BLOCK, JDATA_LOG_DROP_OLDEST or JDATA_LOG_DOWNSAMPLE
+ * @buf:      encoded values waiting to be flushed, in [@head, @used)
+ * @offs:     ring with the offset of each buffered value in @buf
+ * @first:    index of the oldest value in @offs
+ * @count:    number of values in @buf
+ * @seq:      sequence number of the first value in @buf
+ * @written:  number of values appended to the stream
+ * @deadline: time the buffer is flushed at the latest, 0 when it is empty
+ * @timer:    wakes the pExecutor at @deadline. The stream must outlive the task board
+ *            (jdata_shutdown() runs in cnode_destroy(), after cnode_stop()).
+ */
+typedef struct jamlogger_t {
+    char *key;
+    char *topic;
+    pthread_mutex_t lock;
+    int policy;
+    uint8_t *buf;
+    size_t size;
+    size_t head;
+    size_t used;
+    uint32_t offs[JDATA_LOG_RING_SIZE];
+    int first;
+    int count;
+    unsigned long seq;
+    unsigned long written;
+    long deadline;
+    twheel_timer_t timer;
+    jamlogger_stats_t stats;
+    UT_hash_handle hh;
+} jamlogger_t;
+
+void jdata_init(void *cnode);
+/**
+ * jdata_init() - Prepares the jdata subsystem for @cnode (a cnode_t). Called by cnode_init().
+ */
+
+void jdata_shutdown();
+/**
+ * jdata_shutdown() - Flushes all logger streams and releases loggers and broadcasters
+ */
+
+bool jdata_is_bcast_topic(const char *topic);
+void jdata_bcast_receive(const char *topic, const void *data, int len);
+/**
+ * jdata_bcast_receive() - Publishes a new snapshot for the broadcaster of @topic
+ * @topic: MQTT topic, jdata_is_bcast_topic() must be true
+ * @data:  CBOR encoded value
+ * @len:   length of @data
+ *
+ * Context: MQTT callback thread. Values for unknown broadcasters are ignored.
+ */
+
+void jamdata_log_to_server_int(char *ns, char *name, int value);
+void jamdata_log_to_server_float(char *ns, char *name, float value);
+void jamdata_log_to_server_double(char *ns, char *name, double value);
+void jamdata_log_to_server_string(char *ns, char *name, char *value);
+void jamdata_log_to_server(char *ns, char *name, char *fmt, ...);
+/**
+ * jamdata_log_to_server() - Appends a value to the logger stream @ns/@name
+ * @fmt: for structures, one of 'i', 'f', 'd', 's' per field, followed by
+ *       (field name, value) pairs in the variable arguments
+ *
+ * The value is encoded into the stream buffer, which is published as one batch once
+ * JDATA_LOG_BATCH_SIZE values or JDATA_LOG_BATCH_BYTES bytes are buffered, or when
+ * JDATA_LOG_FLUSH_INTERVAL has passed. While the broker is behind, the batch is held
+ * back and the stream policy kicks in once JDATA_LOG_RING_SIZE values are buffered.
+ *
+ * Context: any thread, takes the stream lock. With JDATA_LOG_BLOCK the calling task
+ *          parks (or the thread blocks) until the broker catches up.
+ */
+
+void jamdata_flush(char *ns, char *name);
+/**
+ * jamdata_flush() - Publishes whatever is buffered for @ns/@name
+ */
+
+void jamdata_log_policy(char *ns, char *name, int policy);
+/**
+ * jamdata_log_policy() - Sets what @ns/@name does with a full ring while the broker is behind
+ * @policy: JDATA_LOG_BLOCK holds the writer back, JDATA_LOG_DROP_OLDEST drops the oldest
+ *          value, JDATA_LOG_DOWNSAMPLE drops every other buffered value
+ */
+
+bool jamdata_log_stats(char *ns, char *name, jamlogger_stats_t *st);
+void jdata_print_stats(FILE *fp);
+/**
+ * jamdata_log_stats() - Copies the counters of @ns/@name into @st
+ *
+ * Return: false if the stream does not exist
+ *
+ * jdata_print_stats() prints the counters of all streams to @fp.
+ */
+
+void jdata_log_resume();
+/**
+ * jdata_log_resume() - Wakes the writers JDATA_LOG_BLOCK holds back once the broker
+ *                      caught up or the connection went away
+ *
+ * Context: MQTT callback thread, after a publish completed or the server disconnected
+ */
+
+void jdata_log_deadline(void *arg);
+/**
+ * jdata_log_deadline() - Flushes a stream whose deadline passed
+ * @arg: the jamlogger_t whose timer expired
+ *
+ * Context: pExecutor, processing the timing wheel
+ */
+
+jambroadcaster_t *jambroadcaster_init(int mode, char *ns, char *name);
+/**
+ * jambroadcaster_init() - Returns the broadcaster @ns/@name, creating it if needed
+ * @mode: BCAST_RETURNS_NEXT waits for a value that was not returned before,
+ *        BCAST_RETURNS_LAST returns the newest value (NULL before the first one)
+ * @ns:   namespace, a ".cbor" suffix marks structured values
+ */
+
+void *get_bcast_next_value(jambroadcaster_t *b);
+/**
+ * get_bcast_next_value() - Reads the broadcaster without locking
+ *
+ * Return: pointer to the value inside its snapshot, to be passed to one of the
+ *         get_bcast_*() casters or jamdata_decode(). Strings can be used directly.
+ *         The snapshot stays valid until the calling task reads @b again or terminates
+ *         (a thread outside of tasks: reads @b again).
+ *
+ * Context: BCAST_RETURNS_NEXT parks the calling task (or blocks the thread, outside of
+ *          tasks) until a new value arrives
+ */
+
+void jdata_release_task(task_t *task);
+/**
+ * jdata_release_task() - Drops the broadcast snapshots @task holds
+ *
+ * Context: executor, when @task terminates or is destroyed
+ */
+
+void jdata_park(tboard_t *t, task_t *task, jdata_park_t *p);
+/**
+ * jdata_park() - Parks @task on @p->wq until @p->ready holds
+ * @p: what @task yielded with
+ *
+ * Context: executor of @task, after it yielded. The task goes back to its ready queue
+ *          right away if @p->ready already holds.
+ */
+
+int get_bcast_int(void *value);
+float get_bcast_float(void *value);
+double get_bcast_double(void *value);
+char *get_bcast_char(void *value);
+/**
+ * get_bcast_int(), get_bcast_float(), get_bcast_double(), get_bcast_char() - Converts a
+ * value returned by get_bcast_next_value() to the C type. NULL gives 0 or NULL.
+ */
+
+void jamdata_decode(char *fmt, void *value, int count, void *dst, ...);
+/**
+ * jamdata_decode() - Copies a structured broadcast value into a C structure
+ * @fmt:   one of 'i', 'f', 'd', 's' per field
+ * @value: value returned by get_bcast_next_value()
+ * @count: number of fields
+ * @dst:   structure to fill in
+ *
+ * The variable arguments are the offsetof() of each field in @dst. Fields are taken in
+ * the order they appear in the value, nested structures flattened. String fields point
+ * into the snapshot.
+ */
+
+#endif
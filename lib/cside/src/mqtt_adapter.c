@@ -8,15 +8,36 @@
 #include "tboard.h"
 #include "cnode.h"
 #include "utilities.h"
+#include "jdata.h"
+
+static void mqtt_process_command(server_t *serv, const void *data, int len)
+{
+    command_view_t v;
+
+    // decode in place, the payload is valid until the callback returns
+    if (command_view_init(&v, data, len))
+        msg_processor_view(serv, &v);
+    else
+        msg_processor(serv, command_from_data(NULL, (void *)data, len));
+}
 
 // XXX: Got the message for the task board
 void mqtt_message_callback(struct mosquitto *mosq, void *udata, const struct mosquitto_message *msg) 
 {
     (void)mosq;
     server_t *serv = (server_t *)udata;
-    if (msg->payloadlen) {
-        command_t *cmd = command_from_data(NULL, msg->payload, msg->payloadlen);
-        msg_processor(serv, cmd);
+    command_batch_t b;
+    const void *item;
+    int len;
+    if (msg->payloadlen && jdata_is_bcast_topic(msg->topic)) {
+        jdata_bcast_receive(msg->topic, msg->payload, msg->payloadlen);
+    } else if (msg->payloadlen && command_batch_init(&b, msg->payload, msg->payloadlen)) {
+        while (command_batch_next(&b, &item, &len))
+            mqtt_process_command(serv, item, len);
+        // the replies to a batch go out as one
+        wire_flush(&(serv->wrep));
+    } else if (msg->payloadlen) {
+        mqtt_process_command(serv, msg->payload, msg->payloadlen);
     } else {
         printf("%s\n", msg->topic);
     }
@@ -51,6 +72,8 @@ void mqtt_disconnect_callback(struct mosquitto *mosq, void *udata, int res)
         destroy_mqtt_adapter(serv->mqtt);
     serv->state = SERVER_UNUSED;
     c->eservnum--;
+    // loggers stop waiting for a broker that is gone
+    jdata_log_resume();
 }
 
 void mqtt_subscribe_callback(struct mosquitto *mosq, void *udata, int mid, int qcnt, const int *qgv) 
@@ -72,12 +95,16 @@ void mqtt_publish_callback(struct mosquitto *mosq, void *udata, int mid)
     (void)mosq;
     server_t *serv = (server_t *)udata;
     struct pub_msg_entry_t *p = NULL;
+    atomic_fetch_sub_explicit(&(serv->mqtt->inflight), 1, memory_order_relaxed);
+    jdata_log_resume();
+    pthread_mutex_lock(&(serv->mqtt->hlock));
     HASH_FIND_INT(serv->mqtt->pmsgs, &mid, p);
-    if (p != NULL) {
-        pthread_mutex_lock(&(serv->mqtt->hlock));
+    if (p != NULL)
         HASH_DEL(serv->mqtt->pmsgs, p);
-        pthread_mutex_unlock(&(serv->mqtt->hlock));
-	    command_free((command_t *)p->ptr);
+    pthread_mutex_unlock(&(serv->mqtt->hlock));
+    if (p != NULL) {
+        // releases the command together with its encoded bytes
+        command_free((command_t *)p->ptr);
         free(p);
     }
 }
@@ -126,6 +153,7 @@ struct mqtt_adapter *create_mqtt_adapter(enum levels level, void *s)
     utarray_new(ma->topics, &ut_str_icd);
     pthread_mutex_init(&(ma->hlock), NULL);
     ma->mid = 0;
+    atomic_init(&(ma->inflight), 0);
     
     return ma;
 }
@@ -176,16 +204,22 @@ void disconnect_mqtt_adapter(struct mqtt_adapter *ma)
 
 void mqtt_publish(struct mqtt_adapter *ma, char *topic, void *msg, int msglen, void *udata, int qos)
 {
+    int rc;
     ma->mid++;
+    // dropped again by the publish callback, jdata loggers back off when this grows
+    atomic_fetch_add_explicit(&(ma->inflight), 1, memory_order_relaxed);
     if (udata != NULL) {
         command_t *p = (command_t *)udata;
-        mosquitto_publish(ma->mosq, &(ma->mid), topic, msglen, msg, qos, 0);	
-        struct pub_msg_entry_t *pentry = create_pub_msg_entry(ma->mid, p);
+        int mid;    // several threads publish, keep the id mosquitto assigned to this message
+        rc = mosquitto_publish(ma->mosq, &mid, topic, msglen, msg, qos, 0);	
+        struct pub_msg_entry_t *pentry = create_pub_msg_entry(mid, p);
         pthread_mutex_lock(&(ma->hlock));
         HASH_ADD_INT(ma->pmsgs, id, pentry);
         pthread_mutex_unlock(&(ma->hlock));
     } else
-	    mosquitto_publish(ma->mosq, &(ma->mid), topic, msglen, msg, qos, 0);	
+	    rc = mosquitto_publish(ma->mosq, &(ma->mid), topic, msglen, msg, qos, 0);	
+    if (rc != MOSQ_ERR_SUCCESS)     // no callback is coming for this one
+        atomic_fetch_sub_explicit(&(ma->inflight), 1, memory_order_relaxed);
 }
 
 void mqtt_post_subscription(struct mqtt_adapter *ma, char *topic) 
@@ -6,6 +6,7 @@
 
 #include <mosquitto.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "uthash.h"
 #include "utarray.h"
 
@@ -37,6 +38,7 @@ typedef struct mqtt_adapter {
     struct mosquitto *mosq;
     struct pub_msg_entry_t *pmsgs;
     pthread_mutex_t hlock;
+    atomic_int inflight;        // published, not yet handed over by mosquitto
     UT_array *topics;
 } mqtt_adapter_t;
 
@@ -34,9 +34,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 nvoid_t *nvoid_new(void *data, int len)
 {
-    nvoid_t *nv = (nvoid_t *)malloc(sizeof(len) + len);
+    // the data is stored right behind the header, so nvoid_free() is a single free()
+    nvoid_t *nv = (nvoid_t *)malloc(sizeof(nvoid_t) + len);
     assert(nv != NULL);
     nv->len = len;
+    nv->data = (void *)(nv + 1);
     memcpy(nv->data, data, len);
     return nv;
 }
@@ -89,24 +89,189 @@ void exec_sync(context_t ctx)
                 break;
             default:;
             }
-            mqtt_publish(s->mqtt, c->topics->replytopic, cmd->buffer, cmd->length, cmd, 0);
+            if (cmd != NULL) {
+                // a retransmitted REXEC gets this one replayed
+                icache_complete(c->icache, task_id, node_id, cmd);
+                wire_send(&(s->wrep), cmd);
+                return;
+            }
         }
     }
+    // failed, a retry runs the call again
+    icache_drop(c->icache, task_id, node_id);
 }
 
 function_t esync = TBOARD_FUNC("exec_sync", exec_sync, "nnn", "", PRI_BATCH_TASK);
 
+void processor_init(tboard_t *t)
+{
+    esync.hist = history_get(t, esync.fn_name);
+}
+
+
+// true if the REXEC was seen before and got its answer: another ACK while the call
+// is running, the stored REXEC_RES once it completed
+static bool rexec_replayed(server_t *s, long int task_id, char *node_id, int subcmd)
+{
+    cnode_t *c = s->cnode;
+    command_t *res;
+
+    switch (icache_claim(c->icache, task_id, node_id, &res)) {
+    case ICACHE_RUNNING:
+        send_ack_msg(s, node_id, task_id, ((subcmd == 0) ? 0: globals_Timeout_REXEC_ACK_TIMEOUT));
+        return true;
+    case ICACHE_DONE:
+        if (res != NULL)
+            wire_send(&(s->wrep), res);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 0 if a call of @f may create a task, the retry-after hint of its NAK otherwise
+static int rexec_admit(tboard_t *t, function_t *f)
+{
+    uint64_t cost = f->hist != NULL ? atomic_load_explicit(&(f->hist->cost), memory_order_relaxed) : 0;
+    bool batch = f->tasktype != PRI_SYNC_TASK && f->tasktype != PRI_REAL_TASK;
+
+    return admit_check(&(t->admit), tboard_get_concurrent(t), t->sqs + 1, cost, batch);
+}
+
+// the task of an acknowledged REXEC could not be created after all: forget the call so
+// that it is not acknowledged forever, and have the caller come back later
+static void rexec_failed(server_t *s, long int task_id, char *node_id)
+{
+    cnode_t *c = s->cnode;
+
+    icache_drop(c->icache, task_id, node_id);
+    send_busy_msg(s, node_id, task_id, ADMIT_RETRY_MIN_MS);
+}
 
 void execute_cmd(server_t *s, function_t *f, command_t *cmd)
 {
     cnode_t *c = s->cnode;
     tboard_t *t = (tboard_t *)(c->tboard);
 
-    if (cmd->subcmd == 0)
-        task_create(t, *f, cmd->args, cmd); // no return value
-    else {
+    if (cmd->subcmd == 0) {
+        // task_create() frees the command if it fails, we still need its ids then
+        command_hold(cmd);
+        if (!task_create(t, *f, cmd->args, cmd))
+            rexec_failed(s, cmd->task_id, cmd->node_id);
+        command_free(cmd);
+    } else {
         arg_t *a = command_arg_clone_special(cmd->args, cmd->fn_name, cmd->task_id, cmd->node_id, s);
-        task_create(t, esync, a, NULL);
+        if (!task_create(t, esync, a, NULL)) {
+            rexec_failed(s, cmd->task_id, cmd->node_id);
+            // the other args are the command's
+            int n = a[0].nargs;
+            free(a[n - 4].val.sval);
+            free(a[n - 2].val.sval);
+            free(a);
+            command_free(cmd);
+        }
+    }
+}
+
+void execute_view(server_t *s, function_t *f, command_view_t *v, char *fn_name, char *node_id)
+{
+    cnode_t *c = s->cnode;
+    tboard_t *t = (tboard_t *)(c->tboard);
+
+    if (v->subcmd == 0) {
+        // the task holds on to the command (and its args) until it completes
+        command_t *cmd = command_from_view(v);
+        if (!task_create(t, *f, cmd->args, cmd))
+            rexec_failed(s, v->task_id, node_id);
+    } else {
+        // same layout as command_arg_clone_special(), without the intermediate command
+        arg_t *a = command_view_args(v, 4);
+        int n = a[0].nargs;
+        a[n - 4].type = STRING_TYPE;
+        a[n - 4].val.sval = strdup(fn_name);
+        a[n - 3].type = LONG_TYPE;
+        a[n - 3].val.lval = v->task_id;
+        a[n - 2].type = STRING_TYPE;
+        a[n - 2].val.sval = strdup(node_id);
+        a[n - 1].type = VOID_TYPE;
+        a[n - 1].val.vval = s;
+        if (!task_create(t, esync, a, NULL)) {
+            rexec_failed(s, v->task_id, node_id);
+            command_args_free(a);
+        }
+    }
+}
+
+void msg_processor_view(void *serv, command_view_t *v)
+{
+    function_t *f;
+    server_t *s = (server_t *)serv;
+    cnode_t *c = s->cnode;
+    tboard_t *t = (tboard_t *)(c->tboard);
+    internal_command_t *ic;
+    command_t *res;
+    int retry;
+    char fn_name[SMALL_CMD_STR_LEN];
+    char node_id[LARGE_CMD_STR_LEN];
+
+    switch (v->cmd)
+    {
+    case CmdNames_REXEC:
+        command_view_copy_str(fn_name, v->fn_name, v->fn_name_len, SMALL_CMD_STR_LEN);
+        command_view_copy_str(node_id, v->node_id, v->node_id_len, LARGE_CMD_STR_LEN);
+        f = tboard_find_func(t, fn_name);
+        if (f == NULL) {
+            send_err_msg(s, node_id, v->task_id);
+            return;
+        } else if (rexec_replayed(s, v->task_id, node_id, v->subcmd)) {
+            return;
+        } else if (jcond_evaluate(f->cond) != true) {
+            icache_drop(c->icache, v->task_id, node_id);
+            send_nak_msg(s, node_id, v->task_id);
+            return;
+        } else if ((retry = rexec_admit(t, f)) > 0) {
+            icache_drop(c->icache, v->task_id, node_id);
+            send_busy_msg(s, node_id, v->task_id, retry);
+            return;
+        } else
+            send_ack_msg(s, node_id, v->task_id, ((v->subcmd == 0) ? 0: globals_Timeout_REXEC_ACK_TIMEOUT));
+
+        // only now that a task keeps them, the args are decoded
+        execute_view(s, f, v, fn_name, node_id);
+        return;
+
+    case CmdNames_GET_REXEC_RES:
+        // the caller asks for the result of a call it already had acknowledged
+        command_view_copy_str(node_id, v->node_id, v->node_id_len, LARGE_CMD_STR_LEN);
+        switch (icache_find(c->icache, v->task_id, node_id, &res)) {
+        case ICACHE_RUNNING:
+            send_ack_msg(s, node_id, v->task_id, globals_Timeout_REXEC_ACK_TIMEOUT);
+            return;
+        case ICACHE_DONE:
+            if (res != NULL)
+                wire_send(&(s->wrep), res);
+            return;
+        default:
+            send_err_msg(s, node_id, v->task_id);
+            return;
+        }
+
+    case CmdNames_REXEC_ACK:
+    case CmdNames_REXEC_RES:
+    case CmdNames_REXEC_ERR:
+        // duplicates (ALL_LEVELS) and late replies have nobody waiting for them
+        if (rtable_find(t->task_table, v->task_id) == NULL)
+            return;
+        ic = internal_command_from_view(v);
+        ic->serv = s;
+        taskq_push(&(t->iq), ic);
+        tboard_wake_primary(t);
+        return;
+
+    default:
+        // the rest is infrequent control traffic, go through a full command
+        msg_processor(serv, command_from_view(v));
+        return;
     }
 }
 
@@ -118,13 +283,15 @@ void msg_processor(void *serv, command_t *cmd)
     cnode_t *c = s->cnode;
     tboard_t *t = (tboard_t *)(c->tboard);
     command_t *rcmd;
-    int k;
-    struct queue_entry *e = NULL;
+    int k, retry;
+    sched_t sched;
     internal_command_t *ic;
     // when a message is received, it interprets message and adds to respective queue
     switch (cmd->cmd)
     {
     case CmdNames_REGISTER_ACK:
+        // what we offered in REGISTER and the server speaks, older servers echo a 0
+        s->caps = cmd->subcmd & WIRE_CAPS;
         // if the node is not registered, then change the state to registered
         if (c->cnstate == CNODE_NOT_REGISTERED) {
             c->cnstate = CNODE_REGISTERED;
@@ -213,8 +380,20 @@ void msg_processor(void *serv, command_t *cmd)
             // send REXEC_ERR to the controller that sent the request
             command_free(cmd);
             return;
+        } else if (rexec_replayed(s, cmd->task_id, cmd->node_id, cmd->subcmd)) {
+            command_free(cmd);
+            return;
         } else if (jcond_evaluate(f->cond) != true) {
+            icache_drop(c->icache, cmd->task_id, cmd->node_id);
             send_nak_msg(s, cmd->node_id, cmd->task_id);
+            command_free(cmd);
+            return;
+        } else if ((retry = rexec_admit(t, f)) > 0) {
+            // overloaded, tell the caller when to come back instead of acking a task
+            // we may not be able to create
+            icache_drop(c->icache, cmd->task_id, cmd->node_id);
+            send_busy_msg(s, cmd->node_id, cmd->task_id, retry);
+            command_free(cmd);
             return;
         } else 
             // send the REXEC_ACK to the controller that sent the request
@@ -227,11 +406,14 @@ void msg_processor(void *serv, command_t *cmd)
     case CmdNames_REXEC_ACK:
     case CmdNames_REXEC_RES:
     case CmdNames_REXEC_ERR:
+        if (rtable_find(t->task_table, cmd->task_id) == NULL) {
+            command_free(cmd);
+            return;
+        }
         ic = internal_command_new(cmd);
-        e = queue_new_node(ic);
-        pthread_mutex_lock(&t->iqmutex);
-        queue_insert_tail(&(t->iq), e);
-        pthread_mutex_unlock(&t->iqmutex);
+        ic->serv = s;
+        taskq_push(&(t->iq), ic);
+        tboard_wake_primary(t);
         command_free(cmd);
         return;
 
@@ -241,21 +423,22 @@ void msg_processor(void *serv, command_t *cmd)
 
     case CmdNames_PUT_SCHEDULE: 
         k = 0;
-        pthread_mutex_lock(&t->schmutex);
-        t->sched.len = cmd->args[k].val.lval;
+        sched.len = cmd->args[k].val.lval;
         k++;
-        t->sched.rtslots = cmd->args[k].val.ival;
-        for (int i  = 0; i < t->sched.rtslots; i++) {
+        sched.rtslots = cmd->args[k].val.ival;
+        for (int i  = 0; i < sched.rtslots && i < MAX_RT_SLOTS; i++) {
             k++;
-            t->sched.rtstarts[i] = cmd->args[k].val.ival;
+            sched.rtstarts[i] = cmd->args[k].val.ival;
         }
         k++;
-        t->sched.syslots = cmd->args[k].val.ival;
-        for (int i  = 0; i < t->sched.syslots; i++) {
+        sched.syslots = cmd->args[k].val.ival;
+        for (int i  = 0; i < sched.syslots && i < MAX_SY_SLOTS; i++) {
             k++;
-            t->sched.systarts[i] = cmd->args[k].val.ival;
+            sched.systarts[i] = cmd->args[k].val.ival;
         }
-        pthread_mutex_unlock(&t->schmutex);
+        // compiled here, the pExecutor switches to it at the end of its epoch
+        if (!tboard_put_schedule(t, &sched))
+            tboard_err("msg_processor: Invalid schedule received\n");
         command_free(cmd);
         return;
     default:
@@ -275,31 +458,36 @@ void send_close_msg(void *serv, char *node_id, long int task_id)
 void send_err_msg(void *serv, char *node_id, long int task_id)
 {
     server_t *s = (server_t *)serv;
-    cnode_t *c = s->cnode;
     command_t *cmd = command_new(CmdNames_REXEC_ERR, 0, "", task_id, node_id, "i", CmdNames_FUNC_NOT_FOUND);
-    mqtt_publish(s->mqtt, c->topics->replytopic, cmd->buffer, cmd->length, cmd, 0);
+    wire_send(&(s->wrep), cmd);
 }
 
 void send_ack_msg(void *serv, char *node_id, long int task_id, int timeout)
 {
     server_t *s = (server_t *)serv;
-    cnode_t *c = s->cnode;
     command_t *cmd = command_new(CmdNames_REXEC_ACK, 0, "", task_id, node_id, "i", timeout);
-    mqtt_publish(s->mqtt, c->topics->replytopic, cmd->buffer, cmd->length, cmd, 0);
+    wire_send(&(s->wrep), cmd);
 }
 
 void send_nak_msg(void *serv, char *node_id, long int task_id)
 {
     server_t *s = (server_t *)serv;
-    cnode_t *c = s->cnode;
     command_t *cmd = command_new(CmdNames_REXEC_NAK, 0, "", task_id, node_id, "i", CmdNames_COND_FALSE);
-    mqtt_publish(s->mqtt, c->topics->replytopic, cmd->buffer, cmd->length, cmd, 0);
+    wire_send(&(s->wrep), cmd);
+}
+
+void send_busy_msg(void *serv, char *node_id, long int task_id, int retry_ms)
+{
+    server_t *s = (server_t *)serv;
+    command_t *cmd = command_new(CmdNames_REXEC_NAK, 0, "", task_id, node_id, "ii", CmdNames_OVERLOAD, retry_ms);
+    wire_send(&(s->wrep), cmd);
 }
 
 void send_reg_msg(void *serv, char *node_id, long int task_id) 
 {
     server_t *s = (server_t *)serv;
     cnode_t *c = s->cnode;
-    command_t *cmd = command_new(CmdNames_REGISTER, 0, "", task_id, node_id, "");
+    // offers the capabilities of this node, the REGISTER_ACK says which were taken
+    command_t *cmd = command_new(CmdNames_REGISTER, 0, "", task_id, node_id, "i", WIRE_CAPS);
     mqtt_publish(s->mqtt, c->topics->requesttopic, cmd->buffer, cmd->length, cmd, 0);
 }
\ No newline at end of file
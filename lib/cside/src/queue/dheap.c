@@ -0,0 +1,83 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "dheap.h"
+
+static inline bool dheap_less(dheap_entry_t *x, dheap_entry_t *y)
+{
+    return x->key < y->key || (x->key == y->key && x->seq < y->seq);
+}
+
+bool dheap_init(dheap_t *h, size_t capacity)
+{
+    h->cap = capacity > 0 ? capacity : 1;
+    h->n = 0;
+    h->seq = 0;
+    h->a = (dheap_entry_t *)malloc(h->cap * sizeof(dheap_entry_t));
+    return h->a != NULL;
+}
+
+void dheap_destroy(dheap_t *h)
+{
+    free(h->a);
+    h->a = NULL;
+    h->n = h->cap = 0;
+}
+
+bool dheap_push(dheap_t *h, uint64_t key, void *data)
+{
+    dheap_entry_t e = {.key = key, .seq = h->seq++, .data = data};
+    size_t i, p;
+
+    if (h->n == h->cap) {
+        dheap_entry_t *a = (dheap_entry_t *)realloc(h->a, 2 * h->cap * sizeof(dheap_entry_t));
+        if (a == NULL)
+            return false;
+        h->a = a;
+        h->cap *= 2;
+    }
+    // sift up
+    for (i = h->n++; i > 0; i = p) {
+        p = (i - 1) / 2;
+        if (!dheap_less(&e, &(h->a[p])))
+            break;
+        h->a[i] = h->a[p];
+    }
+    h->a[i] = e;
+    return true;
+}
+
+void *dheap_pop(dheap_t *h)
+{
+    dheap_entry_t last;
+    void *data;
+    size_t i, c;
+
+    if (h->n == 0)
+        return NULL;
+    data = h->a[0].data;
+    last = h->a[--h->n];
+    // sift the last entry down from the root
+    for (i = 0; (c = 2 * i + 1) < h->n; i = c) {
+        if (c + 1 < h->n && dheap_less(&(h->a[c + 1]), &(h->a[c])))
+            c++;
+        if (!dheap_less(&(h->a[c]), &last))
+            break;
+        h->a[i] = h->a[c];
+    }
+    h->a[i] = last;
+    return data;
+}
+
+void *dheap_peek(dheap_t *h, uint64_t *key)
+{
+    if (h->n == 0)
+        return NULL;
+    if (key != NULL)
+        *key = h->a[0].key;
+    return h->a[0].data;
+}
+
+size_t dheap_size(dheap_t *h)
+{
+    return h->n;
+}
@@ -0,0 +1,34 @@
+#ifndef __DHEAP_H__
+#define __DHEAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary min-heap of pointers ordered by a 64-bit key (a deadline), entries with
+ * equal keys come out in insertion order. It is owned by a single thread and takes
+ * no lock. The array doubles when it fills up.
+ */
+typedef struct dheap_entry {
+    uint64_t key;
+    uint64_t seq;
+    void *data;
+} dheap_entry_t;
+
+typedef struct dheap {
+    dheap_entry_t *a;
+    size_t n;
+    size_t cap;
+    uint64_t seq;
+} dheap_t;
+
+bool dheap_init(dheap_t *h, size_t capacity);
+void dheap_destroy(dheap_t *h);
+
+bool dheap_push(dheap_t *h, uint64_t key, void *data);
+void *dheap_pop(dheap_t *h);
+void *dheap_peek(dheap_t *h, uint64_t *key);
+size_t dheap_size(dheap_t *h);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "mpmc.h"
+
+bool mpmc_queue_init(mpmc_queue_t *q, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    q->cells = (struct mpmc_cell *)malloc(size * sizeof(struct mpmc_cell));
+    if (q->cells == NULL)
+        return false;
+    for (size_t i = 0; i < size; i++)
+        atomic_store_explicit(&(q->cells[i].seq), i, memory_order_relaxed);
+    q->mask = size - 1;
+    atomic_store_explicit(&(q->enqueue_pos), 0, memory_order_relaxed);
+    atomic_store_explicit(&(q->dequeue_pos), 0, memory_order_relaxed);
+    return true;
+}
+
+void mpmc_queue_destroy(mpmc_queue_t *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+}
+
+bool mpmc_enqueue(mpmc_queue_t *q, void *data)
+{
+    struct mpmc_cell *cell;
+    size_t pos = atomic_load_explicit(&(q->enqueue_pos), memory_order_relaxed);
+
+    for (;;) {
+        cell = &(q->cells[pos & q->mask]);
+        size_t seq = atomic_load_explicit(&(cell->seq), memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            // cell is free for this lap, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&(q->enqueue_pos), &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0)
+            return false;   // full
+        else
+            pos = atomic_load_explicit(&(q->enqueue_pos), memory_order_relaxed);
+    }
+    cell->data = data;
+    atomic_store_explicit(&(cell->seq), pos + 1, memory_order_release);
+    return true;
+}
+
+void *mpmc_dequeue(mpmc_queue_t *q)
+{
+    struct mpmc_cell *cell;
+    void *data;
+    size_t pos = atomic_load_explicit(&(q->dequeue_pos), memory_order_relaxed);
+
+    for (;;) {
+        cell = &(q->cells[pos & q->mask]);
+        size_t seq = atomic_load_explicit(&(cell->seq), memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            // cell holds data for this lap, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&(q->dequeue_pos), &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0)
+            return NULL;    // empty
+        else
+            pos = atomic_load_explicit(&(q->dequeue_pos), memory_order_relaxed);
+    }
+    data = cell->data;
+    // release the cell for the producers of the next lap
+    atomic_store_explicit(&(cell->seq), pos + q->mask + 1, memory_order_release);
+    return data;
+}
+
+size_t mpmc_queue_size(mpmc_queue_t *q)
+{
+    size_t head = atomic_load_explicit(&(q->dequeue_pos), memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&(q->enqueue_pos), memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
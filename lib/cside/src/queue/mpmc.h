@@ -0,0 +1,39 @@
+#ifndef __MPMC_H__
+#define __MPMC_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MPMC_CACHELINE 64
+
+/*
+ * Bounded multi-producer/multi-consumer ring buffer (D. Vyukov's design).
+ * Each cell carries a sequence number that tells producers and consumers
+ * whether the cell is free for the current lap, so neither side takes a lock
+ * and no per-element node is allocated. The capacity is rounded up to a power
+ * of two.
+ */
+struct mpmc_cell {
+    atomic_size_t seq;
+    void *data;
+};
+
+typedef struct mpmc_queue {
+    struct mpmc_cell *cells;
+    size_t mask;
+    char pad0[MPMC_CACHELINE];
+    atomic_size_t enqueue_pos;
+    char pad1[MPMC_CACHELINE - sizeof(atomic_size_t)];
+    atomic_size_t dequeue_pos;
+    char pad2[MPMC_CACHELINE - sizeof(atomic_size_t)];
+} mpmc_queue_t;
+
+bool mpmc_queue_init(mpmc_queue_t *q, size_t capacity);
+void mpmc_queue_destroy(mpmc_queue_t *q);
+
+bool mpmc_enqueue(mpmc_queue_t *q, void *data);
+void *mpmc_dequeue(mpmc_queue_t *q);
+size_t mpmc_queue_size(mpmc_queue_t *q);
+
+#endif
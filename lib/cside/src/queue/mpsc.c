@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <stdatomic.h>
+#include "mpsc.h"
+
+void mpsc_init(mpsc_t *q)
+{
+    atomic_store_explicit(&(q->stub.next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(q->head), &(q->stub), memory_order_relaxed);
+    q->tail = &(q->stub);
+}
+
+void mpsc_push(mpsc_t *q, mpsc_node_t *n)
+{
+    mpsc_node_t *prev;
+
+    atomic_store_explicit(&(n->next), NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&(q->head), n, memory_order_acq_rel);
+    // between these two lines the consumer cannot get past prev
+    atomic_store_explicit(&(prev->next), n, memory_order_release);
+}
+
+mpsc_node_t *mpsc_pop(mpsc_t *q)
+{
+    mpsc_node_t *tail = q->tail;
+    mpsc_node_t *next = atomic_load_explicit(&(tail->next), memory_order_acquire);
+
+    if (tail == &(q->stub)) {
+        if (next == NULL)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&(next->next), memory_order_acquire);
+    }
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&(q->head), memory_order_acquire))
+        return NULL;                // a push is in progress
+    // tail is the last node, put the stub behind it so it can be handed out
+    mpsc_push(q, &(q->stub));
+    next = atomic_load_explicit(&(tail->next), memory_order_acquire);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
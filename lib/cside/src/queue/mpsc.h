@@ -0,0 +1,31 @@
+#ifndef __MPSC_H__
+#define __MPSC_H__
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Intrusive unbounded MPSC queue (Vyukov). Producers link a node embedded in their
+ * own object with one atomic exchange, nothing is allocated. The single consumer
+ * pops without atomic read-modify-writes. A producer preempted halfway through a
+ * push hides the nodes queued after its own until it resumes, the consumer then
+ * sees an empty queue and comes back later.
+ */
+typedef struct mpsc_node {
+    _Atomic(struct mpsc_node *) next;
+} mpsc_node_t;
+
+typedef struct mpsc {
+    _Atomic(mpsc_node_t *) head;    // producers push here
+    char pad[64 - sizeof(void *)];
+    mpsc_node_t *tail;              // consumer only
+    mpsc_node_t stub;
+} mpsc_t;
+
+void mpsc_init(mpsc_t *q);
+void mpsc_push(mpsc_t *q, mpsc_node_t *n);     // any thread
+mpsc_node_t *mpsc_pop(mpsc_t *q);              // consumer only
+
+#define mpsc_entry(ptr, type, member)   ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#endif
@@ -0,0 +1,73 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "taskq.h"
+
+void taskq_init(taskq_t *q, int type, pthread_mutex_t *lock, size_t capacity)
+{
+    q->type = type;
+    q->lock = lock;
+    queue_init(&(q->list));
+    atomic_init(&(q->spilled), 0);
+    if (type == TASKQ_LOCKFREE && !mpmc_queue_init(&(q->ring), capacity))
+        queue_error();
+}
+
+void taskq_destroy(taskq_t *q)
+{
+    struct queue_entry *e;
+
+    if (q->type == TASKQ_LOCKFREE)
+        mpmc_queue_destroy(&(q->ring));
+    while ((e = queue_pop_head(&(q->list))) != NULL)
+        free(e);
+}
+
+void taskq_push(taskq_t *q, void *data)
+{
+    struct queue_entry *e;
+
+    if (q->type == TASKQ_LOCKFREE && mpmc_enqueue(&(q->ring), data))
+        return;
+    e = queue_new_node(data);
+    pthread_mutex_lock(q->lock);
+    queue_insert_tail(&(q->list), e);
+    if (q->type == TASKQ_LOCKFREE)
+        atomic_fetch_add(&(q->spilled), 1);
+    pthread_mutex_unlock(q->lock);
+}
+
+void *taskq_pop(taskq_t *q)
+{
+    struct queue_entry *e;
+    void *data = NULL;
+
+    if (q->type == TASKQ_LOCKFREE) {
+        if ((data = mpmc_dequeue(&(q->ring))) != NULL || atomic_load(&(q->spilled)) == 0)
+            return data;
+    }
+
+    pthread_mutex_lock(q->lock);
+    e = queue_pop_head(&(q->list));
+    if (e != NULL && q->type == TASKQ_LOCKFREE)
+        atomic_fetch_sub(&(q->spilled), 1);
+    pthread_mutex_unlock(q->lock);
+    if (e != NULL) {
+        data = e->data;
+        free(e);
+    }
+    return data;
+}
+
+bool taskq_empty(taskq_t *q)
+{
+    bool empty;
+
+    if (q->type == TASKQ_LOCKFREE)
+        return mpmc_queue_size(&(q->ring)) == 0 && atomic_load(&(q->spilled)) == 0;
+
+    pthread_mutex_lock(q->lock);
+    empty = (queue_peek_front(&(q->list)) == NULL);
+    pthread_mutex_unlock(q->lock);
+    return empty;
+}
@@ -0,0 +1,45 @@
+#ifndef __TASKQ_H__
+#define __TASKQ_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "queue.h"
+#include "mpmc.h"
+
+/*
+ * Ready queue used by the task board. It holds pointers (task_t *, internal_command_t *)
+ * and comes in two flavours that are selected when the task board is created:
+ *
+ * TASKQ_LOCKED:   the original sys/queue.h STAILQ guarded by a mutex that can be
+ *                 shared among several queues. Every insert allocates a queue_entry.
+ * TASKQ_LOCKFREE: a bounded MPMC ring (mpmc.h) that stores the pointers directly.
+ *                 Producers and consumers never take a lock and nothing is allocated
+ *                 per insert as long as the ring has room. A push into a full ring
+ *                 spills into the STAILQ under the lock instead of waiting for a
+ *                 consumer, which may be the pushing thread itself (the pExecutor
+ *                 posts to the internal queue it drains). Spilled entries are popped
+ *                 once the ring is empty, so the order is FIFO only while nothing
+ *                 spills.
+ */
+enum taskq_types_t {
+    TASKQ_LOCKED = 0,
+    TASKQ_LOCKFREE = 1
+};
+
+typedef struct taskq {
+    int type;
+    pthread_mutex_t *lock;
+    struct queue list;
+    mpmc_queue_t ring;
+    atomic_int spilled;
+} taskq_t;
+
+void taskq_init(taskq_t *q, int type, pthread_mutex_t *lock, size_t capacity);
+void taskq_destroy(taskq_t *q);
+void taskq_push(taskq_t *q, void *data);
+void *taskq_pop(taskq_t *q);
+bool taskq_empty(taskq_t *q);
+
+#endif
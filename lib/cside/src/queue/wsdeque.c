@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "wsdeque.h"
+
+bool wsdeque_init(wsdeque_t *d, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    d->buf = calloc(size, sizeof(void *));
+    if (d->buf == NULL)
+        return false;
+    d->mask = (long)size - 1;
+    atomic_store_explicit(&(d->top), 0, memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), 0, memory_order_relaxed);
+    return true;
+}
+
+void wsdeque_destroy(wsdeque_t *d)
+{
+    free(d->buf);
+    d->buf = NULL;
+}
+
+bool wsdeque_push(wsdeque_t *d, void *data)
+{
+    long b = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    long t = atomic_load_explicit(&(d->top), memory_order_acquire);
+
+    if (b - t > d->mask)
+        return false;   // full
+    atomic_store_explicit(&(d->buf[b & d->mask]), data, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&(d->bottom), b + 1, memory_order_relaxed);
+    return true;
+}
+
+void *wsdeque_pop(wsdeque_t *d)
+{
+    void *data = NULL;
+    long b = atomic_load_explicit(&(d->bottom), memory_order_relaxed) - 1;
+    long t;
+
+    atomic_store_explicit(&(d->bottom), b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&(d->top), memory_order_relaxed);
+    if (t <= b) {
+        data = atomic_load_explicit(&(d->buf[b & d->mask]), memory_order_relaxed);
+        if (t == b) {
+            // last element, race against the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&(d->top), &t, t + 1,
+                                                         memory_order_seq_cst, memory_order_relaxed))
+                data = NULL;
+            atomic_store_explicit(&(d->bottom), b + 1, memory_order_relaxed);
+        }
+    } else // empty
+        atomic_store_explicit(&(d->bottom), b + 1, memory_order_relaxed);
+    return data;
+}
+
+void *wsdeque_steal(wsdeque_t *d)
+{
+    void *data = NULL;
+    long t = atomic_load_explicit(&(d->top), memory_order_acquire);
+    long b;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&(d->bottom), memory_order_acquire);
+    if (t < b) {
+        data = atomic_load_explicit(&(d->buf[t & d->mask]), memory_order_relaxed);
+        // lost the race to the owner or another thief
+        if (!atomic_compare_exchange_strong_explicit(&(d->top), &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            return NULL;
+    }
+    return data;
+}
+
+bool wsdeque_empty(wsdeque_t *d)
+{
+    long b = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    long t = atomic_load_explicit(&(d->top), memory_order_relaxed);
+    return b <= t;
+}
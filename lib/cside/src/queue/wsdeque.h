@@ -0,0 +1,32 @@
+#ifndef __WSDEQUE_H__
+#define __WSDEQUE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Bounded work-stealing deque (Chase-Lev, with the C11 orderings from Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models"). The owning thread
+ * pushes and pops at the bottom, any other thread may steal from the top. Neither
+ * side takes a lock. The capacity is rounded up to a power of two and push fails
+ * when the deque is full.
+ */
+typedef struct wsdeque {
+    atomic_long top;
+    char pad0[64 - sizeof(atomic_long)];
+    atomic_long bottom;
+    char pad1[64 - sizeof(atomic_long)];
+    _Atomic(void *) *buf;
+    long mask;
+} wsdeque_t;
+
+bool wsdeque_init(wsdeque_t *d, size_t capacity);
+void wsdeque_destroy(wsdeque_t *d);
+
+bool wsdeque_push(wsdeque_t *d, void *data);    // owner only
+void *wsdeque_pop(wsdeque_t *d);                // owner only
+void *wsdeque_steal(wsdeque_t *d);              // any thread
+bool wsdeque_empty(wsdeque_t *d);
+
+#endif
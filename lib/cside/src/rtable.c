@@ -0,0 +1,158 @@
+/*
+ * Table of the remote tasks waiting for an acknowledgement or a result. Task ids
+ * are 64-bit snowflakes whose low bits are a per-node sequence, so the full key is
+ * mixed before it picks a slot. The executors insert and resolve remote tasks and the
+ * MQTT threads check replies against the table, all without a lock.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include "tboard.h"
+#include "rtable.h"
+
+#define RTABLE_MASK                 (RTABLE_SIZE - 1)
+
+_Static_assert(RTABLE_SIZE >= 2 * MAX_TASKS, "RTABLE_SIZE must be at least twice MAX_TASKS");
+_Static_assert((RTABLE_SIZE & RTABLE_MASK) == 0, "RTABLE_SIZE must be a power of two");
+
+// murmur3 finalizer, all 64 bits of the key end up in the slot index
+static inline unsigned long rtable_hash(long int key)
+{
+    uint64_t x = (uint64_t)key;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+rtable_t *rtable_create()
+{
+    // all slots start out as RTABLE_EMPTY
+    rtable_t *r = (rtable_t *)calloc(1, sizeof(rtable_t));
+    assert(r != NULL);
+    return r;
+}
+
+void rtable_destroy(rtable_t *r)
+{
+    if (r == NULL)
+        return;
+    for (int i = 0; i < RTABLE_SIZE; i++)
+        free(atomic_load(&(r->slots[i].rtask)));
+    free(r);
+}
+
+bool rtable_insert(rtable_t *r, long int key, struct remote_task_t *rtask)
+{
+    unsigned long h = rtable_hash(key);
+    rtable_slot_t *s;
+    long int k;
+
+    assert(key != RTABLE_EMPTY && key != RTABLE_DELETED && key != RTABLE_CLAIMED);
+    atomic_fetch_add(&(r->inserts), 1);
+    for (int i = 0; i < RTABLE_MAX_PROBE; i++) {
+        s = &(r->slots[(h + i) & RTABLE_MASK]);
+        k = atomic_load(&(s->key));
+        // a tombstone that was cleared under us is still free
+        while ((k == RTABLE_EMPTY || k == RTABLE_DELETED) &&
+               !atomic_compare_exchange_weak(&(s->key), &k, RTABLE_CLAIMED))
+            ;
+        if (k == RTABLE_EMPTY || k == RTABLE_DELETED) {
+            // the task is there before a lookup can match the key
+            atomic_store_explicit(&(s->rtask), rtask, memory_order_relaxed);
+            atomic_store_explicit(&(s->key), key, memory_order_release);
+            atomic_fetch_sub(&(r->inserts), 1);
+            atomic_fetch_add_explicit(&(r->count), 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    atomic_fetch_sub(&(r->inserts), 1);
+    atomic_fetch_add_explicit(&(r->full), 1, memory_order_relaxed);
+    return false;
+}
+
+struct remote_task_t *rtable_find(rtable_t *r, long int key)
+{
+    unsigned long h = rtable_hash(key);
+    rtable_slot_t *s;
+    long int k;
+
+    for (int i = 0; i < RTABLE_MAX_PROBE; i++) {
+        s = &(r->slots[(h + i) & RTABLE_MASK]);
+        k = atomic_load_explicit(&(s->key), memory_order_acquire);
+        if (k == key)
+            return atomic_load_explicit(&(s->rtask), memory_order_acquire);
+        if (k == RTABLE_EMPTY)      // keys are never moved, nothing further along
+            break;
+    }
+    return NULL;
+}
+
+/*
+ * Empties the tombstones that end a probe chain at @i. An insert that read one of
+ * them while it was live may still claim the slot after it, so each is only cleared
+ * while no insert is probing: the tombstone was seen before @inserts, the empty slot
+ * after it, in that order.
+ */
+static void rtable_trim(rtable_t *r, unsigned long i)
+{
+    rtable_slot_t *s;
+    long int k;
+
+    // a chain running through a slot continues in the next one, so none ends in an
+    // empty slot: the tombstones right before one are in no chain
+    for (int n = 0; n < RTABLE_SIZE; n++, i--) {
+        s = &(r->slots[i & RTABLE_MASK]);
+        k = RTABLE_DELETED;
+        if (atomic_load(&(s->key)) != RTABLE_DELETED || atomic_load(&(r->inserts)) != 0 ||
+            atomic_load(&(r->slots[(i + 1) & RTABLE_MASK].key)) != RTABLE_EMPTY ||
+            !atomic_compare_exchange_strong(&(s->key), &k, RTABLE_EMPTY))
+            break;
+    }
+}
+
+void rtable_sweep(rtable_t *r)
+{
+    // going down, a cleared slot lets the tombstone before it go as well
+    unsigned long end = r->sweep;
+    for (unsigned long i = end + RTABLE_SWEEP; i != end; i--)
+        rtable_trim(r, i);
+    r->sweep = end + RTABLE_SWEEP;
+}
+
+struct remote_task_t *rtable_remove(rtable_t *r, long int key)
+{
+    unsigned long h = rtable_hash(key);
+    rtable_slot_t *s;
+    struct remote_task_t *rtask = NULL;
+    long int k;
+
+    for (int i = 0; i < RTABLE_MAX_PROBE; i++) {
+        s = &(r->slots[(h + i) & RTABLE_MASK]);
+        k = atomic_load_explicit(&(s->key), memory_order_acquire);
+        if (k == key) {
+            // whoever swaps the task out owns it and frees the slot
+            rtask = atomic_exchange_explicit(&(s->rtask), NULL, memory_order_acq_rel);
+            if (rtask == NULL)
+                break;
+            atomic_store(&(s->key), RTABLE_DELETED);
+            atomic_fetch_sub_explicit(&(r->count), 1, memory_order_relaxed);
+            rtable_trim(r, h + i);
+            break;
+        }
+        if (k == RTABLE_EMPTY)
+            break;
+    }
+    return rtask;
+}
+
+void rtable_print_stats(rtable_t *r, FILE *fptr)
+{
+    if (r == NULL)
+        return;
+    fprintf(fptr, "Remote task table: %d outstanding, %ld inserts failed [size %d, probe %d]\n",
+        atomic_load(&(r->count)), atomic_load(&(r->full)), RTABLE_SIZE, RTABLE_MAX_PROBE);
+}
@@ -0,0 +1,105 @@
+#ifndef __RTABLE_H__
+#define __RTABLE_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+struct remote_task_t;
+
+#define RTABLE_SIZE                 131072
+#define RTABLE_MAX_PROBE            64
+#define RTABLE_SWEEP                1024
+/**
+ * Configurable Macros
+ * @RTABLE_SIZE:        number of slots in the remote task table, a power of two and
+ *                      at least twice MAX_TASKS, as every task may have a remote call
+ *                      outstanding
+ * @RTABLE_MAX_PROBE:   slots visited from the home slot of a key before an insert gives
+ *                      up (the table is full around it) or a lookup reports a miss
+ * @RTABLE_SWEEP:       slots rtable_sweep() looks at each time the pExecutor goes idle
+ */
+
+#define RTABLE_EMPTY                0
+#define RTABLE_DELETED              (-1L)
+#define RTABLE_CLAIMED              (-2L)
+
+/**
+ * rtable_slot_t - One slot of the remote task table
+ * @key:    task id, RTABLE_EMPTY if no probe chain runs through the slot,
+ *          RTABLE_DELETED once freed while one may, RTABLE_CLAIMED while an insert
+ *          fills it in
+ * @rtask:  the remote task, NULL while the slot is being filled or emptied
+ */
+typedef struct rtable_slot_t {
+    atomic_long key;
+    _Atomic(struct remote_task_t *) rtask;
+} rtable_slot_t;
+
+/**
+ * rtable_t - Outstanding remote tasks, keyed on the 64-bit task id
+ * @sweep:   next slot rtable_sweep() looks at, pExecutor only
+ * @inserts: inserts between their first probe and publishing their key
+ * @count:   remote tasks in the table
+ * @full:    inserts that failed because no slot was free within RTABLE_MAX_PROBE
+ * @slots:   open-addressed slots, linear probing
+ *
+ * Nothing takes a lock. Inserts claim a free slot with a CAS on its key, removes swap
+ * @rtask to NULL, so a thread that got the remote task from a lookup and one removing
+ * it do not both own it, and leave a tombstone. A remove then turns the tombstones at
+ * the end of the probe chain back into RTABLE_EMPTY, one CAS each: no chain of another
+ * key runs through a slot followed by an empty one, so lookups stay short however many
+ * tasks went through the table. An insert that is still probing may have passed the
+ * slot while it was live, so a tombstone is only cleared while @inserts is 0. The ones
+ * a remove could not clear are picked up by rtable_sweep() on the pExecutor. Task ids
+ * are unique, so a key is never inserted twice.
+ */
+typedef struct rtable_t {
+    unsigned long sweep;
+    atomic_int inserts;
+    atomic_int count;
+    atomic_long full;
+    rtable_slot_t slots[RTABLE_SIZE];
+} rtable_t;
+
+rtable_t *rtable_create();
+void rtable_destroy(rtable_t *r);
+/**
+ * rtable_destroy() - Frees @r and the remote tasks still in it. The tasks waiting on
+ *                    them are not touched.
+ */
+
+bool rtable_insert(rtable_t *r, long int key, struct remote_task_t *rtask);
+/**
+ * rtable_insert() - Adds @rtask under @key
+ *
+ * Return: false if there is no free slot near the home slot of @key
+ */
+
+struct remote_task_t *rtable_find(rtable_t *r, long int key);
+/**
+ * rtable_find() - Returns the remote task of @key, NULL if there is none
+ *
+ * The remote task can be freed by the thread that removes it at any time, so it must
+ * only be dereferenced where that cannot happen (see process_timeout_event()).
+ */
+
+struct remote_task_t *rtable_remove(rtable_t *r, long int key);
+/**
+ * rtable_remove() - Takes the remote task of @key out of the table
+ *
+ * Return: the remote task, now owned by the caller, or NULL if somebody else removed
+ *         it first or it was never there
+ */
+
+void rtable_sweep(rtable_t *r);
+/**
+ * rtable_sweep() - Clears the tombstones left at the end of probe chains in the next
+ *                  RTABLE_SWEEP slots, the ones removes found inserts in flight for
+ *
+ * Context: pExecutor, before it parks
+ */
+
+void rtable_print_stats(rtable_t *r, FILE *fptr);
+
+#endif
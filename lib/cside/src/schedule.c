@@ -0,0 +1,57 @@
+/*
+ * Compiled schedules. A PUT_SCHEDULE from the controller is turned into a sorted,
+ * immutable slot table once, instead of every epoch, and handed to the pExecutor
+ * without a lock.
+ */
+
+#include <stdlib.h>
+#include "tboard.h"
+#include "schedule.h"
+
+schedtab_t *schedtab_compile(sched_t *s)
+{
+    schedtab_t *tab;
+    schedslot_t e;
+    int n = 0, j;
+
+    if (s->len <= 0 || s->rtslots < 0 || s->rtslots > MAX_RT_SLOTS ||
+        s->syslots < 0 || s->syslots > MAX_SY_SLOTS)
+        return NULL;
+    tab = (schedtab_t *)malloc(sizeof(schedtab_t) + (s->rtslots + s->syslots + 1) * sizeof(schedslot_t));
+    if (tab == NULL)
+        return NULL;
+    for (int i = 0; i < s->rtslots; i++)
+        tab->slots[n++] = (schedslot_t){.start = s->rtstarts[i], .type = TW_EVENT_RT_SCHEDULE};
+    for (int i = 0; i < s->syslots; i++)
+        tab->slots[n++] = (schedslot_t){.start = s->systarts[i], .type = TW_EVENT_SY_SCHEDULE};
+    for (int i = 0; i < n; i++) {
+        if (tab->slots[i].start < 0 || tab->slots[i].start >= s->len) {
+            free(tab);
+            return NULL;
+        }
+    }
+    // insertion sort, there are a handful of slots
+    for (int i = 1; i < n; i++) {
+        e = tab->slots[i];
+        for (j = i; j > 0 && tab->slots[j - 1].start > e.start; j--)
+            tab->slots[j] = tab->slots[j - 1];
+        tab->slots[j] = e;
+    }
+    tab->slots[n] = (schedslot_t){.start = s->len, .type = TW_EVENT_INSTALL_SCHEDULE};
+    tab->len = s->len;
+    tab->nslots = n;
+    return tab;
+}
+
+void schedtab_publish(_Atomic(schedtab_t *) *next, schedtab_t *tab)
+{
+    // the reader only takes tables by swapping them out, it cannot hold this one
+    free(atomic_exchange_explicit(next, tab, memory_order_acq_rel));
+}
+
+schedtab_t *schedtab_take(_Atomic(schedtab_t *) *next)
+{
+    if (atomic_load_explicit(next, memory_order_relaxed) == NULL)
+        return NULL;
+    return atomic_exchange_explicit(next, NULL, memory_order_acq_rel);
+}
@@ -0,0 +1,70 @@
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include <stdatomic.h>
+
+#define MAX_RT_SLOTS            8
+#define MAX_SY_SLOTS            8
+
+/**
+ * sched_t - Data type for schedules
+ * @len:        length of the schedule epoch in microseconds
+ * @syslots:    SY task slots - could be 0
+ * @systarts:   Starting times of each slot. We don't have end times because slot size is fixed 
+ * @rtslots:    RT task slots - could be 0
+ * @rtstarts:   Starting times of each RT slot. The slot size is same across all slots. However, RT slots different from SY slots.
+ */
+typedef struct sched_t {
+    int len;
+    int syslots;
+    int systarts[MAX_SY_SLOTS];
+    int rtslots;
+    int rtstarts[MAX_RT_SLOTS];
+} sched_t;
+
+/**
+ * schedslot_t - One entry of a compiled schedule
+ * @start:  offset from the start of the epoch in microseconds
+ * @type:   TW_EVENT_RT_SCHEDULE, TW_EVENT_SY_SCHEDULE, or TW_EVENT_INSTALL_SCHEDULE for
+ *          the end of the epoch
+ */
+typedef struct schedslot_t {
+    int start;
+    int type;
+} schedslot_t;
+
+/**
+ * schedtab_t - A schedule compiled into its slots, sorted by start time
+ * @len:    length of the epoch in microseconds
+ * @nslots: RT and SY slots, @slots[@nslots] is the end of the epoch
+ * @slots:  the slots
+ *
+ * A table is never changed once published. The pExecutor walks it with a cursor, one
+ * wheel timer at a time, and switches to a newer table at the end of an epoch.
+ */
+typedef struct schedtab_t {
+    long int len;
+    int nslots;
+    schedslot_t slots[];
+} schedtab_t;
+
+schedtab_t *schedtab_compile(sched_t *s);
+/**
+ * schedtab_compile() - Compiles @s into a slot table
+ *
+ * Return: the table (free() it), NULL if @s is malformed: no epoch length, too many
+ *         slots or slots starting outside of the epoch
+ */
+
+void schedtab_publish(_Atomic(schedtab_t *) *next, schedtab_t *tab);
+schedtab_t *schedtab_take(_Atomic(schedtab_t *) *next);
+/**
+ * schedtab_publish() - Hands @tab to the reader of @next, any thread
+ * schedtab_take() - Takes the latest table published on @next, NULL if there is none
+ *
+ * A published table belongs to the reader once taken, so the reader frees the table it
+ * replaces when it is done with it, RCU style with the end of an epoch as the grace
+ * period. A table published on top of one that was never taken is freed right away.
+ */
+
+#endif
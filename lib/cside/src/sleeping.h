@@ -1,18 +1,47 @@
 #ifndef __SLEEPING_H__
 #define __SLEEPING_H__
 
-#include <math.h>
 #include <time.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
 
+/*
+ * Precise sleeping for slot starts. The thread blocks in clock_nanosleep() on an
+ * absolute CLOCK_MONOTONIC deadline that is taken early by the spin window, and then
+ * polls the clock until the real deadline. The spin window follows the wakeup latency
+ * the sleeper observes (mean plus four mean deviations, the way TCP estimates its
+ * retransmission timeout), so it shrinks on a quiet machine and grows under load.
+ */
+
+#define SLEEP_SPIN_INIT             50000
+#define SLEEP_SPIN_MIN              2000
+#define SLEEP_SPIN_MAX              500000
+/**
+ * Configurable Macros, all in nanoseconds
+ * @SLEEP_SPIN_INIT:    spin window before any wakeup was observed
+ * @SLEEP_SPIN_MIN:     the spin window never gets shorter than this
+ * @SLEEP_SPIN_MAX:     nor longer than this, a slot start that late is lost anyway
+ */
+
+/**
+ * sleeper_t - Wakeup latency estimate of one thread
+ * @spin:   current spin window
+ * @lavg:   mean latency of a clock_nanosleep() wakeup past its deadline
+ * @ldev:   mean deviation of that latency
+ */
 typedef struct sleeper {
-    // there can be other parameters over here.
-    double savg;
+    int64_t spin;
+    int64_t lavg;
+    int64_t ldev;
 } sleeper_t;
 
-// 500 microseconds or smaller is considered SHORT sleeping
-#define SHORT_SLEEP_TIME            500000
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()                 __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax()                 asm volatile("yield" ::: "memory")
+#else
+#define cpu_relax()                 asm volatile("" ::: "memory")
+#endif
 
 static inline int64_t curtime_in_nanosec()
 {
@@ -21,102 +50,79 @@ static inline int64_t curtime_in_nanosec()
     return (int64_t)(1000000000 * ts.tv_sec + ts.tv_nsec);
 }
 
-static inline void __do_sleep() 
-{
-    // we could do other sleeps as well
-    asm("nop");asm("nop");asm("nop");asm("nop");
-    asm("nop");asm("nop");asm("nop");asm("nop");
-    asm("nop");asm("nop");asm("nop");asm("nop");
-}
-
 /**
- * @brief Busy sleep for the given time (in nanoseconds). This is a precise sleeper. 
- * It uses a learned sleeper that gives the number of asm("nop") instructions to use.
- * 
- * @param sleep_factor 
- * @param stime  - sleeping time in nanoseconds
+ * @brief Feed one observed wakeup latency (in nanoseconds) into the spin window
  */
-static inline void tiny_busy_sleep(sleeper_t *s, int64_t stime) 
+static inline void sleeper_learn(sleeper_t *s, int64_t lat)
 {
-    int64_t start = curtime_in_nanosec();
-    for (int i = 0; i < lround(stime/s->savg); i++)
-        __do_sleep();
-    int64_t end = curtime_in_nanosec();
-    // do the correction
-    double x = (end - start)/stime;
-    s->savg = s->savg * 0.8 +  (11.0 * x/(10.0 * x + 1)) * s->savg * 0.2;
-}
+    int64_t err = lat - s->lavg;
 
+    s->lavg += err / 8;
+    s->ldev += ((err < 0 ? -err : err) - s->ldev) / 4;
+    s->spin = s->lavg + 4 * s->ldev;
+    if (s->spin < SLEEP_SPIN_MIN)
+        s->spin = SLEEP_SPIN_MIN;
+    else if (s->spin > SLEEP_SPIN_MAX)
+        s->spin = SLEEP_SPIN_MAX;
+}
 
 /**
- * @brief Block sleep for the given time (in nanoseconds). This is NOT a precise sleeper.
- * You don't need to learn the sleeping scale to use this sleeping mechanism. 
- * We use the nanosleep provided by the OS, expect a lot of jitter. 
-  * 
- * @param stime  - sleeping time in nanoseconds
+ * @brief Sleep until the absolute CLOCK_MONOTONIC time @deadline (in nanoseconds).
+ * Blocks for all but the spin window and spins for the rest.
+ *
+ * @param s         - sleeper object, owned by the calling thread
+ * @param deadline  - wakeup time in nanoseconds
+ * @return how late we returned, in nanoseconds
  */
-static inline void small_block_sleep(sleeper_t *s, int64_t stime) 
+static inline int64_t sleep_until(sleeper_t *s, int64_t deadline)
 {
-    int64_t start = curtime_in_nanosec();
-    struct timespec ts = {.tv_sec = 0.9 * stime/1000000000, .tv_nsec = lround(0.9 * stime) % 1000000000}, tr;
-    nanosleep(&ts, &tr);
-    int64_t end = curtime_in_nanosec();
-    if ((end - start) < stime) 
-        tiny_busy_sleep(s, stime - (end - start));
+    int64_t wake = deadline - s->spin, now = curtime_in_nanosec();
+    struct timespec ts = {.tv_sec = wake / 1000000000, .tv_nsec = wake % 1000000000};
+
+    if (wake > now) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+        now = curtime_in_nanosec();
+        sleeper_learn(s, now - wake);
+    }
+    while (now < deadline) {
+        cpu_relax();
+        now = curtime_in_nanosec();
+    }
+    return now - deadline;
 }
 
 /**
- * @brief This is a smart sleeper that uses system sleeping and busy sleeping to get accurate sleeping
- * 
+ * @brief Precise relative sleep, see sleep_until()
+ *
  * @param s  - sleeper object
- * @param stime -sleeping time in nanoseconds
+ * @param stime - sleeping time in nanoseconds
  */
-static inline void smart_sleep(sleeper_t *s, int64_t stime) 
+static inline void smart_sleep(sleeper_t *s, int64_t stime)
 {
-    if (stime < SHORT_SLEEP_TIME)
-        tiny_busy_sleep(s, stime);
-    else 
-        small_block_sleep(s, stime);
+    sleep_until(s, curtime_in_nanosec() + stime);
 }
 
-static inline void sleep_until(sleeper_t *s, int64_t stime, double frac) 
-{
-    int64_t ctime = curtime_in_nanosec();
-    smart_sleep(s, lround((stime - ctime) * 0.8));
-}
-
-static inline void system_sleep(int64_t stime) 
+static inline void system_sleep(int64_t stime)
 {
     struct timespec ts = {.tv_sec = stime/1000000000, .tv_nsec = stime % 1000000000}, tr;
     nanosleep(&ts, &tr);
 }
 
 /**
- * @brief Learn the sleep_factor. This is the time for a single sleep statement in nanoseconds.
- * You call the learn_sleeping with a set trial number
- * 
- * @param sleep_f 
- * @param n 
+ * @brief Seed the spin window with @n short sleeps of the calling thread (100us each).
+ * The thread that later sleeps on @s should call this, the latency is per thread.
+ *
+ * @param s - sleeper object
+ * @param n - number of trial sleeps
  */
-static inline void learn_sleeping(sleeper_t *s, int n) 
+static inline void learn_sleeping(sleeper_t *s, int n)
 {
-    int64_t start, end;
-    s->savg = 0;
-
-    // setup initial value
-    start = curtime_in_nanosec();
+    s->spin = SLEEP_SPIN_INIT;
+    s->lavg = SLEEP_SPIN_INIT / 4;
+    s->ldev = SLEEP_SPIN_INIT / 8;
     for (int i = 0; i < n; i++)
-        __do_sleep();
-    end = curtime_in_nanosec();
-    s->savg = ((double)(end - start)/n);
-
-    // refine the value..
-    for (int i = 0; i < 100; i++) {
-        start = curtime_in_nanosec();
-        tiny_busy_sleep(s, 2000);
-        end = curtime_in_nanosec();
-        s->savg = s->savg * 0.8 +  ((end - start)/2000.0) * s->savg * 0.2;
-    }
+        sleep_until(s, curtime_in_nanosec() + 100000);
 }
 
 #endif
@@ -0,0 +1,144 @@
+/*
+ * Shared stacks of the executors. Tasks in shared stack mode run on the stack of
+ * the executor they started on, and only the part of it they actually use is kept
+ * while they are parked, see sstack.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "tboard.h"
+#include "sstack.h"
+#ifdef SSTACK_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+bool sstack_usable()
+{
+#ifdef SSTACK_ASAN
+    static atomic_bool warned = false;
+
+    if (__asan_get_current_fake_stack() != NULL) {
+        if (!atomic_exchange(&warned, true))
+            tboard_err("sstack: detect_stack_use_after_return is on, tasks get stacks of their own.\n");
+        return false;
+    }
+#endif
+    return true;
+}
+
+void sstack_init(sstack_t *s, int num)
+{
+    memset(s, 0, sizeof(sstack_t));
+    s->num = num;
+}
+
+static void sstack_map(sstack_t *s)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    char *m = mmap(NULL, SSTACK_SIZE + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    assert(m != MAP_FAILED);
+    // guard page, stacks grow down
+    assert(mprotect(m, page, PROT_NONE) == 0);
+    s->base = m + page;
+    s->top = s->base + SSTACK_SIZE;
+}
+
+void sstack_destroy(sstack_t *s)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if (s->base != NULL)
+        munmap(s->base - page, SSTACK_SIZE + page);
+    s->base = s->top = NULL;
+    s->owner = NULL;
+}
+
+#ifdef SSTACK_ASAN
+// frames hold redzones the intercepted memcpy() would report, so they are copied a
+// word at a time without instrumentation (the saved stack pointer is word aligned)
+__attribute__((no_sanitize_address)) static void sstack_copy(char *dst, const char *src, size_t len)
+{
+    volatile long *d = (volatile long *)dst;
+    const volatile long *s = (const volatile long *)src;
+
+    for (size_t i = 0; i < len / sizeof(long); i++)
+        d[i] = s[i];
+}
+#else
+#define sstack_copy                 memcpy
+#endif
+
+static void sstack_save(sstack_t *s, task_t *task)
+{
+    size_t len = s->top - task->ss.sp;
+
+    if (len > task->ss.cap) {
+        task->ss.buf = realloc(task->ss.buf, len);
+        assert(task->ss.buf != NULL);
+        task->ss.cap = len;
+    }
+    sstack_copy(task->ss.buf, task->ss.sp, len);
+    task->ss.len = len;
+    s->saves++;
+    s->bytes += len;
+}
+
+void sstack_enter(sstack_t *s, task_t *task)
+{
+    if (s->owner == task)
+        return;     // nobody used the stack since it yielded
+    if (s->base == NULL)
+        sstack_map(s);
+    if (s->owner != NULL)
+        sstack_save(s, s->owner);
+    s->owner = task;
+#ifdef SSTACK_ASAN
+    // the redzones of the previous owner are in the way of this one
+    __asan_unpoison_memory_region(s->base, SSTACK_SIZE);
+#endif
+    if (task->ss.home == NULL) {
+        task->ss.home = s;
+        sstack_bind(task->ctx, s->base, SSTACK_SIZE);
+    } else {
+        assert(task->ss.home == s);
+        sstack_copy(s->top - task->ss.len, task->ss.buf, task->ss.len);
+        s->restores++;
+    }
+}
+
+void sstack_leave(sstack_t *s, task_t *task, bool dead)
+{
+    char *sp;
+
+    if (dead) {
+        if (s->owner == task)
+            s->owner = NULL;
+        sstack_forget(task);
+        return;
+    }
+    // everything from the stack pointer up is live, without it the whole stack is
+    if ((sp = sstack_saved_sp(task->ctx)) == NULL)
+        sp = s->base;
+    assert(sp >= s->base && sp <= s->top);
+    task->ss.sp = sp;
+}
+
+void sstack_forget(task_t *task)
+{
+    free(task->ss.buf);
+    task->ss.buf = NULL;
+    task->ss.len = task->ss.cap = 0;
+}
+
+void sstack_print_stats(sstack_t *s, FILE *fptr)
+{
+    if (s->base == NULL)
+        return;
+    fprintf(fptr, "Shared stack of %s %d: %ld saves (%ld bytes, %ld avg), %ld restores\n",
+        s->num < 0 ? "pExecutor" : "sExecutor", s->num < 0 ? 0 : s->num, s->saves, s->bytes,
+        s->saves > 0 ? s->bytes / s->saves : 0, s->restores);
+}
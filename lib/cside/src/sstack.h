@@ -0,0 +1,141 @@
+#ifndef __SSTACK_H__
+#define __SSTACK_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <minicoro.h>
+
+/*
+ * Shared stack coroutines. A task in this mode has no stack of its own: it runs on
+ * the shared stack of the executor that first resumed it, and when another task
+ * needs that stack its live frames are copied out into a buffer sized to them. They
+ * are copied back, to the same addresses, before it runs again. Frames hold pointers
+ * into the stack, so such a task is tied to its executor for the rest of its life
+ * (task_place() sends it back there). Copies happen lazily: a task that is resumed
+ * again before anybody else used the stack finds its frames still in place.
+ */
+
+#define SSTACK_SIZE                 (256 * 1024)
+/**
+ * Configurable Macros
+ * @SSTACK_SIZE:    size of the shared stack of an executor, the deepest a task in this
+ *                  mode may go. A guard page below it catches overflows.
+ */
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SSTACK_ASAN                 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SSTACK_ASAN                 1
+#endif
+#endif
+/**
+ * SSTACK_ASAN - Built with AddressSanitizer (the default Makefile flags). Frames are
+ *               then copied without instrumentation and the shadow of the shared stack
+ *               is cleared for whoever gets it, as it still holds the redzones of the
+ *               previous owner.
+ */
+
+#define STACK_SHARED                ((size_t)-1)
+/**
+ * STACK_SHARED - function_t.stack_size of functions whose tasks run on shared stacks,
+ *                e.g. TBOARD_FUNC_STACK(..., STACK_SHARED)
+ */
+
+struct task_t;
+
+/**
+ * sstack_t - Shared stack of one executor
+ * @base:     lowest address of the stack, NULL until the first task in this mode runs
+ * @top:      end of the stack, frames are copied out from the saved stack pointer to here
+ * @owner:    task whose frames are in the stack now, NULL if nobody's are
+ * @num:      sExecutor that owns the stack, -1 for the pExecutor
+ * @saves:    times frames were copied out
+ * @restores: times frames were copied back
+ * @bytes:    bytes copied out, summed over @saves
+ *
+ * Only the owning executor touches it.
+ */
+typedef struct sstack_t {
+    char *base;
+    char *top;
+    struct task_t *owner;
+    int num;
+    long saves;
+    long restores;
+    long bytes;
+} sstack_t;
+
+/**
+ * sstack_save_t - Frames of a task in shared stack mode (task_t.ss)
+ * @shared:   the task runs on a shared stack
+ * @home:     shared stack the task runs on, NULL until it first ran
+ * @sp:       its stack pointer when it last yielded, the lowest address of its frames
+ * @buf:      copy of the frames while another task has the stack
+ * @len:      bytes in @buf
+ * @cap:      size of @buf
+ */
+typedef struct sstack_save_t {
+    bool shared;
+    sstack_t *home;
+    char *sp;
+    char *buf;
+    size_t len;
+    size_t cap;
+} sstack_save_t;
+
+bool sstack_usable();
+/**
+ * sstack_usable() - False if tasks cannot run on shared stacks in this process, they get
+ *                   stacks of their own then. That is the case under AddressSanitizer
+ *                   with detect_stack_use_after_return: the fake frames of a parked task
+ *                   are keyed on stack addresses another task reuses.
+ */
+
+void sstack_init(sstack_t *s, int num);
+void sstack_destroy(sstack_t *s);
+/**
+ * sstack_init() - Sets up the shared stack of an executor, the memory is mapped when the
+ *                 first task in this mode runs on it (mapping failures are fatal)
+ * sstack_destroy() - Unmaps it, the tasks that ran on it must be gone
+ */
+
+void sstack_enter(sstack_t *s, struct task_t *task);
+void sstack_leave(sstack_t *s, struct task_t *task, bool dead);
+/**
+ * sstack_enter() - Gets @s ready to resume @task: copies the frames of its current owner
+ *                  out and those of @task in, or starts the coroutine of a new @task on it
+ * sstack_leave() - Records where the frames of @task end after it yielded (its saved stack
+ *                  pointer, see sstack_saved_sp()), or drops them if @dead
+ *
+ * Context: executor thread owning @s, around mco_resume()
+ */
+
+void sstack_forget(struct task_t *task);
+/**
+ * sstack_forget() - Frees the saved frames of @task, for tasks destroyed while parked
+ */
+
+mco_desc sstack_desc_init(void (*func)(mco_coro *co));
+mco_result sstack_create(mco_coro **out, mco_desc *desc);
+void sstack_bind(mco_coro *co, char *base, size_t size);
+char *sstack_saved_sp(mco_coro *co);
+bool sstack_coro_intact(mco_coro *co);
+/**
+ * sstack_desc_init() - Like mco_desc_init(), for a coroutine without a stack of its own
+ * sstack_create() - Like mco_create(), for such a description
+ * sstack_bind() - Makes the initial context of @co on the stack at @base
+ * sstack_saved_sp() - Stack pointer @co was switched out at, NULL where the context
+ *                     layout of minicoro is not known (the whole stack is saved then)
+ * sstack_coro_intact() - False if the stack of @co ran into its mco_coro header
+ *
+ * These need the minicoro internals and live in tboard.c, next to MINICORO_IMPL.
+ */
+
+void sstack_print_stats(sstack_t *s, FILE *fptr);
+/**
+ * sstack_print_stats() - Prints the copy counters of @s, nothing if it was never used
+ */
+
+#endif
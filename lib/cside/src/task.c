@@ -8,6 +8,7 @@
 #include "mqtt_adapter.h"
 #include "cnode.h"
 #include "constants.h"
+#include "jdata.h"
 
 
 long int mysnowflake_id()
@@ -32,14 +33,19 @@ bool task_create(tboard_t *t, function_t fn, void *args, void *cmd)
         return false;
     mco_result res;
 
-    // create task_t object
-    task_t *task = calloc(1, sizeof(task_t));
+    // create task_t object - recycled from the task board pool
+    task_t *task = taskpool_task_alloc(t->tpool);
     task->status = TASK_INITIALIZED;
     task->type = fn.tasktype;
     task->id = TASK_ID_NONBLOCKING;
     task->fn = fn;
-    // create description and populate it with argument
-    task->desc = mco_desc_init((task->fn.fn), 0);
+    // create description and populate it with argument, on the stack size the function asked for
+    task->ss.shared = (fn.stack_size == STACK_SHARED || t->sstacks) && sstack_usable();
+    if (task->ss.shared)
+        task->desc = sstack_desc_init(task->fn.fn);
+    else
+        task->desc = mco_desc_init((task->fn.fn), taskpool_stack_size(t->tpool, fn.stack_size == STACK_SHARED ? 0 : fn.stack_size));
+    taskpool_desc_attach(t->tpool, &(task->desc));
     task->desc.user_data = args;
     if (args != NULL) {
         arg_t *a = args;
@@ -48,11 +54,12 @@ bool task_create(tboard_t *t, function_t fn, void *args, void *cmd)
     task->cmd_obj = cmd;
     // non-blocking task so no parent
     task->parent = NULL;
-    // create coroutine
-    if ( (res = mco_create(&(task->ctx), &(task->desc))) != MCO_SUCCESS ) {
+    // create coroutine, one in shared stack mode gets its stack when it first runs
+    res = task->ss.shared ? sstack_create(&(task->ctx), &(task->desc)) : mco_create(&(task->ctx), &(task->desc));
+    if (res != MCO_SUCCESS) {
         tboard_err("task_create: Failed to create coroutine: %s.\n",mco_result_description(res));
         if (task->cmd_obj != NULL) command_free((command_t *)task->cmd_obj);
-        free(task);
+        taskpool_task_free(t->tpool, task);
         return false;
     } else {
         // attempt to add task to tboard
@@ -60,7 +67,7 @@ bool task_create(tboard_t *t, function_t fn, void *args, void *cmd)
         if (!added){
             mco_destroy(task->ctx); // we must destroy stack allocated in mco_create() on failure
             if (task->cmd_obj != NULL) command_free((command_t *)task->cmd_obj);
-            free(task); // free task, as it turns out we cannot use it
+            taskpool_task_free(t->tpool, task); // free task, as it turns out we cannot use it
         }
         return added;
     }
@@ -78,11 +85,14 @@ void task_destroy(task_t *task)
     // destroy user data if applicable
     if (task->data_size > 0 && task->desc.user_data != NULL)
         free(task->desc.user_data);
-    // destroy coroutine
+    // destroy coroutine - the pool it came from is its allocator data
+    taskpool_t *pool = (taskpool_t *)task->desc.allocator_data;
     mco_destroy(task->ctx);
+    sstack_forget(task);
+    jdata_release_task(task);
     if (task->cmd_obj != NULL) command_free((command_t *)task->cmd_obj);
     // free task_t
-    free(task);
+    taskpool_task_free(pool, task);
 }
 
 inline void task_yield()
@@ -99,36 +109,37 @@ inline void *task_get_args()
 
 void task_place(tboard_t *t, task_t *task)
 {
+    task->qtime = trace_now();
+    // a task on the shared stack of an sExecutor can only run there
+    if (task->ss.home != NULL && task->ss.home->num >= 0) {
+        taskq_push(&(t->shome[task->ss.home->num]), task);
+        tboard_wake_secondary(t, task->ss.home->num);
+        return;
+    }
     // add task to ready queue
     if(task->type <= PRI_BATCH_TASK || t->sqs == 0) {
         // task should be added to primary ready queue
-        pthread_mutex_lock(&(t->pmutex)); // lock primary mutex
-        struct queue_entry *task_q = queue_new_node(task); // create queue entry
-        //printf("Task type %d\n", task->type);
         switch (task->type) {
             case PRI_SYNC_TASK:
-                queue_insert_tail(&(t->pqueue_sy), task_q);
+                taskq_push(&(t->pqueue_sy), task);
             break;
             case PRI_REAL_TASK:
-                queue_insert_tail(&(t->pqueue_rt), task_q);
+                taskq_push(&(t->pqueue_rt), task);
             break;
-            case PRI_BATCH_TASK:
-                queue_insert_tail(&(t->pqueue_ba), task_q);
+            default:
+                taskq_push(&(t->pqueue_ba), task);
         }
-        pthread_cond_signal(&(t->pcond)); // signal primary condition variable as only one 
-                                          // thread will ever wait for pcond
-        pthread_mutex_unlock(&(t->pmutex)); // unlock mutex
+        tboard_wake_primary(t); // only one thread will ever wait on pwake
     } else {
-        // task should be added to secondary ready queue
-        int j = rand() % (t->sqs); // randomly select secondary queue
-        pthread_mutex_lock(&(t->smutex[j])); // lock secondary mutex
-        struct queue_entry *task_q = queue_new_node(task); // create queue entry
-        queue_insert_tail(&(t->squeue[j]), task_q); // insert queue entry to tail
-        pthread_cond_signal(&(t->scond[j])); // signal secondary condition variable as only
-                                             // one thread will ever wait for pcond
+        // task should be added to secondary ready queue. A sExecutor keeps the tasks it
+        // creates on its own deque, everybody else goes through the injection queue
+        exec_t *e = current_exec;
+        if (e == NULL || e->type != SECONDARY_EXECUTOR || e->tboard != t ||
+            !wsdeque_push(&(t->sdeque[e->num]), task))
+            taskq_push(&(t->sinject), task);
+        tboard_wake_idle_secondary(t); // let a parked sExecutor pick it up or steal it
         if (SIGNAL_PRIMARY_ON_NEW_SECONDARY_TASK == 1)
-            pthread_cond_signal(&(t->pcond)); // signal primary condition variable
-        pthread_mutex_unlock(&(t->smutex[j])); // unlock mutex
+            tboard_wake_primary(t); // signal primary condition variable
     }
 }
 
@@ -145,10 +156,14 @@ bool task_add(tboard_t *t, task_t *task)
     task->cpu_time = 0;
     task->yields = 0;
     task->status = TASK_INITIALIZED;
-    task->hist = NULL;
     // add task to history
-    history_record_exec(t, task, &(task->hist));
-    task->hist->executions += 1; // increase execution count
+    history_attach(t, task);
+    // its expected cost counts against new remote calls until it completes
+    task->cost = admit_charge(&(t->admit), task->hist != NULL ? atomic_load_explicit(&(task->hist->cost), memory_order_relaxed) : 0);
+    // a REXEC can come with a time budget, it counts from now
+    task->deadline = 0;
+    if (task->cmd_obj != NULL && ((command_t *)task->cmd_obj)->deadline > 0)
+        task->deadline = task->ctime + (uint64_t)((command_t *)task->cmd_obj)->deadline * 1000;
     // add task to ready queue
     task_place(t, task);
     return true;
@@ -172,18 +187,22 @@ void *blocking_task_create(tboard_t *t, function_t fn, int type, void *args, siz
     task.type = type; // tagged arbitrarily, will assume parents position
     task.id = TASK_ID_BLOCKING;
     task.fn = fn;
-    task.desc = mco_desc_init((task.fn.fn), 0);
+    task.ss.shared = (fn.stack_size == STACK_SHARED || t->sstacks) && sstack_usable();
+    if (task.ss.shared)
+        task.desc = sstack_desc_init(task.fn.fn);
+    else
+        task.desc = mco_desc_init((task.fn.fn), taskpool_stack_size(t->tpool, fn.stack_size == STACK_SHARED ? 0 : fn.stack_size));
+    taskpool_desc_attach(t->tpool, &(task.desc));
     task.desc.user_data = args;
     task.data_size = sizeof_args;
     task.parent = NULL;
-    task.hist = NULL;
 
     // add task to history
-    history_record_exec(t, &task, &(task.hist));
-    task.hist->executions += 1; // increase execution count
+    history_attach(t, &task);
 
     // create coroutine context
-    if ( (res = mco_create(&(task.ctx), &(task.desc))) != MCO_SUCCESS ) {
+    res = task.ss.shared ? sstack_create(&(task.ctx), &(task.desc)) : mco_create(&(task.ctx), &(task.desc));
+    if (res != MCO_SUCCESS) {
         tboard_err("blocking_task_create: Failed to create coroutine: %s.\n",mco_result_description(res));
         return NULL;
     } else { // context creation successful
@@ -338,8 +357,8 @@ bool sleep_task_create(tboard_t *tboard, int sval)
     rtask.task_id = mysnowflake_id();
     rtask.status = TASK_INITIALIZED;
     rtask.mode = TASK_MODE_SLEEPING;
-
-    twheel_add_event(tboard, TW_EVENT_BEGIN_JSLEEP, clone_taskid(&(rtask.task_id)), getcurtime() + sval);
+    // the executor arms the wake up once the remote task is in the task table
+    rtask.wake = getcurtime() + sval;
 
     // push rtask into storage. This copies memory in current thread so we dont have
     // to worry about invalid reads
@@ -376,16 +395,13 @@ bool sleep_task_create(tboard_t *tboard, int sval)
 
 void remote_task_free(tboard_t *t, long int taskid) 
 {
-    remote_task_t *rtask = NULL;
-        HASH_FIND_INT(t->task_table, &(taskid), rtask);
-    if (rtask != NULL) {
-        HASH_DEL(t->task_table, rtask);
-        free(rtask);
-    }
+    remote_task_t *rtask = rtable_remove(t->task_table, taskid);
+    if (rtask != NULL)
+        twheel_release_rtask(t, rtask);
 }
 
 
-void remote_task_destroy(remote_task_t *rtask)
+void remote_task_destroy(tboard_t *t, remote_task_t *rtask)
 {
     if (rtask == NULL)
         return;
@@ -397,48 +413,137 @@ void remote_task_destroy(remote_task_t *rtask)
     // free alloc'd data if applicable
     if (rtask->data_size > 0 && rtask->data != NULL)
         free(rtask->data);    
-    // free rtask object
-    free(rtask);
+    // cancel the timer and free rtask object
+    twheel_release_rtask(t, rtask);
 }
 
 
 #define  send_command_to_server(X) do {                         \
-    cmd = command_new_using_arg(CmdNames_REXEC, 0, rtask->command, rtask->task_id, cn->core->device_id, rtask->fn_argsig, rtask->data); \
-    mqtt_publish(X, cn->topics->requesttopic, cmd->buffer, cmd->length, cmd, 0); \
+    command_hold(cmd);                                          \
+    wire_send(&((X)->wreq), cmd);                               \
 } while (0)
 
-void remote_task_place(tboard_t *t, remote_task_t *rtask)
+command_t *remote_task_command(tboard_t *t, remote_task_t *rtask)
 {
     cnode_t *cn = (cnode_t *)t->cnode;
-    command_t *cmd;
-    // check for valid taskboard and remote task
-    if (t == NULL || rtask == NULL)
-        return;
+    return command_new_using_arg(CmdNames_REXEC, 0, rtask->command, rtask->task_id, cn->core->device_id, rtask->fn_argsig, rtask->data);
+}
 
-    twheel_add_event(t, TW_EVENT_REXEC_TIMEOUT, clone_taskid(&(rtask->task_id)), REXEC_TIMEOUT);
-    switch (rtask->level) {
+void remote_task_send(tboard_t *t, int level, command_t *cmd)
+{
+    cnode_t *cn = (cnode_t *)t->cnode;
+
+    trace_event(TRACE_REXEC_SEND, cmd->task_id, NULL, level);
+
+    switch (level) {
         case ALL_LEVELS:
-            send_command_to_server(cn->devserv->mqtt);
+            send_command_to_server(cn->devserv);
             for(int i = 0; i < cn->eservnum; i++) 
-                send_command_to_server(cn->edgeserv[i]->mqtt);
+                send_command_to_server(cn->edgeserv[i]);
             if (cn->cloudserv != NULL)
-                send_command_to_server(cn->cloudserv->mqtt);
+                send_command_to_server(cn->cloudserv);
         break;
 
         case DEVICE_LEVEL:
-            send_command_to_server(cn->devserv->mqtt);
+            send_command_to_server(cn->devserv);
         break;
 
         case EDGE_LEVEL:
             for(int i = 0; i < cn->eservnum; i++) 
-                send_command_to_server(cn->edgeserv[i]->mqtt);
+                send_command_to_server(cn->edgeserv[i]);
         break;
 
         case CLOUD_LEVEL:
             if (cn->cloudserv != NULL)
-                send_command_to_server(cn->cloudserv->mqtt);
+                send_command_to_server(cn->cloudserv);
         break;
     }
+    command_free(cmd);
+}
+
+void remote_task_hedge(tboard_t *t, remote_task_t *rtask)
+{
+    command_t *cmd = remote_task_command(t, rtask);
+
+    rtask->hedge = HEDGE_NONE;
+    twheel_timer_arm(t, &(rtask->timer), getcurtime() + REXEC_TIMEOUT);
+    // one encoding for both levels
+    command_hold(cmd);
+    remote_task_send(t, EDGE_LEVEL, cmd);
+    remote_task_send(t, CLOUD_LEVEL, cmd);
+}
+
+void remote_task_answered(tboard_t *t, remote_task_t *rtask, void *serv)
+{
+    cnode_t *cn = (cnode_t *)t->cnode;
+    server_t *s = (server_t *)serv;
+    command_t *cmd;
+    uint64_t n;
+
+    if (s != NULL && rtask->sent != 0) {
+        lathist_record(&(s->rtt), (uint64_t)(getcurtime() - rtask->sent) * 1000);
+        n = atomic_load_explicit(&(s->rtt.count), memory_order_relaxed);
+        if (n >= HEDGE_MIN_SAMPLES && n % HEDGE_REFRESH == 0) {
+            long int us = (long int)(lathist_percentile(&(s->rtt), HEDGE_PERCENTILE) / 1000);
+            us = us < HEDGE_MIN_US ? HEDGE_MIN_US : (us > REXEC_TIMEOUT / 2 ? REXEC_TIMEOUT / 2 : us);
+            atomic_store_explicit(&(s->stagger), us, memory_order_relaxed);
+        }
+    }
+    // only the device J has a staggered request, and it is the one answering
+    if (rtask->level != ALL_LEVELS || rtask->hedge == HEDGE_STAGGERED || cn == NULL)
+        return;
+    cmd = command_new(CmdNames_REXEC_CANCEL, 0, rtask->command, rtask->task_id, cn->core->device_id, "");
+    if (cn->devserv != s)
+        send_command_to_server(cn->devserv);
+    for (int i = 0; i < cn->eservnum; i++)
+        if (cn->edgeserv[i] != s)
+            send_command_to_server(cn->edgeserv[i]);
+    if (cn->cloudserv != NULL && cn->cloudserv != s)
+        send_command_to_server(cn->cloudserv);
+    command_free(cmd);
+}
+
+void remote_task_flush(tboard_t *t)
+{
+    cnode_t *cn = (cnode_t *)t->cnode;
+
+    if (cn == NULL || cn->devserv == NULL)
+        return;
+    wire_flush(&(cn->devserv->wreq));
+    for (int i = 0; i < cn->eservnum; i++)
+        wire_flush(&(cn->edgeserv[i]->wreq));
+    if (cn->cloudserv != NULL)
+        wire_flush(&(cn->cloudserv->wreq));
+}
+
+// how long an ALL_LEVELS request waits for the device J before it goes to the others
+static long int remote_task_stagger(tboard_t *t)
+{
+    cnode_t *cn = (cnode_t *)t->cnode;
+
+    if (cn == NULL || !cn->args->hedge || cn->devserv == NULL || (cn->eservnum == 0 && cn->cloudserv == NULL))
+        return 0;
+    return atomic_load_explicit(&(cn->devserv->stagger), memory_order_relaxed);
+}
+
+void remote_task_place(tboard_t *t, remote_task_t *rtask)
+{
+    long int stagger;
+
+    // check for valid taskboard and remote task
+    if (t == NULL || rtask == NULL)
+        return;
+
+    rtask->sent = getcurtime();
+    stagger = rtask->level == ALL_LEVELS ? remote_task_stagger(t) : 0;
+    if (stagger > 0) {
+        rtask->hedge = HEDGE_STAGGERED;
+        twheel_timer_arm(t, &(rtask->timer), rtask->sent + stagger);
+        remote_task_send(t, DEVICE_LEVEL, remote_task_command(t, rtask));
+        return;
+    }
+    twheel_timer_arm(t, &(rtask->timer), rtask->sent + REXEC_TIMEOUT);
+    remote_task_send(t, rtask->level, remote_task_command(t, rtask));
     /*
      * The rtask was freed here.. not anymore we wait for the response to come from 
      * the remote side. Then the entry should be removed from the task list and it 
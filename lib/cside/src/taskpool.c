@@ -0,0 +1,212 @@
+/*
+ * Recycling pool for task_t objects and coroutine stacks. Every task used to
+ * calloc a task_t and malloc a full coroutine stack in mco_create(), only to free
+ * both again when the task died. The pool keeps the released blocks on free lists
+ * so that task creation on a warm task board does not go to the system allocator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "tboard.h"
+#include "taskpool.h"
+
+// Coroutine blocks carry a small header that records the block size. The free
+// callback of minicoro does not tell us the size, and blocks of other sizes must
+// not end up in the free list.
+#define POOL_HDR_SIZE           16
+
+#define block_to_user(b)        ((void *)((char *)(b) + POOL_HDR_SIZE))
+#define user_to_block(u)        ((void *)((char *)(u) - POOL_HDR_SIZE))
+#define block_size(b)           (*(size_t *)(b))
+
+static void *coro_block_new(size_t size)
+{
+    void *b = malloc(POOL_HDR_SIZE + size);
+    if (b != NULL)
+        block_size(b) = size;
+    return b;
+}
+
+// the class serving blocks of @coro_size, NULL if there is none
+static pool_class_t *coro_class(taskpool_t *p, size_t coro_size)
+{
+    for (int i = 0; i < TASKPOOL_CLASSES; i++)
+        if (p->cls[i].coro_size == coro_size)
+            return &(p->cls[i]);
+    return NULL;
+}
+
+taskpool_t *taskpool_create(size_t stack_size, int low_mark, int high_mark)
+{
+    taskpool_t *p = (taskpool_t *)calloc(1, sizeof(taskpool_t));
+    pool_class_t *def;
+    assert(p != NULL);
+    assert(pthread_mutex_init(&(p->lock), NULL) == 0);
+
+    // let minicoro compute the full block sizes (coroutine + context + storage + stack)
+    for (int i = 0; i < TASKPOOL_CLASSES; i++) {
+        mco_desc d = mco_desc_init(NULL, i < TASKPOOL_CLASSES - 1 ? (size_t)STACK_SIZE_MIN << i : stack_size);
+        p->cls[i].stack_size = d.stack_size;
+        p->cls[i].coro_size = d.coro_size;
+    }
+    def = &(p->cls[TASKPOOL_CLASSES - 1]);
+    p->low_mark = low_mark;
+    p->high_mark = high_mark < low_mark ? low_mark : high_mark;
+
+    // only the default class is preallocated, the others fill up as their tasks end
+    for (int i = 0; i < low_mark; i++) {
+        pool_block_t *t = (pool_block_t *)calloc(1, sizeof(task_t));
+        void *c = coro_block_new(def->coro_size);
+        if (t == NULL || c == NULL) {
+            free(t);
+            free(c);
+            break;
+        }
+        t->next = p->tasks;
+        p->tasks = t;
+        p->ntasks++;
+        ((pool_block_t *)block_to_user(c))->next = def->coros;
+        def->coros = block_to_user(c);
+        def->ncoros++;
+    }
+    return p;
+}
+
+size_t taskpool_stack_size(taskpool_t *p, size_t want)
+{
+    size_t def;
+
+    if (want == 0 || p == NULL)
+        return want;
+    def = p->cls[TASKPOOL_CLASSES - 1].stack_size;
+    if (want > def)
+        return want;
+    for (int i = 0; i < TASKPOOL_CLASSES - 1; i++)
+        if (want <= p->cls[i].stack_size && p->cls[i].stack_size < def)
+            return p->cls[i].stack_size;
+    return 0;
+}
+
+void taskpool_destroy(taskpool_t *p)
+{
+    pool_block_t *b, *n;
+
+    if (p == NULL)
+        return;
+    pthread_mutex_lock(&(p->lock));
+    for (b = p->tasks; b != NULL; b = n) {
+        n = b->next;
+        free(b);
+    }
+    for (int i = 0; i < TASKPOOL_CLASSES; i++) {
+        for (b = p->cls[i].coros; b != NULL; b = n) {
+            n = b->next;
+            free(user_to_block(b));
+        }
+        p->cls[i].coros = NULL;
+    }
+    p->tasks = NULL;
+    pthread_mutex_unlock(&(p->lock));
+    pthread_mutex_destroy(&(p->lock));
+    free(p);
+}
+
+task_t *taskpool_task_alloc(taskpool_t *p)
+{
+    pool_block_t *b = NULL;
+
+    if (p != NULL) {
+        pthread_mutex_lock(&(p->lock));
+        if ((b = p->tasks) != NULL) {
+            p->tasks = b->next;
+            p->ntasks--;
+            p->hits++;
+        } else
+            p->misses++;
+        pthread_mutex_unlock(&(p->lock));
+    }
+    if (b == NULL)
+        return (task_t *)calloc(1, sizeof(task_t));
+    memset(b, 0, sizeof(task_t));
+    return (task_t *)b;
+}
+
+void taskpool_task_free(taskpool_t *p, task_t *task)
+{
+    pool_block_t *b = (pool_block_t *)task;
+
+    if (task == NULL)
+        return;
+    if (p != NULL) {
+        pthread_mutex_lock(&(p->lock));
+        if (p->ntasks < p->high_mark) {
+            b->next = p->tasks;
+            p->tasks = b;
+            p->ntasks++;
+            b = NULL;
+        } else
+            p->trims++;
+        pthread_mutex_unlock(&(p->lock));
+    }
+    free(b);
+}
+
+void *taskpool_coro_alloc(size_t size, void *allocator_data)
+{
+    taskpool_t *p = (taskpool_t *)allocator_data;
+    pool_class_t *k = p != NULL ? coro_class(p, size) : NULL;
+    pool_block_t *b = NULL;
+
+    if (k != NULL) {
+        pthread_mutex_lock(&(p->lock));
+        if ((b = k->coros) != NULL) {
+            k->coros = b->next;
+            k->ncoros--;
+            p->hits++;
+        } else
+            p->misses++;
+        pthread_mutex_unlock(&(p->lock));
+    }
+    if (b != NULL)
+        return b;
+
+    void *c = coro_block_new(size);
+    return c != NULL ? block_to_user(c) : NULL;
+}
+
+void taskpool_coro_free(void *ptr, void *allocator_data)
+{
+    taskpool_t *p = (taskpool_t *)allocator_data;
+    pool_class_t *k;
+    void *c;
+
+    if (ptr == NULL)
+        return;
+    c = user_to_block(ptr);
+    if (p != NULL && (k = coro_class(p, block_size(c))) != NULL) {
+        pthread_mutex_lock(&(p->lock));
+        if (k->ncoros < p->high_mark) {
+            ((pool_block_t *)ptr)->next = k->coros;
+            k->coros = (pool_block_t *)ptr;
+            k->ncoros++;
+            c = NULL;
+        } else
+            p->trims++;
+        pthread_mutex_unlock(&(p->lock));
+    }
+    free(c);
+}
+
+void taskpool_print_stats(taskpool_t *p, FILE *fptr)
+{
+    if (p == NULL)
+        return;
+    pthread_mutex_lock(&(p->lock));
+    fprintf(fptr, "Taskpool: %ld hits, %ld misses, %ld trims; %d tasks cached [low %d, high %d]; stacks cached:",
+        p->hits, p->misses, p->trims, p->ntasks, p->low_mark, p->high_mark);
+    for (int i = 0; i < TASKPOOL_CLASSES; i++)
+        fprintf(fptr, " %d x %zuK", p->cls[i].ncoros, p->cls[i].stack_size / 1024);
+    fprintf(fptr, "\n");
+    pthread_mutex_unlock(&(p->lock));
+}
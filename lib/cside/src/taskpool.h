@@ -0,0 +1,125 @@
+#ifndef __TASKPOOL_H__
+#define __TASKPOOL_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+struct task_t;
+
+#define TASKPOOL_CLASSES            3
+/**
+ * Configurable Macros
+ * @TASKPOOL_CLASSES:   number of coroutine stack sizes with a free list of their own,
+ *                      STACK_SIZE_MIN doubling up to the default stack of the pool
+ */
+
+/**
+ * pool_block_t - Free list link overlaid on a recycled block
+ * @next: next free block in the list
+ */
+typedef struct pool_block_t {
+    struct pool_block_t *next;
+} pool_block_t;
+
+/**
+ * pool_class_t - Free coroutine blocks of one stack size
+ * @coros:      free coroutine blocks (mco_coro + context + storage + stack)
+ * @stack_size: stack size of the class
+ * @coro_size:  size of the blocks, as minicoro computes it for @stack_size
+ * @ncoros:     number of blocks on @coros
+ */
+typedef struct pool_class_t {
+    pool_block_t *coros;
+    size_t stack_size;
+    size_t coro_size;
+    int ncoros;
+} pool_class_t;
+
+/**
+ * taskpool_t - Recycling pool for task_t objects and coroutine stacks
+ * @lock:       protects the free lists and counters
+ * @cls:        coroutine blocks by stack size, the last class holds the default stack
+ * @tasks:      free task_t objects
+ * @ntasks:     number of objects on @tasks
+ * @low_mark:   number of blocks preallocated at creation time
+ * @high_mark:  maximum number of free blocks cached per list, extra blocks go back to the system
+ * @hits:       allocations served from the free lists
+ * @misses:     allocations that fell back to malloc()
+ * @trims:      releases that went back to the system because of @high_mark
+ *
+ * A pool is owned by the task board. Coroutine blocks are handed to minicoro
+ * through the malloc_cb/free_cb hooks of mco_desc with the pool as allocator_data,
+ * so mco_create() and mco_destroy() never touch the system allocator while the pool
+ * has free blocks. Functions that declare a smaller stack (function_t.stack_size) get
+ * their blocks from a smaller class, blocks of any other size bypass the free lists.
+ */
+typedef struct taskpool_t {
+    pthread_mutex_t lock;
+    pool_class_t cls[TASKPOOL_CLASSES];
+    pool_block_t *tasks;
+    int ntasks;
+    int low_mark;
+    int high_mark;
+    long hits;
+    long misses;
+    long trims;
+} taskpool_t;
+
+taskpool_t *taskpool_create(size_t stack_size, int low_mark, int high_mark);
+/**
+ * taskpool_create() - Creates a pool and preallocates @low_mark task_t objects and
+ *                     coroutine blocks able to hold a stack of @stack_size bytes
+ * @stack_size: default coroutine stack size of the pool (0 selects MCO_DEFAULT_STACK_SIZE)
+ * @low_mark:   number of objects to preallocate
+ * @high_mark:  maximum number of free objects to keep cached
+ *
+ * Return: pointer to the pool, freed in taskpool_destroy()
+ */
+
+void taskpool_destroy(taskpool_t *p);
+/**
+ * taskpool_destroy() - Releases all cached blocks and the pool itself. Blocks still held
+ *                      by live tasks must have been returned before this is called.
+ */
+
+size_t taskpool_stack_size(taskpool_t *p, size_t want);
+/**
+ * taskpool_stack_size() - Rounds a stack size up to the smallest class that holds it
+ * @want: stack size a function asked for, 0 for the default
+ *
+ * Return: stack size to hand to mco_desc_init(), 0 for the default stack. Sizes above
+ *         the default are returned as they are and get blocks outside of the pool.
+ */
+
+struct task_t *taskpool_task_alloc(taskpool_t *p);
+/**
+ * taskpool_task_alloc() - Returns a zeroed task_t, from the free list if possible
+ */
+
+void taskpool_task_free(taskpool_t *p, struct task_t *task);
+/**
+ * taskpool_task_free() - Returns @task to the pool. A NULL @p frees to the system.
+ */
+
+void *taskpool_coro_alloc(size_t size, void *allocator_data);
+void taskpool_coro_free(void *ptr, void *allocator_data);
+/**
+ * taskpool_coro_alloc(), taskpool_coro_free() - minicoro allocation hooks
+ * @allocator_data: pointer to the taskpool_t
+ *
+ * Installed into mco_desc.malloc_cb and mco_desc.free_cb by taskpool_desc_attach().
+ */
+
+#define taskpool_desc_attach(p, d) do {                 \
+    (d)->malloc_cb = taskpool_coro_alloc;               \
+    (d)->free_cb = taskpool_coro_free;                  \
+    (d)->allocator_data = (p);                          \
+} while (0)
+
+void taskpool_print_stats(taskpool_t *p, FILE *fptr);
+/**
+ * taskpool_print_stats() - Prints hit/miss/trim counters and the free list lengths
+ */
+
+#endif
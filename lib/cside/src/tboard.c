@@ -3,10 +3,17 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #include "tboard.h"
 #include "command.h"
 #include "mqtt_adapter.h"
 #include "core.h"
+#include "future.h"
 
 #define MINICORO_IMPL
 #define MCO_USE_ASM
@@ -26,7 +33,7 @@
 //////////// TBOARD FUNCTIONS //////////////
 ////////////////////////////////////////////
 
-tboard_t* tboard_create(void *cnode, int secondary_queues)
+tboard_t* tboard_create(void *cnode, int secondary_queues, int qtype)
 {
     // create tboard
     assert(secondary_queues <= MAX_SECONDARIES);
@@ -45,46 +52,49 @@ tboard_t* tboard_create(void *cnode, int secondary_queues)
     assert(pthread_mutex_init(&(tboard->hmutex), NULL) == 0);
     assert(pthread_mutex_init(&(tboard->emutex), NULL) == 0);
     assert(pthread_cond_init(&(tboard->tcond), NULL) == 0);
-    assert(pthread_mutex_init(&(tboard->twmutex), NULL) == 0);
-    assert(pthread_mutex_init(&(tboard->schmutex), NULL) == 0);
 
     // create and initialize primary queues
     assert(pthread_mutex_init(&(tboard->pmutex), NULL) == 0);
-    assert(pthread_cond_init(&(tboard->pcond), NULL) == 0);
 
     tboard->cnode = cnode;
-    tboard->pqueue_sy = queue_create();
-    tboard->pqueue_rt = queue_create();
-    tboard->pqueue_ba = queue_create();
-    tboard->iq = queue_create();
+    tboard->qtype = qtype;
+    taskq_init(&(tboard->pqueue_sy), qtype, &(tboard->pmutex), READY_QUEUE_RING);
+    taskq_init(&(tboard->pqueue_rt), qtype, &(tboard->pmutex), READY_QUEUE_RING);
+    assert(dheap_init(&(tboard->syheap), 64));
+    assert(dheap_init(&(tboard->rtheap), 64));
+    taskq_init(&(tboard->pqueue_ba), qtype, &(tboard->pmutex), READY_QUEUE_RING);
+    taskq_init(&(tboard->iq), qtype, &(tboard->iqmutex), INTERNAL_QUEUE_RING);
 
-    queue_init(&(tboard->pqueue_sy));
-    queue_init(&(tboard->pqueue_rt));
-    queue_init(&(tboard->pqueue_ba));
-    queue_init(&(tboard->iq));
+    taskq_init(&(tboard->sinject), qtype, &(tboard->iqmutex), READY_QUEUE_RING);
 
     // set number of secondaries tboard has
     tboard->sqs = secondary_queues;
 
     for (int i=0; i<secondary_queues; i++) {
-        // create & initialize secondary i's mutex, cond, queues
+        // create & initialize secondary i's mutex and queues
         assert(pthread_mutex_init(&(tboard->smutex[i]), NULL)==0);
-        assert(pthread_cond_init(&(tboard->scond[i]), NULL) == 0);
 
-        tboard->squeue[i] = queue_create();
-
-        queue_init(&(tboard->squeue[i]));
+        assert(wsdeque_init(&(tboard->sdeque[i]), MAX_TASKS));
+        taskq_init(&(tboard->shome[i]), qtype, &(tboard->smutex[i]), READY_QUEUE_RING);
     }
 
     tboard->status = 0; // indicate its been created but not started
     tboard->shutdown = 0;
     tboard->task_count = 0; // how many concurrent tasks are running
     tboard->exec_hist = NULL;
-
-    tboard->task_table = NULL;
-    tboard->twheel = twheel_init();
-    learn_sleeping(&(tboard->sleeper), 1000000);
-    install_next_schedule(tboard, 0);
+    admit_init(&(tboard->admit), MAX_TASKS);
+
+    tboard->task_table = rtable_create();
+    tboard->tpool = taskpool_create(STACK_SIZE, TASKPOOL_LOW_WATERMARK, TASKPOOL_HIGH_WATERMARK);
+    twheel_init(tboard);
+    // the pExecutor trains the sleeper itself, the wakeup latency is per thread
+    learn_sleeping(&(tboard->sleeper), 0);
+    topo_init(&(tboard->topo));
+    tboard->slotlat = (lathist_t *)calloc(2, sizeof(lathist_t));
+    assert(tboard->slotlat != NULL);
+    // no schedule until one is put, tboard_put_schedule()
+    atomic_init(&(tboard->schednext), NULL);
+    tboard->sched = NULL;
     return tboard; // return address of tboard in memory
 }
 
@@ -93,15 +103,21 @@ void tboard_start(tboard_t *tboard)
     // we want to start the threads for tboard executor
     // for this we allocate argument sent to executor function so it knows what to do
     // then we create the thread
+    char desc[128];
+
     if (tboard == NULL || tboard->status != 0)
         return; // only want to start an initialized tboard
     
+    // the timing wheel is the pExecutor's from here on
+    atomic_store_explicit(&(tboard->twowned), 1, memory_order_release);
     // create primary executor
     exec_t *primary = (exec_t *)calloc(1, sizeof(exec_t));
     primary->type = PRIMARY_EXECUTOR;
     primary->num = 0;
     primary->tboard = tboard;
-    pthread_create(&(tboard->primary), NULL, executor, primary);
+    sstack_init(&(primary->sstack), -1);
+    topo_spawn(&(tboard->topo), &(tboard->primary), executor, primary, true, 0, desc, sizeof(desc));
+    printf("%s\n", desc);
 
     // save it incase we call kill so we can free memory
     tboard->pexect = primary;
@@ -112,7 +128,10 @@ void tboard_start(tboard_t *tboard)
         secondary->type = SECONDARY_EXECUTOR;
         secondary->num = i;
         secondary->tboard = tboard;
-        pthread_create(&(tboard->secondary[i]), NULL, executor, secondary);
+        secondary->seed = i + 1;
+        sstack_init(&(secondary->sstack), i);
+        topo_spawn(&(tboard->topo), &(tboard->secondary[i]), executor, secondary, false, i, desc, sizeof(desc));
+        printf("%s\n", desc);
         // save it incase we call kill so we can free memory
         tboard->sexect[i] = secondary;
     }
@@ -136,63 +155,85 @@ void tboard_shutdown(tboard_t *tboard)
     // lock tmutex. If we get lock, it means that user has taken all necessary data
     // from task board as it should be locked before tboard_kill() is run
     pthread_mutex_lock(&(tboard->tmutex));
-    pthread_mutex_lock(&(tboard->twmutex));
     // destroy mutex and condition variables 
     pthread_mutex_destroy(&(tboard->iqmutex));
     pthread_mutex_destroy(&(tboard->cmutex));
     pthread_mutex_destroy(&(tboard->pmutex));
-    pthread_cond_destroy(&(tboard->pcond)); // broadcasted in tboard_kill()
-    for (int i=0; i<tboard->sqs; i++) {
+    for (int i=0; i<tboard->sqs; i++)
         pthread_mutex_destroy(&(tboard->smutex[i]));
-        pthread_cond_destroy(&(tboard->scond[i])); // broadcasted in tboard_kill();
-    }
     pthread_cond_destroy(&(tboard->tcond));
 
     // empty task queues and destroy any persisting contexts
+    task_t *task;
+    internal_command_t *ic;
     for (int i=0; i<tboard->sqs; i++) {
-        struct queue_entry *entry = queue_peek_front(&(tboard->squeue[i]));
-        while (entry != NULL) {
-            queue_pop_head(&(tboard->squeue[i]));
-            task_destroy((task_t *)(entry->data)); // destroys task_t and coroutine
-            free(entry);
-            entry = queue_peek_front(&(tboard->squeue[i]));
-        }
-    }
-    struct queue_entry *entry = queue_peek_front(&(tboard->pqueue_sy));
-    while (entry != NULL) {
-        queue_pop_head(&(tboard->pqueue_sy));
-        task_destroy((task_t *)(entry->data)); // destroys task_t and coroutine
-        free(entry);
-        entry = queue_peek_front(&(tboard->pqueue_sy));
-    }
-    entry = queue_peek_front(&(tboard->pqueue_rt));
-    while (entry != NULL) {
-        queue_pop_head(&(tboard->pqueue_rt));
-        task_destroy((task_t *)(entry->data)); // destroys task_t and coroutine
-        free(entry);
-        entry = queue_peek_front(&(tboard->pqueue_rt));
-    }
-    entry = queue_peek_front(&(tboard->pqueue_ba));
-    while (entry != NULL) {
-        queue_pop_head(&(tboard->pqueue_ba));
-        task_destroy((task_t *)(entry->data)); // destroys task_t and coroutine
-        free(entry);
-        entry = queue_peek_front(&(tboard->pqueue_ba));
+        while ((task = wsdeque_pop(&(tboard->sdeque[i]))) != NULL)
+            task_destroy(task); // destroys task_t and coroutine
+        wsdeque_destroy(&(tboard->sdeque[i]));
+        while ((task = taskq_pop(&(tboard->shome[i]))) != NULL)
+            task_destroy(task);
+        taskq_destroy(&(tboard->shome[i]));
     }
+    while ((task = taskq_pop(&(tboard->sinject))) != NULL)
+        task_destroy(task);
+    taskq_destroy(&(tboard->sinject));
+    while ((task = taskq_pop(&(tboard->pqueue_sy))) != NULL)
+        task_destroy(task);
+    while ((task = taskq_pop(&(tboard->pqueue_rt))) != NULL)
+        task_destroy(task);
+    while ((task = dheap_pop(&(tboard->syheap))) != NULL)
+        task_destroy(task);
+    while ((task = dheap_pop(&(tboard->rtheap))) != NULL)
+        task_destroy(task);
+    while ((task = taskq_pop(&(tboard->pqueue_ba))) != NULL)
+        task_destroy(task);
+    while ((ic = taskq_pop(&(tboard->iq))) != NULL)
+        if (ic->cmd != FUTURE_CMD_WAIT)     // lives in its group of futures
+            internal_command_free(ic);
+    taskq_destroy(&(tboard->pqueue_sy));
+    taskq_destroy(&(tboard->pqueue_rt));
+    dheap_destroy(&(tboard->syheap));
+    dheap_destroy(&(tboard->rtheap));
+    taskq_destroy(&(tboard->pqueue_ba));
+    taskq_destroy(&(tboard->iq));
 
     // unlock tmutex so we can destroy it
     pthread_mutex_unlock(&(tboard->tmutex));
     
-    // free executor arguments
+    // free executor arguments, with the shared stacks the parked tasks were on
+    if (tboard->pexect != NULL) {
+        sstack_print_stats(&(tboard->pexect->sstack), stdout);
+        sstack_destroy(&(tboard->pexect->sstack));
+    }
     free(tboard->pexect);
     for (int i=0; i<tboard->sqs; i++) {
+        if (tboard->sexect[i] != NULL) {
+            sstack_print_stats(&(tboard->sexect[i]->sstack), stdout);
+            sstack_destroy(&(tboard->sexect[i]->sstack));
+        }
         free(tboard->sexect[i]);
     }
     
-    // destroy history mutex
+    // report and destroy history before the task board goes away
+    history_print_records(tboard, stdout);
+    admit_print_stats(&(tboard->admit), stdout);
+    history_print_slots(tboard, stdout);
+    if (tboard->histfile != NULL && !history_dump(tboard, tboard->histfile))
+        tboard_err("tboard_shutdown: Could not write history to %s.\n", tboard->histfile);
     history_destroy(tboard);
+    free(tboard->slotlat);
     // destroy the registry of functions
     destroy_func_registry(tboard);
+    // release cached task objects and coroutine stacks
+    taskpool_print_stats(tboard->tpool, stdout);
+    taskpool_destroy(tboard->tpool);
+    // the wheel holds timers of the remote tasks, it goes first
+    twheel_destroy(tboard);
+    free(tboard->sched);
+    free(schedtab_take(&(tboard->schednext)));
+    // remote tasks that never got a reply
+    rtable_print_stats(tboard->task_table, stdout);
+    rtable_destroy(tboard->task_table);
 
     // destroy rest of task board mutexes
     pthread_mutex_destroy(&(tboard->hmutex));
@@ -214,18 +255,16 @@ bool tboard_kill(tboard_t *t)
     // indicate to taskboard that shutdown is occuring
     t->shutdown = 1;
 
-    // queue primary executor thread cancellation, signal condition variable
-    pthread_mutex_lock(&(t->pmutex));
+    // queue primary executor thread cancellation, wake it up so it gets to its cancellation point
     pthread_cancel(t->primary);
-    pthread_cond_signal(&(t->pcond));
-    pthread_mutex_unlock(&(t->pmutex));
+    atomic_fetch_add_explicit(&(t->pwake), 1, memory_order_relaxed);
+    tboard_wake_word(&(t->pwake));
 
     for (int i=0; i<t->sqs; i++) {
-        // queue secondary executor thread i cancellation, signal condition variable
-        pthread_mutex_lock(&(t->smutex[i]));
+        // queue secondary executor thread i cancellation, wake it up
         pthread_cancel(t->secondary[i]);
-        pthread_cond_signal(&(t->scond[i]));
-        pthread_mutex_unlock(&(t->smutex[i]));
+        atomic_fetch_add_explicit(&(t->swake[i]), 1, memory_order_relaxed);
+        tboard_wake_word(&(t->swake[i]));
     }
     
     // wait for executor threads to terminate fully
@@ -274,6 +313,86 @@ int tboard_add_concurrent(tboard_t *t) {
     return ret;
 }
 
+void tboard_wait_word(atomic_uint *word, unsigned int val, long int timeout)
+{
+    struct timespec ts = {.tv_sec = timeout / 1000000, .tv_nsec = (timeout % 1000000) * 1000};
+
+#ifdef __linux__
+    // returns at once if @word moved on since the caller read @val
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, timeout < 0 ? NULL : &ts, NULL, 0);
+#else
+    if (timeout < 0 || timeout > 100) {
+        ts.tv_sec = 0;
+        ts.tv_nsec = 100000;
+    }
+    if (atomic_load_explicit(word, memory_order_acquire) == val)
+        nanosleep(&ts, NULL);
+#endif
+}
+
+void tboard_wake_word(atomic_uint *word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+void tboard_wake_primary(tboard_t *t)
+{
+    // pairs with the fence in the executor park: either we see psleep set,
+    // or the executor sees the work we just pushed
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(t->psleep), memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&(t->pwake), 1, memory_order_relaxed);
+        tboard_wake_word(&(t->pwake)); // only one thread will ever wait on pwake
+    }
+}
+
+void tboard_wake_secondary(tboard_t *t, int num)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(t->ssleep[num]), memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&(t->swake[num]), 1, memory_order_relaxed);
+        tboard_wake_word(&(t->swake[num]));
+    }
+}
+
+void tboard_wake_idle_secondary(tboard_t *t)
+{
+    unsigned int start;
+    int i, sleeping;
+
+    if (t->sqs == 0)
+        return;
+    atomic_thread_fence(memory_order_seq_cst);
+    start = atomic_fetch_add_explicit(&(t->snext), 1, memory_order_relaxed);
+    for (int k = 0; k < t->sqs; k++) {
+        i = (start + k) % t->sqs;
+        sleeping = 1;
+        // claim it, the pushes after ours look for somebody else
+        if (atomic_load_explicit(&(t->ssleep[i]), memory_order_relaxed) &&
+            atomic_compare_exchange_strong(&(t->ssleep[i]), &sleeping, 0)) {
+            atomic_fetch_add_explicit(&(t->swake[i]), 1, memory_order_relaxed);
+            tboard_wake_word(&(t->swake[i]));
+            return;
+        }
+    }
+}
+
+bool tboard_put_schedule(tboard_t *t, sched_t *s)
+{
+    schedtab_t *tab = schedtab_compile(s);
+
+    if (tab == NULL)
+        return false;
+    schedtab_publish(&(t->schednext), tab);
+    // an idle pExecutor without a schedule starts it right away
+    tboard_wake_primary(t);
+    return true;
+}
+
 void tboard_register_func(tboard_t *t, function_t fn) {
     function_t *f = (function_t *)malloc(sizeof(function_t));
     f->fn = fn.fn;
@@ -281,6 +400,8 @@ void tboard_register_func(tboard_t *t, function_t fn) {
     f->fn_sig = strdup(fn.fn_sig);
     f->tasktype = fn.tasktype;
     f->cond = strdup(fn.cond);
+    f->stack_size = taskpool_stack_size(t->tpool, fn.stack_size);
+    f->hist = history_get(t, f->fn_name);
     HASH_ADD_KEYPTR(hh, t->registry, f->fn_name, strlen(f->fn_name), f);
 }
 
@@ -307,6 +428,80 @@ void destroy_func_registry(tboard_t *t) {
 
 
 
+///////////////////////////////////////////////////
+/////////// Shared stack coroutines ///////////////
+///////////////////////////////////////////////////
+
+/*
+ * A coroutine of a task in shared stack mode is only its mco_coro, context and
+ * storage. mco_create() insists on a stack of MCO_MIN_STACK_SIZE inside the block,
+ * so sstack_create() does what mco_init() does without one, and sstack_bind() makes
+ * the context on the shared stack when the task first runs. See sstack.h.
+ */
+
+mco_desc sstack_desc_init(void (*func)(mco_coro *co))
+{
+    mco_desc desc = mco_desc_init(func, 0);
+    _mco_init_desc_sizes(&desc, 0);
+    return desc;
+}
+
+mco_result sstack_create(mco_coro **out, mco_desc *desc)
+{
+    mco_coro *co = (mco_coro *)desc->malloc_cb(desc->coro_size, desc->allocator_data);
+    size_t context_addr, storage_addr;
+
+    *out = NULL;
+    if (co == NULL)
+        return MCO_OUT_OF_MEMORY;
+    memset(co, 0, sizeof(mco_coro));
+    context_addr = _mco_align_forward((size_t)co + sizeof(mco_coro), 16);
+    storage_addr = _mco_align_forward(context_addr + sizeof(_mco_context), 16);
+    memset((void *)context_addr, 0, sizeof(_mco_context));
+    memset((void *)storage_addr, 0, desc->storage_size);
+    co->context = (void *)context_addr;
+    co->storage = (unsigned char *)storage_addr;
+    co->storage_size = desc->storage_size;
+    co->state = MCO_SUSPENDED;
+    co->free_cb = desc->free_cb;
+    co->allocator_data = desc->allocator_data;
+    co->func = desc->func;
+    co->user_data = desc->user_data;
+#ifdef _MCO_USE_TSAN
+    co->tsan_fiber = __tsan_create_fiber(0);
+#endif
+    co->magic_number = MCO_MAGIC_NUMBER;
+    *out = co;
+    return MCO_SUCCESS;
+}
+
+void sstack_bind(mco_coro *co, char *base, size_t size)
+{
+    // mco_yield() checks the stack pointer against these
+    co->stack_base = base;
+    co->stack_size = size;
+    _mco_makectx(co, &(((_mco_context *)co->context)->ctx), base, size);
+}
+
+char *sstack_saved_sp(mco_coro *co)
+{
+#if defined(MCO_USE_ASM) && defined(__x86_64__) && !defined(_WIN32)
+    // _mco_switch() stored it pointing at its return address
+    return (char *)((_mco_context *)co->context)->ctx.rsp;
+#elif defined(MCO_USE_ASM) && defined(__aarch64__)
+    return (char *)((_mco_context *)co->context)->ctx.sp;
+#else
+    (void)co;
+    return NULL;
+#endif
+}
+
+bool sstack_coro_intact(mco_coro *co)
+{
+    return co->magic_number == MCO_MAGIC_NUMBER;
+}
+
+
 ///////////////////////////////////////////////////
 /////////// Logging functionality /////////////////
 ///////////////////////////////////////////////////
@@ -5,13 +5,25 @@
 
 #include <sys/queue.h>
 #include "queue/queue.h"
+#include "queue/taskq.h"
+#include "queue/wsdeque.h"
+#include "queue/dheap.h"
+#include "queue/mpsc.h"
 #include <minicoro.h>
 #include <uthash.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "timeout.h"
 #include "command.h"
 #include "sleeping.h"
+#include "taskpool.h"
+#include "sstack.h"
+#include "rtable.h"
+#include "admit.h"
+#include "schedule.h"
+#include "topology.h"
+#include "trace.h"
 
 
 ///////////////////////////////
@@ -21,10 +33,48 @@
 #define MAX_TASKS 65536 // 8196
 #define MAX_SECONDARIES 10
 #define STACK_SIZE 57344 // 37344 // in bytes
+#define STACK_SIZE_MIN 16384
+/**
+ *  STACK_SIZE is the coroutine stack of a task whose function does not say
+ *  otherwise (function_t.stack_size is 0). The compiler sets a smaller stack
+ *  for functions whose stack use it can bound, never below STACK_SIZE_MIN.
+ *  Coroutine stacks are heap blocks without a guard page, the floor covers
+ *  the runtime, tinycbor and mosquitto frames the compiler cannot see.
+ */
 #define REINSERT_PRIORITY_AT_HEAD 1 
 
+#define READY_QUEUE_TYPE TASKQ_LOCKFREE
+#define READY_QUEUE_RING 4096
+#define INTERNAL_QUEUE_RING 1024
+/**
+ *  Ready queue implementation passed to tboard_create() by the cnode.
+ *  TASKQ_LOCKFREE uses bounded MPMC rings that hold task_t pointers
+ *  directly, TASKQ_LOCKED the mutex guarded STAILQs (see queue/taskq.h).
+ *  READY_QUEUE_RING and INTERNAL_QUEUE_RING are the ring sizes of the
+ *  ready queues and of the internal (reply) queue. What does not fit
+ *  spills into the locked list, so they only need to cover the usual
+ *  occupancy, not MAX_TASKS.
+ */
+
+#define TASKPOOL_LOW_WATERMARK 64
+#define TASKPOOL_HIGH_WATERMARK 1024
+/**
+ *  Task objects and coroutine stacks are recycled through a per-tboard
+ *  pool (see taskpool.h). LOW_WATERMARK blocks are preallocated when the
+ *  task board is created, and at most HIGH_WATERMARK free blocks are kept
+ *  cached; anything released above that goes back to the system.
+ */
+
 #define DEBUG 0
 
+#define SECONDARY_INJECT_POLL_INTERVAL 61
+/**
+ *  Secondary executors run their own deque first (newest task first, for
+ *  locality), then the shared injection queue, then steal from others. Every
+ *  SECONDARY_INJECT_POLL_INTERVAL tasks the injection queue is checked first so
+ *  that yielded tasks and tasks placed by other threads cannot be starved.
+ */
+
 #define SIGNAL_PRIMARY_ON_NEW_SECONDARY_TASK 1
 /**
  *  This will wake up primary executor when a
@@ -73,16 +123,37 @@ enum rtask_status_codes_t {
 
 #define TASK_MAX_RETRIES 3
 
+#define HEDGE_PERCENTILE        95
+#define HEDGE_MIN_SAMPLES       32
+#define HEDGE_REFRESH           16
+#define HEDGE_MIN_US            1000
+/**
+ * Configurable Macros
+ * @HEDGE_PERCENTILE:   with -D an ALL_LEVELS request goes to the device J first, and to
+ *                      the others if it has not answered by this percentile of its latency
+ * @HEDGE_MIN_SAMPLES:  replies of the device J needed before requests are staggered
+ * @HEDGE_REFRESH:      the stagger is recomputed every HEDGE_REFRESH replies
+ * @HEDGE_MIN_US:       shortest stagger, the longest is half of REXEC_TIMEOUT
+ */
+
+enum rtask_hedge_t {
+    HEDGE_NONE,             // sent to every server of its level
+    HEDGE_STAGGERED         // ALL_LEVELS, only the device J has it so far
+};
+
 #define MAX_MSG_LENGTH 254
 #define MAX_ARG_LENGTH 32
 
 #define RT_SLOT_LEN     500            // in microseconds
+#define SLOTLAT_SY      0              // index of @slotlat in tboard_t
+#define SLOTLAT_RT      1
 
 #define RTASK_SEND 1
 #define RTASK_RECV 0
 
 // Set MCO values
 #define MCO_DEFAULT_STACK_SIZE STACK_SIZE
+#define MCO_MIN_STACK_SIZE STACK_SIZE_MIN
 
 
 ///////////////////////////////////////////////////////////////////
@@ -118,9 +189,42 @@ typedef enum
     TW_EVENT_RT_CLOSE,
     TW_EVENT_SY_SCHEDULE,
     TW_EVENT_BEGIN_JSLEEP,
+    TW_EVENT_LOG_FLUSH,
+    TW_EVENT_WIRE_FLUSH,
+    TW_EVENT_FUTURE_TIMEOUT,
     TW_EVENT_REXEC_TIMEOUT
 } twheel_event_t;
 
+#define TWHEEL_POOL_SIZE        64
+/**
+ * Configurable Macros
+ * @TWHEEL_POOL_SIZE:   schedule events preallocated for the pExecutor, the pool grows
+ *                      if a schedule needs more
+ */
+
+#define TW_TIMER_ARM            0x1
+#define TW_TIMER_RELEASE        0x2
+#define TW_TIMER_POSTED         0x4
+
+/**
+ * twheel_timer_t - Timeout embedded in the object it times
+ * @to:     the timeout on the wheel, only the pExecutor touches it
+ * @node:   link in the timer inbox of the task board
+ * @state:  TW_TIMER_* bits. POSTED while @node sits in the inbox, ARM or RELEASE is
+ *          what the pExecutor does with the timer when it takes it out.
+ * @tval:   expiry time for ARM, in microseconds (getcurtime() based)
+ *
+ * The timing wheel belongs to the pExecutor. Other threads never touch it, they post
+ * the timer to the inbox instead, where it stays at most once: posting a timer that is
+ * already posted only updates @tval, so the inbox needs no memory of its own.
+ */
+typedef struct twheel_timer_t {
+    struct timeout to;
+    mpsc_node_t node;
+    atomic_int state;
+    atomic_long tval;
+} twheel_timer_t;
+
 // default schedule cycle in microseconds - 1ms
 #define TW_DEFAULT_SCHEDULE_LEN 5000
 
@@ -133,6 +237,12 @@ typedef enum
  * function_t - Structure containing crucial function information
  * @fn:      function pointer
  * @fn_name: common function name
+ * @hist:    history entry of the function, set once by tboard_register_func() so
+ *           tasks find it without hashing the name. NULL for unregistered functions.
+ * @stack_size: coroutine stack of its tasks in bytes, 0 for STACK_SIZE. The compiler
+ *           estimates it from the call graph and the frame sizes of -fstack-usage, and
+ *           leaves it at 0 when it cannot bound the stack (recursion, alloca, VLAs).
+ *           STACK_SHARED runs the tasks on the shared stack of their executor (sstack.h).
  * 
  * This structure is essential for efficiently recording and serializing function
  * execution information in our history hash table. To pass a function to task_t,
@@ -145,34 +255,19 @@ typedef struct {
     enum task_types_t tasktype;
     const char *fn_sig;
     const char *cond;
+    struct history_t *hist;
+    size_t stack_size;
     UT_hash_handle hh;
 } function_t;
 
 #define TBOARD_FUNC(name, func, sig, ccond, ttype) (function_t){.fn = func, .fn_name = name, .fn_sig = sig, .cond = ccond, .tasktype = ttype}
+#define TBOARD_FUNC_STACK(name, func, sig, ccond, ttype, stack) (function_t){.fn = func, .fn_name = name, .fn_sig = sig, .cond = ccond, .tasktype = ttype, .stack_size = stack}
 
 struct history_t;
+struct lathist_t;
 struct exec_t;
 
 
-#define MAX_RT_SLOTS            8
-#define MAX_SY_SLOTS            8
-
-/**
- * sched_t - Data type for schedules
- * @len:        length of the schedule epoch in microseconds
- * @syslots:    SY task slots - could be 0
- * @systarts:   Starting times of each slot. We don't have end times because slot size is fixed 
- * @rtslots:    RT task slots - could be 0
- * @rtstarts:   Starting times of each RT slot. The slot size is same across all slots. However, RT slots different from SY slots.
- */
-typedef struct sched_t {
-    int len;
-    int syslots;
-    int systarts[MAX_SY_SLOTS];
-    int rtslots;
-    int rtstarts[MAX_RT_SLOTS];
-} sched_t;
-
 /**
  * task_t - Data type containing task information
  * @id:         Task ID representing source of task
@@ -185,7 +280,7 @@ typedef struct sched_t {
  *              @type == PRIMARY_RT_EXEC: Second highest priority (real time task)
  *              @type == PRIMARY_BA_EXEC: Lowest priority task that goes in the primary executor
  *              @type == SECONDARY_BA_EXEC: Secondary executor tasks (only batch goes there)
- * @cpu_time:   CPU time of task execution 
+ * @cpu_time:   Time in ns the task spent running on an executor, summed over its resumes
  * @yields:     Count of yields by task
  * @fn:         Task function to be run by task executor as function_t.
  *              This can be generated easily by macro TBOARD_FUNC(tb_task_f fn);
@@ -195,6 +290,15 @@ typedef struct sched_t {
  *              this should be 0, meaning non-zero values are indictive of allocated user data
  * @hist:       Pointer to history_t object in hash table
  * @parent:     Link to parent task if task type is blocking (NULL value indicates non-blocking)
+ * @qtime:      Time (trace_now()) the task last went into a ready queue
+ * @ctime:      Time (trace_now()) the task was added to the task board
+ * @deadline:   Absolute deadline (trace_now() clock), 0 if the task has none. RT and SY
+ *              tasks run earliest deadline first, see task_sequencer().
+ * @ss:         Shared stack state, for tasks of STACK_SHARED functions or of a task board
+ *              with tboard_t.sstacks set
+ * @cost:       What admit_charge() charged to the backlog for the task, given back when
+ *              it completes
+ * @bcast:      Broadcast snapshots the task holds, one per broadcaster it read (jdata.h)
  * 
  * Structure contains all necessary information relating to a task.
  * 
@@ -204,7 +308,7 @@ typedef struct task_t {
     int id;
     int status;
     int type;
-    int cpu_time;
+    uint64_t cpu_time;
     int yields;
     function_t fn;
     context_t ctx;
@@ -213,13 +317,20 @@ typedef struct task_t {
     void *cmd_obj;
     struct history_t *hist;
     struct task_t *parent;
+    uint64_t qtime;
+    uint64_t ctime;
+    uint64_t deadline;
+    sstack_save_t ss;
+    uint64_t cost;
+    struct bcast_hold_t *bcast;
 } task_t;
 
 
 typedef enum {
     TASK_MODE_REMOTE,
     TASK_MODE_REMOTE_NB,
-    TASK_MODE_SLEEPING
+    TASK_MODE_SLEEPING,
+    TASK_MODE_FUTURE
 } remote_task_mode_t;
 
 /**
@@ -230,6 +341,15 @@ typedef enum {
  * @data_size:    size of data/response. non-zero value indicative of alloc'd data 
  * @calling_task: task_t pointer to task that issued remote task
  * @mode:     indicate the type of remote interaction the task would have.
+ * @wake:     TASK_MODE_SLEEPING: time to wake up at, getcurtime() based
+ * @timer:    REXEC timeout, or the wake up of a sleep. It lives in the remote task, so a
+ *            reply cancels it in O(1) and no timeout event is allocated per request.
+ *            Remote tasks that were placed are only freed by the pExecutor (see
+ *            twheel_release_rtask()), which owns the timer.
+ * @future:   TASK_MODE_FUTURE: the future the reply resolves (see future.h), the
+ *            calling task is parked on its group instead of on the remote task
+ * @sent:     when the request last went out, getcurtime() based
+ * @hedge:    HEDGE_STAGGERED while the other servers of ALL_LEVELS wait for @timer
   * 
  * Any remote interface must be able to pull this from outgoing task queue and interpret it.
  * Once request has been fulfilled, it must be placed back into the incoming task queue
@@ -238,7 +358,7 @@ typedef enum {
  * is received. Otherwise, it will be placed back into the appropriate ready queue after task is
  * issued by MQTT adapter.
  */
-typedef struct {
+typedef struct remote_task_t {
     int status;
     long int task_id;
     char command[MAX_MSG_LENGTH]; 
@@ -249,15 +369,17 @@ typedef struct {
     int retries;
     int level;
     char fn_argsig[MAX_ARG_LENGTH];
-    UT_hash_handle  hh;
+    long int wake;
+    twheel_timer_t timer;
+    struct future_t *future;
+    long int sent;
+    int hedge;
 } remote_task_t;
 
 /**
  * tboard_t - Task Board object.
  * @primary:    Thread of primary task executor (pExecutor)
  * @secondary:  Threads of secondary task executors (sExecutor)
- * @pcond:      Condition variable of pExecutor
- * @scond:      Condition variables of sExecutor
  * @pmutex:     Mutex of pExecutor
  * @smutex:     Mutexs of sExecutor
  * @cmutex:     Task count mutex, locked when changing concurrent task count
@@ -265,15 +387,44 @@ typedef struct {
  * @tcond:      Task board condition variable. This signals once all task executor threads
  *              have been joined in tboard_destroy()
  * @emutex:     Task board exit mutex, locking only when shutdown initializes. 
- * @pqueue:     Primary task ready queue
- * @squeue:     Secondary task ready queues
+ * @pqueue:     Primary task ready queue. The SY and RT queues are inboxes, task_sequencer()
+ *              moves their tasks into @syheap and @rtheap.
+ * @syheap:     SY tasks in deadline order, only the pExecutor touches it
+ * @rtheap:     RT tasks in deadline order, only the pExecutor touches it
+ * @sdeque:     Work-stealing deques of the sExecutors, only sExecutor i pushes/pops @sdeque[i]
+ * @sinject:    Secondary injection queue for tasks placed by other threads and yielded tasks
+ * @shome:      Tasks tied to sExecutor i because their frames are on its shared stack
+ * @iq:         Internal command queue (REXEC replies from the message processor)
+ * @qtype:      Ready queue implementation, TASKQ_LOCKED or TASKQ_LOCKFREE
+ * @psleep:     Set while pExecutor is about to park, producers only wake it if set
+ * @pwake:      Futex word the parked pExecutor waits on, bumped by every wakeup
+ * @ssleep:     Same as @psleep for each sExecutor. tboard_wake_idle_secondary() clears it
+ *              when it picks the sExecutor, so the next wakeup goes to another one
+ * @swake:      Same as @pwake for each sExecutor
+ * @snext:      Where tboard_wake_idle_secondary() starts looking for a parked sExecutor
  * @msg_mutex:  Message queue mutex, locking only when modifying message queues or using @msg_cond
  * @msg_cond:   Message queue condition variable, used for external MQTT adapter to sleep on
  * @sqs:        Number of secondary ready queues and executors
  * @task_count: Tracks the number of concurrent tasks running in task board
  * @exec_hist:  Task execution history hash table
+ * @histfile:   history_dump() target at shutdown, NULL to only print the records
  * @pexect:     pointer to pExecutor argument
  * @sexect:     pointer to sExecutor arguments
+ * @tpool:      Recycling pool for task_t objects and coroutine stacks
+ * @twheel:     Timing wheel, owned by the pExecutor, nobody else touches it
+ * @twinbox:    Timers posted to the pExecutor by other threads, see twheel_timer_t
+ * @twpool:     Free schedule events of the pExecutor, linked through callback.arg
+ * @twowned:    Set by tboard_start(), from then on only the pExecutor owns @twheel
+ * @schednext:  Schedule published by tboard_put_schedule(), not yet taken by the pExecutor
+ * @sched:      Schedule the pExecutor runs, NULL until there is one
+ * @schedpos:   Cursor of the pExecutor in @sched, the slot @schedto is armed for
+ * @epoch:      Start of the current epoch of @sched (us, getcurtime() based)
+ * @schedto:    Wheel timer of the slot under the cursor
+ * @sleeper:    Wakeup latency estimate of the pExecutor, for precise slot starts
+ * @topo:       Placement of the executor threads, applied by tboard_start()
+ * @slotlat:    How late the SY and RT slots started (SLOTLAT_SY, SLOTLAT_RT), pExecutor writes
+ * @sstacks:    Run every task on the shared stack of its executor, set before tboard_start()
+ * @admit:      Admission control of remote calls, see admit_check()
  * @status:     Task board status.
  *              @status == 0: Task Board has been created
  *              @status == 1: Task Board has started
@@ -293,9 +444,6 @@ typedef struct {
     pthread_t primary;
     pthread_t secondary[MAX_SECONDARIES];
 
-    pthread_cond_t pcond;
-    pthread_cond_t scond[MAX_SECONDARIES];
-
     pthread_mutex_t pmutex;
     pthread_mutex_t smutex[MAX_SECONDARIES];
 
@@ -307,14 +455,23 @@ typedef struct {
 
     pthread_mutex_t emutex;
     pthread_mutex_t hmutex;
-    pthread_mutex_t twmutex;
-    pthread_mutex_t schmutex;
 
-    struct queue pqueue_sy;
-    struct queue pqueue_rt;
-    struct queue pqueue_ba;
-    struct queue squeue[MAX_SECONDARIES];
-    struct queue iq;
+    taskq_t pqueue_sy;
+    taskq_t pqueue_rt;
+    taskq_t pqueue_ba;
+    dheap_t syheap;
+    dheap_t rtheap;
+    wsdeque_t sdeque[MAX_SECONDARIES];
+    taskq_t sinject;
+    taskq_t shome[MAX_SECONDARIES];
+    taskq_t iq;
+    int qtype;
+
+    atomic_int psleep;
+    atomic_uint pwake;
+    atomic_int ssleep[MAX_SECONDARIES];
+    atomic_uint swake[MAX_SECONDARIES];
+    atomic_uint snext;
 
     int sqs;
     void *cnode;
@@ -324,17 +481,31 @@ typedef struct {
     int task_count;
 
     struct history_t *exec_hist;
+    const char *histfile;
 
     struct exec_t *pexect;
     struct exec_t *sexect[MAX_SECONDARIES];
 
+    taskpool_t *tpool;
+
     int shutdown; // should be set to 0 unless told to end after all tasks are completed
     int status;
 
-    remote_task_t *task_table;
+    rtable_t *task_table;
     struct timeouts *twheel;
-    sched_t sched;
+    mpsc_t twinbox;
+    struct timeout *twpool;
+    atomic_int twowned;
+    _Atomic(schedtab_t *) schednext;
+    schedtab_t *sched;
+    int schedpos;
+    long int epoch;
+    struct timeout schedto;
     sleeper_t sleeper;
+    exec_topo_t topo;
+    struct lathist_t *slotlat;
+    bool sstacks;
+    admit_t admit;
 
 } tboard_t;
 
@@ -343,6 +514,8 @@ typedef struct {
  * @type:   indicates whether task executor is primary or secondary.
  * @num:    If TExec is sExecutor, then @num identifies sExecutor.
  * @tboard: Reference to task board.
+ * @sstack: Shared stack of the executor, for tasks in shared stack mode
+ * @task:   Task the executor is running, NULL between tasks
  * 
  * This type is exclusively used by tboard_start(), where it is created, and by tboard_destroy() where
  * it is freed.
@@ -353,8 +526,20 @@ typedef struct exec_t { // passed to executor thread so it knows what to do
     int type;
     int num;
     tboard_t *tboard;
+    unsigned int ticks;     // tasks run, paces polling of the injection queue
+    unsigned int seed;      // victim selection for work stealing
+    sstack_t sstack;
+    struct task_t *task;
 } exec_t;
 
+/**
+ * current_exec - exec_t of the executor running on this thread, NULL on other threads
+ *
+ * task_place() uses this to place new secondary tasks on the deque of the creating
+ * sExecutor instead of the shared injection queue.
+ */
+extern __thread exec_t *current_exec;
+
 
 
 ///////////////////////////////////////////////
@@ -379,16 +564,18 @@ void task_sequencer(tboard_t *tboard);
 /** task_sequencer() - TSeq; Rearranges ready queues for priority task execution.
  * @tboard: pointer to taskboard object.
  * 
- * Not fully implemented, the idea of this function is to resequence the ready queues
- * so that tasks with higher priorities and/or closer deadlines are executed in a
- * timely manner. We run this function in the executor before popping the head from
- * the respective ready queue. 
- * 
- * Under current implementation, it takes remote task responses from @t->msg_recv and places
- * then in the appropriate ready queue.
- * 
- * It is at the discretion of the sequencer to determine if it has been run recently. it
- * is a good idea to resequence the queues when a new priority tasks are added.
+ * Resequences the SY and RT ready queues so that tasks with closer deadlines are
+ * executed first. Producers (and yielding tasks) still push onto @tboard->pqueue_sy and
+ * @tboard->pqueue_rt, which are FIFOs. The pExecutor runs this function before it picks
+ * an SY or RT task: everything waiting in those queues moves into @tboard->syheap and
+ * @tboard->rtheap, ordered by task_t deadline. Tasks without a deadline come after all
+ * tasks that have one, in arrival order, so a node without deadlines behaves as before.
+ *
+ * Deadlines come from the "deadline" field of a REXEC command (microseconds from its
+ * arrival). An RT task without one gets the end of the RT slot it is started in.
+ * Tasks completing after their deadline are counted per function in the history.
+ *
+ * Context: pExecutor only
  */
 
 /////////////////////////////////////////////////
@@ -432,7 +619,7 @@ void *executor(void *arg);
  * Context: Function will run in it's own thread, created in tboard_start().
  * Context: Function will sleep on condition variables described above
  * Context: Function will lock mutexes corresponding to tboard queues that it accesses
- * Context: Function will call history.c functions, locking tboard->hmutex
+ * Context: Function will call history.c functions, which take no lock on this path
  */
 
 
@@ -442,10 +629,11 @@ void *executor(void *arg);
 ///////////// TBoard Definitions /////////////////
 //////////////////////////////////////////////////
 
-tboard_t* tboard_create(void *cnode, int secondary_queues);
+tboard_t* tboard_create(void *cnode, int secondary_queues, int qtype);
 /**
  * tboard_create() - Creates task board object.
  * @secondary_queues: Number of secondary queues tboard should have.
+ * @qtype:            Ready queue implementation (TASKQ_LOCKED or TASKQ_LOCKFREE)
  * 
  * This function allocates and initializes task board object.
  * 
@@ -469,6 +657,9 @@ void tboard_start(tboard_t *tboard);
  * is stored in respective exec_t pointer of tboard object (pexect and sexect for pExecutor and
  * sExecutor respectively).
  * 
+ * Each thread is created placed as @tboard->topo says (see topo_spawn()), and where it
+ * ended up is printed.
+ *
  * Context: Creates threads referenced in @tboard.
  */
 
@@ -484,7 +675,7 @@ void tboard_shutdown(tboard_t *t);
  * * - All task board mutexes and condition variables are destroyed
  * * - All ready queues are emptied and task data is freed
  * * - All message queues are emptied and task+msg data is freed
- * * - Task history hash table is destroyed
+ * * - Task history is printed, dumped to @t->histfile if set, and its hash table destroyed
  * * - Task board object is freed
  * 
  * Context: Function will block thread it is called on until task board threads are terminated
@@ -516,8 +707,7 @@ bool tboard_kill(tboard_t *t);
  * tboard_destroy() allowing program to terminate. 
  * 
  * Context: Executor threads stored in @t->primary and @t->secondary[] are canceled.
- *          As such, all @t->pmutex and @t->smutex[] are locked to signal @t->pcond
- *          and @t->scond[] respectively.
+ *          Their futex words (@t->pwake, @t->swake[]) are bumped to wake them up.
  * Context: Sleeps on @t->tcond, signal occurs once all tasks are joined.
  * Context: @t->emutex is locked to initiate shutdown, effectively blocking tboard_destroy()
  *          from proceeding until after all tasks are joined. Once that occurs, it will signal
@@ -590,6 +780,47 @@ int tboard_add_concurrent(tboard_t *t);
  *         else - @t->task_count after incrementing
  */
 
+void tboard_wake_primary(tboard_t *t);
+void tboard_wake_secondary(tboard_t *t, int num);
+void tboard_wake_idle_secondary(tboard_t *t);
+/**
+ * tboard_wake_primary(), tboard_wake_secondary() - Wake a parked executor after
+ *                                                   work was pushed to one of its queues
+ * @t:   tboard_t pointer of task board.
+ * @num: index of the sExecutor
+ *
+ * tboard_wake_idle_secondary() wakes one parked sExecutor, if any, so that it can
+ * pick up or steal the new work. Idle sExecutors do not spin. The sExecutor is claimed
+ * by clearing its @t->ssleep[] flag, and the search starts at a rotating index, so a
+ * burst of pushes wakes a different sExecutor each time.
+ *
+ * Producers push into the ready queues without holding the executor mutex. An executor
+ * announces that it is about to park through @t->psleep/@t->ssleep[], so these functions
+ * only bump its futex word and make the system call when somebody may actually be sleeping.
+ *
+ * Context: takes no lock
+ */
+
+void tboard_wait_word(atomic_uint *word, unsigned int val, long int timeout);
+void tboard_wake_word(atomic_uint *word);
+/**
+ * tboard_wait_word() - Sleeps while @word still holds @val, for at most @timeout
+ *                      microseconds (forever if negative). Spurious returns are possible.
+ * tboard_wake_word() - Wakes a thread sleeping on @word, bump @word first.
+ *
+ * A futex on Linux, elsewhere the sleeper polls @word.
+ */
+
+bool tboard_put_schedule(tboard_t *t, sched_t *s);
+/**
+ * tboard_put_schedule() - Compiles @s and hands it to the pExecutor
+ *
+ * The pExecutor switches over at the end of its current epoch, or right away if it
+ * has no schedule yet.
+ *
+ * Return: false if @s is malformed, see schedtab_compile()
+ */
+
 void tboard_register_func(tboard_t *t, function_t fn);
 function_t *tboard_find_func(tboard_t *t, char *fname);
 
@@ -598,6 +829,11 @@ function_t *tboard_find_func(tboard_t *t, char *fname);
 ////////////////////////////////////////////////
 
 void remote_task_free(tboard_t *t, long int taskid);
+/**
+ * remote_task_free() - Removes remote task @taskid from @t->task_table and frees it,
+ *                      if it is still there
+ */
+
 void remote_task_place(tboard_t *t, remote_task_t *rtask);
 /**
  * remote_task_place() - Places remote task into appropriate queue
@@ -605,9 +841,40 @@ void remote_task_place(tboard_t *t, remote_task_t *rtask);
  * @rtask:  remote_task_t pointer of remote task.
  * @send:   boolean value indicating whether remote task is being sent or received.
  * 
- * Places remote task into appropriate queue in task board @t.
- * 
- * Context: locks @t->msg_mutex
+ * Places remote task into appropriate queue in task board @t. The REXEC timeout of
+ * @rtask is armed before the request goes out, @rtask is not touched afterwards
+ * since the reply may already be resolving it on the pExecutor. With -D an ALL_LEVELS
+ * request goes to the device J alone, its timer set to the stagger of the device J.
+ */
+
+void remote_task_hedge(tboard_t *t, remote_task_t *rtask);
+void remote_task_answered(tboard_t *t, remote_task_t *rtask, void *serv);
+/**
+ * remote_task_hedge() - Sends a staggered ALL_LEVELS request to the edge and cloud
+ *                       servers, the device J did not answer in time
+ * remote_task_answered() - Records the latency of the server @serv that answered
+ *                          @rtask, and cancels the request at the other servers of an
+ *                          ALL_LEVELS request (REXEC_CANCEL)
+ *
+ * Context: pExecutor only
+ */
+
+command_t *remote_task_command(tboard_t *t, remote_task_t *rtask);
+void remote_task_send(tboard_t *t, int level, command_t *cmd);
+/**
+ * remote_task_command() - Encodes the REXEC request of @rtask
+ *
+ * remote_task_send() publishes @cmd to the servers of @level, each publish holding its
+ * own reference. The reference of the caller is dropped. Servers in the batched mode
+ * get it in their next batch (see wire.h).
+ */
+
+void remote_task_flush(tboard_t *t);
+/**
+ * remote_task_flush() - Publishes the REXECs waiting in the batches of the servers
+ *
+ * Called by the executors when they run out of work, so the requests issued during
+ * a pass go out together.
  */
 
 arg_t *remote_task_create(tboard_t *tboard, char *cmd_func, int level, char *fn_argsig, arg_t *qargs, int nargs);
@@ -615,6 +882,8 @@ bool remote_task_create_nb(tboard_t *tboard, char *cmd_func, int level, char *fn
 
 bool sleep_task_create(tboard_t *tboard, int sval);
 
+long int mysnowflake_id();
+
 int preferred_task_level(remote_task_t *rt);
 
 void *blocking_task_create(tboard_t *t, function_t fn, int type, void *args, size_t sizeof_args);
@@ -687,10 +956,7 @@ bool task_create(tboard_t *t, function_t fn, void *args, void *cmd);
  * Tasks created via task_create() are local tasks. Remote procedure tasks (RPC) can be issued by MQTT
  * and are sent in the form of a message, handled by msg_processor().
  * 
- * Context: Process context. Takes and releases task executor mutex (@t->pmutex, @t->smutex[] for 
- *          pExecutor and sExecutor)
- * Context: Process Context. Signal task executor condition variable (@t->pcond, @t->scond[] for 
- *          pExecutor and sExecutor)
+ * Context: Process context. Wakes the parked task executor, see tboard_wake_primary()
  * 
  * Return:
  * * true   - task was added to task board successfully.
@@ -724,10 +990,7 @@ bool task_add(tboard_t *t, task_t *task);
  * Function determines which TExec ready queue task should be added to. It will lock the appropriate
  * TExec mutex and signal condition variable after adding to ready queue.
  * 
- * Context: Process context. Takes and releases task executor mutex (@t->pmutex, @t->smutex[] for 
- *          pExecutor and sExecutor)
- * Context: Process Context. Signal task executor condition variable (@t->pcond, @t->scond[] for 
- *          pExecutor and sExecutor)
+ * Context: Process context. Wakes the parked task executor, see tboard_wake_primary()
  * 
  * Return:
  * * true   - task was added to task board successfully.
@@ -755,12 +1018,13 @@ void *task_get_args();
  * Return: Function arguments issued on task creation, as a void pointer.
  */
 
-void remote_task_destroy(remote_task_t *rtask);
+void remote_task_destroy(tboard_t *t, remote_task_t *rtask);
 /**
  * remote_task_destroy() - Destroy remote task on tboard destroy
- * @rtask: Pointer to remote task to destroy
+ * @rtask: Pointer to remote task to destroy, already removed from @t->task_table
  * 
- * Destroys remote task and any associated local tasks on task board destroy
+ * Destroys remote task and any associated local tasks on task board destroy. The
+ * remote task itself goes through twheel_release_rtask().
  */
 
 void task_destroy(task_t *task);
@@ -804,57 +1068,162 @@ void msg_processor(void *serv, command_t *cmd);
  * indicate that @msg should be returned to the message queue. 
  */
 
+void processor_init(tboard_t *t);
+/**
+ * processor_init() - Prepares the message processor of task board @t
+ * @t: tboard_t pointer to the task board, not started yet
+ *
+ * Resolves the history entry of the internal exec_sync function once, so synchronous
+ * REXEC tasks get it from function_t.hist like registered functions instead of looking
+ * it up under the history mutex on every call.
+ */
+
+void msg_processor_view(void *serv, command_view_t *v);
+/**
+ * msg_processor_view() - Handles a message decoded in place by command_view_init()
+ * @serv: server_t pointer to server interface
+ * @v:    view borrowing the MQTT payload, only valid during the call
+ *
+ * REXEC_ACK/RES/ERR are turned into internal commands directly, and a REXEC decodes its
+ * args only after the function was found, its condition held and admit_check() let it in. Other commands are
+ * materialised with command_from_view() and passed on to msg_processor().
+ */
+
 void send_close_msg(void *serv, char *node_id, long int task_id);
 void send_err_msg(void *serv, char *node_id, long int task_id);
 void send_ack_msg(void *serv, char *node_id, long int task_id, int timeout);
 void send_nak_msg(void *serv, char *node_id, long int task_id);
+void send_busy_msg(void *serv, char *node_id, long int task_id, int retry_ms);
 void send_reg_msg(void *serv, char *node_id, long int task_id);
 
 ////////////////////////////////////////////////////////////////
 /////////////////// Task history functionality /////////////////
 ////////////////////////////////////////////////////////////////
 
+#define HIST_SUB_BITS           5
+#define HIST_MAX_BITS           40
+/**
+ * Configurable Macros
+ * @HIST_SUB_BITS:  every power of two of a latency is split into 2^HIST_SUB_BITS buckets,
+ *                  so a recorded value is off by at most 1/32 (about 3%)
+ * @HIST_MAX_BITS:  largest latency kept apart, 2^40 ns (about 18 minutes). Longer ones
+ *                  land in the last bucket.
+ */
+
+#define HIST_SUB                (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS            ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define HIST_SLOTS              (MAX_SECONDARIES + 1)
+
+/**
+ * lathist_t - Log-linear (HDR style) latency histogram in nanoseconds
+ * @counts: samples per bucket, see hist_bucket()
+ * @count:  number of samples
+ * @sum:    sum of the samples, for the mean
+ * @max:    largest sample
+ *
+ * A histogram has a single writer, the executor that owns it, so the counters are
+ * bumped with relaxed loads and stores instead of atomic read-modify-writes. Readers
+ * may see a sample half recorded, which is fine for statistics.
+ */
+typedef struct lathist_t {
+    atomic_uint counts[HIST_BUCKETS];
+    atomic_ulong count;
+    atomic_ulong sum;
+    atomic_ulong max;
+} lathist_t;
+
+/**
+ * exec_hist_t - What one executor recorded for one function
+ * @qwait:       time spent in a ready queue before each resume
+ * @cpu:         time a task spent running on executors, per completed task
+ * @wall:        time from task_add() to completion, per completed task
+ * @yields:      yields of the tasks run by this executor
+ * @completions: tasks completed by this executor
+ * @misses:      tasks completed by this executor after their deadline
+ */
+typedef struct exec_hist_t {
+    lathist_t qwait;
+    lathist_t cpu;
+    lathist_t wall;
+    atomic_ulong yields;
+    atomic_ulong completions;
+    atomic_ulong misses;
+} exec_hist_t;
+
 /**
  * history_t - tracks task execution history
  * @fn_name:     task function name (also hash table key, must be unique)
- * @mean_t:      average run time in CPU time units for complete executions
- * @mean_yield:  average number of yields for all complete executions
- * @yields:      total number of yields for all executions (incremented at each yield)
  * @executions:  number of exections
- * @completions: number of complete executions
+ * @exec:        per executor statistics, slot 0 is the pExecutor and slot i + 1 sExecutor i.
+ *               Allocated by the executor on its first record.
+ * @cost:        moving average of the CPU time in ns of a task, 0 until one completed.
+ *               Admission control charges it to the backlog.
  * 
  * This type is handled internally by history.c implementation. A pointer must be present in
- * tboard_t task board object to serve as the head of the hash table. Pointers present in
- * task_t task object are references to single entry in hash table, so modifications can be
- * made freely to history_t entry without searching the list.
+ * tboard_t task board object to serve as the head of the hash table. Entries are created
+ * under tboard->hmutex, once per function, and never move until history_destroy(). The
+ * function registry and every task_t keep a pointer to their entry, so the executors
+ * record into it without searching the table or taking a lock.
  */
 
 typedef struct history_t {
     char *fn_name;
-    double mean_t;
-    double mean_yield;
-    double yields;
-    int executions;
-    int completions;
+    atomic_long executions;
+    _Atomic(exec_hist_t *) exec[HIST_SLOTS];
+    atomic_ulong cost;
     UT_hash_handle hh;
 } history_t;
 
 
-void history_record_exec(tboard_t *t, task_t *task, history_t **hist);
+history_t *history_get(tboard_t *t, const char *fn_name);
+/**
+ * history_get() - Returns the history entry of @fn_name, creating it if needed
+ * @t:       tboard_t pointer to task board
+ * @fn_name: function name
+ *
+ * Called when a function is registered, and for tasks of functions that were not.
+ *
+ * Context: locks @t->hmutex in order to modify hash table
+ */
+
+void history_attach(tboard_t *t, task_t *task);
+/**
+ * history_attach() - Links a new task to its history entry and counts the execution
+ * @t:    tboard_t pointer to task board
+ * @task: task_t pointer of task being added
+ *
+ * Uses the entry cached on @task->fn, so registered functions need no lookup. Also
+ * stamps the task creation time for the wall time histogram.
+ */
+
+void history_record_wait(task_t *task, uint64_t wait);
 /**
- * history_record_exec() - Record task execution in history hash table
+ * history_record_wait() - Records the queue wait of a task about to be resumed
+ *
+ * Context: executor threads only, records into the slot of the calling executor
+ */
+
+void history_record_yield(task_t *task);
+void history_record_exec(tboard_t *t, task_t *task);
+/**
+ * history_record_exec() - Record task completion in history hash table
  * @t:    tboard_t pointer to task board
- * @task: task_t pointer of task to record
- * @hist: history_t in hash table to return
+ * @task: task_t pointer of completed task
  * 
- * This function will record execution information to the history_t hash table
- * of the task board @t. If there is currently no record in the hash table,
- * history_record_exec() will add it to the table, attaching entry to @hist. If
- * record does exist, @hist will reflect its location and its data will be modified.
+ * Records the CPU and wall time of @task into the histograms of the calling executor,
+ * and whether it missed its deadline.
+ * history_record_yield() counts a yield the same way.
  * 
- * @hist is expected to point to a null pointer.
- * 
- * Context: locks @t->hmutex in order to modify hash table
+ * Context: executor threads only, takes no lock
+ */
+
+void lathist_record(lathist_t *h, uint64_t v);
+uint64_t lathist_percentile(const lathist_t *h, double p);
+/**
+ * lathist_record() - Adds the sample @v (ns) to @h, from the single writer of @h only
+ * lathist_percentile() - Value in ns below which @p percent of the samples in @h fall
+ *
+ * Return: the upper bound of the bucket holding that sample, 0 if @h is empty
  */
 
 void history_fetch_exec(tboard_t *t, function_t *func, history_t **hist);
@@ -909,13 +1278,34 @@ void history_print_records(tboard_t *t, FILE *fptr);
  * @fptr: file pointer to print records to.
  * 
  * @fptr is assumed opened, and is assumed to be closed. Default value should be stdout.
- * format will print as:
+ * Histograms of all executors are merged, format will print as:
  * 
- * "task 'func_name' completed %d/%d times, yielding %ld times with mean execution time %ld"\
+ * "History: task 'func_name' completed %lu/%ld times, yielding %lu times (average %.2f)[, %lu deadline misses]"
+ * "  queue wait|cpu time|wall time  p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us"
  * 
  * Context: locks @t->hmutex in order to access hash table
  */
 
+void history_print_slots(tboard_t *t, FILE *fptr);
+/**
+ * history_print_slots() - Prints how late the SY and RT slots started, same format
+ */
+
+void history_dump_json(tboard_t *t, FILE *fptr);
+bool history_dump(tboard_t *t, const char *path);
+/**
+ * history_dump_json() - Writes execution history to @fptr as JSON
+ * @t:    tboard_t pointer to task board
+ * @fptr: file pointer to write to
+ *
+ * One object per function with its counters and, for each histogram, the merged
+ * count, mean, p50/p99/p999 and max in ns, per executor percentiles and the non
+ * empty buckets as [upper bound in ns, count] pairs. history_dump() writes the
+ * same to the file @path.
+ *
+ * Context: locks @t->hmutex in order to access hash table
+ */
+
 void destroy_func_registry(tboard_t *t);
 
 
@@ -925,12 +1315,77 @@ void destroy_func_registry(tboard_t *t);
 ////////////////////////////////////////////////////////////////
 
 long int getcurtime();
-struct timeouts *twheel_init();
+void twheel_init(tboard_t *tb);
+void twheel_destroy(tboard_t *tb);
+/**
+ * twheel_init() - Creates the timing wheel of @tb, its timer inbox and event pool
+ *
+ * twheel_destroy() frees them at shutdown, after the executors are gone. Remote tasks
+ * released while their timer was still posted are freed too.
+ */
+
+bool twheel_owner(tboard_t *tb);
+/**
+ * twheel_owner() - True on the thread that may touch the timing wheel: the pExecutor,
+ *                  or the thread setting up the task board before tboard_start()
+ */
+
 struct timeout *twheel_get_next(tboard_t *tb);
-void *clone_taskid(long int *task_id);
+void twheel_put_event(tboard_t *tb, struct timeout *t);
 bool twheel_add_event(tboard_t *tb, twheel_event_t type, void *arg, long int tval);
-bool twheel_delete_timeout(tboard_t *tb, long int *id);
+void twheel_arm_slot(tboard_t *tb, twheel_event_t type, long int tval);
+/**
+ * twheel_add_event() - Adds a schedule event to the wheel
+ * @type:   TW_EVENT_RT_CLOSE
+ * @tval:   absolute time in microseconds (getcurtime() based)
+ *
+ * The event comes from the pool of the pExecutor, which hands it back with
+ * twheel_put_event() once it has expired.
+ *
+ * twheel_arm_slot() arms @tb->schedto for a slot of the schedule instead, @type is
+ * TW_EVENT_RT_SCHEDULE, TW_EVENT_SY_SCHEDULE or TW_EVENT_INSTALL_SCHEDULE (end of the
+ * epoch). Slots fire early and carry @tval as their argument, wait_to_slot() waits for it.
+ *
+ * Context: twheel_owner() only
+ */
+
+void twheel_timer_init(twheel_timer_t *tm, twheel_event_t type, void *arg);
+void twheel_timer_arm(tboard_t *tb, twheel_timer_t *tm, long int tval);
+void twheel_timer_cancel(tboard_t *tb, twheel_timer_t *tm);
+/**
+ * twheel_timer_init(), twheel_timer_arm(), twheel_timer_cancel() - Embedded timers
+ * @tm:      the timer
+ * @type:    TW_EVENT_REXEC_TIMEOUT, TW_EVENT_BEGIN_JSLEEP, TW_EVENT_LOG_FLUSH,
+ *           TW_EVENT_WIRE_FLUSH or TW_EVENT_FUTURE_TIMEOUT, decides what the pExecutor
+ *           does when @tm expires
+ * @arg:     passed along to it (a task id, a logger, a batch, a group of futures)
+ * @tval:    absolute expiry time in microseconds (getcurtime() based)
+ *
+ * Arming a pending timer moves it. twheel_timer_arm() can be called from any thread,
+ * off the pExecutor it posts @tm to the timer inbox and wakes the pExecutor if it is
+ * parked, since the new expiry may come before the one it sleeps until. Cancelling is
+ * for the pExecutor only, as is freeing the object a timer lives in while it is pending.
+ */
+
+void twheel_release_rtask(tboard_t *tb, remote_task_t *rtask);
+/**
+ * twheel_release_rtask() - Cancels the timer of @rtask and frees it
+ *
+ * Only one thread may release a remote task, the one that took it out of the task table.
+ * On the pExecutor the remote task is freed right away, unless its timer still sits in
+ * the inbox. Elsewhere, and in that case, the pExecutor frees it when it takes the timer
+ * out of the inbox.
+ */
+
 void twheel_update_to_now(tboard_t *tb);
+long int twheel_timeout(tboard_t *tb);
+/**
+ * twheel_update_to_now() - Applies the posted timers, then moves the wheel to now
+ * twheel_timeout() - Microseconds from the last update to the next expiry, 0 if some
+ *                    timer has expired already, -1 if the wheel is empty
+ *
+ * Context: pExecutor only
+ */
 
 
 ////////////////////////////////////////////////////////////////
@@ -943,9 +1398,22 @@ void dummy_next_rt_slot(void *arg);
 void dummy_close_rt_slot(void *arg);
 void dummy_next_sleep_event(void *arg);
 void dummy_next_timeout_event(void *arg);
+void dummy_next_log_flush(void *arg);
+void dummy_next_wire_flush(void *arg);
+void dummy_next_future_timeout(void *arg);
 
-void install_next_schedule(tboard_t *tb, long int etime);
-void wait_to_sy_slot(tboard_t *tb, void *arg, long int stime);
+void schedule_advance(tboard_t *tb);
+/**
+ * schedule_advance() - Moves the schedule cursor past the slot that just fired and arms
+ *                      @tb->schedto for the next one
+ *
+ * At the end of an epoch the next epoch starts, with the schedule published meanwhile
+ * if there is one. Nothing is allocated or locked. Also called to start the first
+ * schedule once one was published.
+ *
+ * Context: pExecutor only
+ */
+void wait_to_slot(tboard_t *tb, int slot, long int stime);
 void process_sleep_event(tboard_t *t, void *arg);
 void process_timeout_event(tboard_t *t, void *arg);
 
@@ -0,0 +1,320 @@
+/*
+ * Placement of the executor threads: CPU pinning, the real-time policy of the
+ * pExecutor and the number of CPUs we can actually use. Linux only, elsewhere the
+ * threads are left to the scheduler.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+#include <unistd.h>
+#include "topology.h"
+
+// parses a CPU list like "0-3,6" into @set, returns false if it is malformed
+static bool topo_parse_list(const char *s, bool *set)
+{
+    char *end;
+    long a, b;
+
+    memset(set, 0, TOPO_MAX_CPUS * sizeof(bool));
+    while (*s != '\0' && !isspace((unsigned char)*s)) {
+        a = b = strtol(s, &end, 10);
+        if (end == s)
+            return false;
+        if (*end == '-') {
+            s = end + 1;
+            b = strtol(s, &end, 10);
+            if (end == s)
+                return false;
+        }
+        if (a < 0 || b < a || b >= TOPO_MAX_CPUS)
+            return false;
+        for (long i = a; i <= b; i++)
+            set[i] = true;
+        s = end;
+        if (*s == ',')
+            s++;
+    }
+    return true;
+}
+
+static void topo_set_cpus(exec_topo_t *t, bool *set)
+{
+    t->ncpus = 0;
+    for (int i = 0; i < TOPO_MAX_CPUS; i++)
+        if (set[i])
+            t->cpus[t->ncpus++] = i;
+}
+
+static bool topo_has_cpu(exec_topo_t *t, int cpu)
+{
+    for (int i = 0; i < t->ncpus; i++)
+        if (t->cpus[i] == cpu)
+            return true;
+    return false;
+}
+
+void topo_init(exec_topo_t *t)
+{
+    bool set[TOPO_MAX_CPUS] = {false};
+
+    t->pcpu = -1;
+    t->rtprio = 0;
+    t->pin = false;
+#ifdef __linux__
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int i = 0; i < TOPO_MAX_CPUS && i < CPU_SETSIZE; i++)
+            set[i] = CPU_ISSET(i, &mask);
+        topo_set_cpus(t, set);
+        if (t->ncpus > 0)
+            return;
+    }
+#endif
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < n && i < TOPO_MAX_CPUS; i++)
+        set[i] = true;
+    topo_set_cpus(t, set);
+}
+
+// an isolated CPU we may use, the last one of the set if there is none
+static int topo_auto_cpu(exec_topo_t *t)
+{
+    bool iso[TOPO_MAX_CPUS];
+    char buf[256];
+    FILE *fp = fopen("/sys/devices/system/cpu/isolated", "r");
+
+    if (fp != NULL) {
+        if (fgets(buf, sizeof(buf), fp) != NULL && topo_parse_list(buf, iso)) {
+            for (int i = t->ncpus - 1; i >= 0; i--) {
+                if (iso[t->cpus[i]]) {
+                    fclose(fp);
+                    return t->cpus[i];
+                }
+            }
+        }
+        fclose(fp);
+    }
+    return t->cpus[t->ncpus - 1];
+}
+
+static bool topo_option(exec_topo_t *t, char *opt)
+{
+    bool set[TOPO_MAX_CPUS];
+    char *val = strchr(opt, '=');
+
+    if (val != NULL)
+        *val++ = '\0';
+    if (strcmp(opt, "cpus") == 0 && val != NULL) {
+        if (!topo_parse_list(val, set))
+            return false;
+        // we cannot go beyond the affinity mask we were started with
+        for (int i = 0; i < TOPO_MAX_CPUS; i++)
+            set[i] = set[i] && topo_has_cpu(t, i);
+        topo_set_cpus(t, set);
+        return t->ncpus > 0;
+    } else if (strcmp(opt, "primary") == 0 && val != NULL) {
+        // a CPU named here has to be in the set, whatever came first
+        t->pcpu = strcmp(val, "auto") == 0 ? -2 : atoi(val);
+        return true;
+    } else if (strcmp(opt, "rt") == 0) {
+        t->rtprio = val != NULL ? atoi(val) : TOPO_RT_PRIO;
+        return t->rtprio >= sched_get_priority_min(SCHED_FIFO) && t->rtprio <= sched_get_priority_max(SCHED_FIFO);
+    } else if (strcmp(opt, "pin") == 0 && val == NULL) {
+        t->pin = true;
+        return true;
+    }
+    return false;
+}
+
+static bool topo_parse_text(exec_topo_t *t, char *text)
+{
+    char *save, *opt, *c;
+
+    // comments only appear in files, cut them before splitting
+    for (char *line = text; (c = strchr(line, '#')) != NULL; line = c) {
+        while (*c != '\0' && *c != '\n')
+            *c++ = ' ';
+    }
+    for (opt = strtok_r(text, " \t\r\n;", &save); opt != NULL; opt = strtok_r(NULL, " \t\r\n;", &save)) {
+        if (!topo_option(t, opt)) {
+            fprintf(stderr, "Invalid executor topology option: %s\n", opt);
+            return false;
+        }
+    }
+    if (t->pcpu == -2)
+        t->pcpu = topo_auto_cpu(t);
+    if (t->pcpu >= 0 && !topo_has_cpu(t, t->pcpu)) {
+        fprintf(stderr, "Executor topology: CPU %d of the pExecutor is not usable\n", t->pcpu);
+        return false;
+    }
+    return true;
+}
+
+bool topo_parse(exec_topo_t *t, const char *spec)
+{
+    char *text;
+    bool ok;
+    long len;
+    FILE *fp;
+
+    if (spec[0] != '@') {
+        text = strdup(spec);
+    } else {
+        if ((fp = fopen(spec + 1, "r")) == NULL) {
+            fprintf(stderr, "Cannot read executor topology from %s\n", spec + 1);
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        rewind(fp);
+        text = (char *)calloc(1, len + 1);
+        if (text != NULL && fread(text, 1, len, fp) != (size_t)len)
+            text[0] = '\0';
+        fclose(fp);
+    }
+    if (text == NULL)
+        return false;
+    ok = topo_parse_text(t, text);
+    free(text);
+    return ok;
+}
+
+// the bandwidth limit of the cgroup in CPUs (rounded up), 0 if there is none
+static int topo_cgroup_cpus()
+{
+    long quota = -1, period = 0;
+    char buf[64];
+    FILE *fp;
+
+    if ((fp = fopen("/sys/fs/cgroup/cpu.max", "r")) != NULL) {
+        // "max 100000" or "<quota> <period>"
+        if (fscanf(fp, "%63s %ld", buf, &period) == 2 && strcmp(buf, "max") != 0)
+            quota = atol(buf);
+        fclose(fp);
+    } else if ((fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")) != NULL) {
+        if (fscanf(fp, "%ld", &quota) != 1)
+            quota = -1;
+        fclose(fp);
+        if ((fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")) != NULL) {
+            if (fscanf(fp, "%ld", &period) != 1)
+                period = 0;
+            fclose(fp);
+        }
+    }
+    if (quota <= 0 || period <= 0)
+        return 0;
+    return (quota + period - 1) / period;
+}
+
+int topo_cpu_quota(exec_topo_t *t)
+{
+    int n = topo_cgroup_cpus();
+
+    return n > 0 && n < t->ncpus ? n : t->ncpus;
+}
+
+// CPU the executor is pinned to, -1 if it is left to the scheduler
+static int topo_cpu(exec_topo_t *t, bool primary, int num)
+{
+    int cpu = -1, others = 0, k;
+
+    if (primary) {
+        cpu = t->pcpu;
+    } else if (t->pin) {
+        // spread over the CPUs the pExecutor does not have, share it only if there are none
+        for (int i = 0; i < t->ncpus; i++)
+            others += t->cpus[i] != t->pcpu;
+        k = others > 0 ? num % others : 0;
+        for (int i = 0; i < t->ncpus; i++) {
+            if (others > 0 && t->cpus[i] == t->pcpu)
+                continue;
+            if (k-- == 0) {
+                cpu = t->cpus[i];
+                break;
+            }
+        }
+    }
+    return cpu;
+}
+
+static int topo_desc(char *desc, int len, bool primary, int num)
+{
+    int n = snprintf(desc, len, "%s", primary ? "pExecutor" : "sExecutor");
+
+    if (!primary)
+        n += snprintf(desc + n, len - n, " %d", num);
+    return n;
+}
+
+void topo_place(exec_topo_t *t, pthread_t th, bool primary, int num, char *desc, int len)
+{
+    int cpu = topo_cpu(t, primary, num), n;
+
+    n = topo_desc(desc, len, primary, num);
+#ifdef __linux__
+    if (cpu >= 0) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        if (pthread_setaffinity_np(th, sizeof(mask), &mask) == 0)
+            n += snprintf(desc + n, len - n, ": cpu %d", cpu);
+        else
+            n += snprintf(desc + n, len - n, ": cpu %d refused", cpu);
+    } else
+        n += snprintf(desc + n, len - n, ": unpinned");
+    if (primary && t->rtprio > 0) {
+        struct sched_param sp = {.sched_priority = t->rtprio};
+        int rc = pthread_setschedparam(th, SCHED_FIFO, &sp);
+        if (rc == 0)
+            snprintf(desc + n, len - n, ", SCHED_FIFO %d", t->rtprio);
+        else
+            snprintf(desc + n, len - n, ", SCHED_FIFO %d refused (%s)", t->rtprio, strerror(rc));
+    }
+#else
+    (void)th;
+    (void)cpu;
+    snprintf(desc + n, len - n, ": unpinned");
+#endif
+}
+
+int topo_spawn(exec_topo_t *t, pthread_t *th, void *(*fn)(void *), void *arg,
+               bool primary, int num, char *desc, int len)
+{
+#ifdef __linux__
+    int cpu = topo_cpu(t, primary, num), rt = primary ? t->rtprio : 0, n, rc = -1;
+    pthread_attr_t attr;
+
+    // placed before it runs a single instruction, so the executor starts where it stays
+    if ((cpu >= 0 || rt > 0) && pthread_attr_init(&attr) == 0) {
+        cpu_set_t mask;
+        struct sched_param sp = {.sched_priority = rt};
+        CPU_ZERO(&mask);
+        if (cpu >= 0)
+            CPU_SET(cpu, &mask);
+        if ((cpu < 0 || pthread_attr_setaffinity_np(&attr, sizeof(mask), &mask) == 0) &&
+            (rt <= 0 || (pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) == 0 &&
+                         pthread_attr_setschedpolicy(&attr, SCHED_FIFO) == 0 &&
+                         pthread_attr_setschedparam(&attr, &sp) == 0)))
+            rc = pthread_create(th, &attr, fn, arg);
+        pthread_attr_destroy(&attr);
+        if (rc == 0) {
+            n = topo_desc(desc, len, primary, num);
+            if (cpu >= 0)
+                n += snprintf(desc + n, len - n, ": cpu %d", cpu);
+            else
+                n += snprintf(desc + n, len - n, ": unpinned");
+            if (rt > 0)
+                snprintf(desc + n, len - n, ", SCHED_FIFO %d", rt);
+            return 0;
+        }
+    }
+#endif
+    // the attributes were refused (no CAP_SYS_NICE, say), place it once it runs
+    if ((rc = pthread_create(th, NULL, fn, arg)) != 0)
+        return rc;
+    topo_place(t, *th, primary, num, desc, len);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define TOPO_MAX_CPUS               256
+#define TOPO_RT_PRIO                50
+/**
+ * Configurable Macros
+ * @TOPO_MAX_CPUS:  highest CPU number + 1 the executors can be placed on
+ * @TOPO_RT_PRIO:   SCHED_FIFO priority of the pExecutor for a plain "rt"
+ */
+
+/**
+ * exec_topo_t - Where the executor threads run
+ * @cpus:   CPUs the executors may use, the affinity mask of the process, narrowed by "cpus="
+ * @ncpus:  number of entries in @cpus
+ * @pcpu:   CPU the pExecutor is pinned to, -1 to leave it to the scheduler
+ * @rtprio: SCHED_FIFO priority of the pExecutor, 0 to keep the default policy
+ * @pin:    pin the sExecutors round robin over @cpus, leaving out the pExecutor's if we can
+ *
+ * Written as a list of options separated by blanks, semicolons or newlines, e.g.
+ * "cpus=2-7 primary=auto rt=60 pin". "primary=auto" picks an isolated CPU (isolcpus=)
+ * out of @cpus if there is one, the last CPU otherwise. A spec "@path" reads the options
+ * from the file path, where '#' starts a comment.
+ */
+typedef struct exec_topo_t {
+    short cpus[TOPO_MAX_CPUS];
+    int ncpus;
+    int pcpu;
+    int rtprio;
+    bool pin;
+} exec_topo_t;
+
+void topo_init(exec_topo_t *t);
+bool topo_parse(exec_topo_t *t, const char *spec);
+/**
+ * topo_init() - Default topology: all CPUs of the affinity mask, nothing pinned, no
+ *               real-time policy, which is what plain pthread_create() gives
+ * topo_parse() - Applies the options of @spec to @t
+ *
+ * Return: false on an unknown option, a CPU outside of @t->cpus or an unreadable file,
+ *         a message went to stderr
+ */
+
+int topo_cpu_quota(exec_topo_t *t);
+/**
+ * topo_cpu_quota() - CPUs we may keep busy: @t->cpus, capped by the CPU bandwidth
+ *                    limit of our cgroup (cpu.max in v2, cfs_quota_us in v1) rounded up
+ */
+
+void topo_place(exec_topo_t *t, pthread_t th, bool primary, int num, char *desc, int len);
+/**
+ * topo_place() - Pins executor thread @th and sets its policy as @t says
+ * @primary: @th is the pExecutor, else sExecutor @num
+ * @desc:    filled with the resulting placement for the startup report
+ *
+ * Failures (no CAP_SYS_NICE for SCHED_FIFO, say) leave the thread as it was and
+ * show up in @desc.
+ */
+
+int topo_spawn(exec_topo_t *t, pthread_t *th, void *(*fn)(void *), void *arg,
+               bool primary, int num, char *desc, int len);
+/**
+ * topo_spawn() - Creates executor thread @th running @fn(@arg), placed as @t says
+ * @primary: @th is the pExecutor, else sExecutor @num
+ * @desc:    filled with the resulting placement for the startup report
+ *
+ * The CPU and the SCHED_FIFO policy go into the attributes of pthread_create(), so the
+ * thread never runs elsewhere or under SCHED_OTHER. If they are refused, the thread is
+ * created plainly and placed by topo_place().
+ *
+ * Return: 0, or the error of pthread_create()
+ */
+
+#endif
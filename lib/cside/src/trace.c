@@ -0,0 +1,232 @@
+/*
+ * Per-thread binary trace rings and the Chrome trace writer, see trace.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+atomic_int trace_enabled = 0;
+
+static _Atomic(trace_ring_t *) rings = NULL;
+static __thread trace_ring_t *my_ring = NULL;
+static __thread char my_name[TRACE_NAME_LEN];
+
+uint64_t trace_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static trace_ring_t *trace_ring_new()
+{
+    trace_ring_t *r = (trace_ring_t *)calloc(1, sizeof(trace_ring_t));
+    assert(r != NULL);
+    r->tid = syscall(SYS_gettid);
+    if (my_name[0] != '\0')
+        memcpy(r->name, my_name, TRACE_NAME_LEN);
+    else
+        snprintf(r->name, TRACE_NAME_LEN, "thread-%d", r->tid);
+    r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&rings, &(r->next), r, memory_order_release, memory_order_relaxed))
+        ;
+    my_ring = r;
+    return r;
+}
+
+void trace_emit(trace_type_t type, uint64_t id, const char *name, uint32_t arg)
+{
+    trace_ring_t *r = my_ring != NULL ? my_ring : trace_ring_new();
+    unsigned long h = atomic_load_explicit(&(r->head), memory_order_relaxed);
+    trace_event_t *e = &(r->ev[h & (TRACE_RING_SIZE - 1)]);
+
+    e->ts = trace_now();
+    e->id = id;
+    e->name = name;
+    e->arg = arg;
+    e->type = type;
+    atomic_store_explicit(&(r->head), h + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(my_name, TRACE_NAME_LEN, fmt, args);
+    va_end(args);
+    if (my_ring != NULL)
+        memcpy(my_ring->name, my_name, TRACE_NAME_LEN);
+}
+
+void trace_enable(bool on)
+{
+    atomic_store_explicit(&trace_enabled, on, memory_order_relaxed);
+}
+
+static void trace_toggle(int signo)
+{
+    (void)signo;
+    // a lock-free atomic, fine in a signal handler
+    atomic_fetch_xor_explicit(&trace_enabled, 1, memory_order_relaxed);
+}
+
+void trace_install_signal(int signo)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_toggle;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&(sa.sa_mask));
+    sigaction(signo, &sa, NULL);
+}
+
+bool trace_used()
+{
+    return atomic_load(&rings) != NULL;
+}
+
+/*
+ * Copies the events still in @r into @buf (TRACE_RING_SIZE entries), oldest first,
+ * and returns how many there are. Events the owner overwrote while we were copying
+ * are dropped.
+ */
+static int trace_ring_snapshot(trace_ring_t *r, trace_event_t *buf)
+{
+    unsigned long end = atomic_load_explicit(&(r->head), memory_order_acquire);
+    unsigned long start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    unsigned long h;
+
+    for (unsigned long i = start; i < end; i++)
+        buf[i - start] = r->ev[i & (TRACE_RING_SIZE - 1)];
+    atomic_thread_fence(memory_order_acquire);
+    // the owner may be writing the slot of event h right now, which held h - TRACE_RING_SIZE
+    h = atomic_load_explicit(&(r->head), memory_order_relaxed);
+    if (h + 1 > start + TRACE_RING_SIZE) {
+        unsigned long valid = h + 1 - TRACE_RING_SIZE;
+        if (valid >= end)
+            return 0;
+        memmove(buf, buf + (valid - start), (end - valid) * sizeof(trace_event_t));
+        start = valid;
+    }
+    return end - start;
+}
+
+static const char *slot_names[] = {"", "batch", "SY slot", "RT slot"};
+
+static void trace_write_event(FILE *fp, int pid, int tid, trace_event_t *e, int *depth, bool *first)
+{
+    const char *ph = NULL, *name = e->name != NULL ? e->name : "task";
+    const char *cat = "task";
+    double ts = e->ts / 1000.0;
+
+    switch (e->type) {
+        case TRACE_TASK_START:
+        case TRACE_TASK_RESUME:
+            ph = "B";
+            break;
+        case TRACE_TASK_YIELD:
+        case TRACE_TASK_COMPLETE:
+            ph = "E";
+            break;
+        case TRACE_SLOT_ENTER:
+            ph = "B";
+            cat = "slot";
+            name = e->arg < 4 ? slot_names[e->arg] : "slot";
+            break;
+        case TRACE_SLOT_EXIT:
+            ph = "E";
+            cat = "slot";
+            break;
+        case TRACE_EXEC_PARK:
+            ph = "B";
+            cat = "exec";
+            name = "parked";
+            break;
+        case TRACE_EXEC_UNPARK:
+            ph = "E";
+            cat = "exec";
+            break;
+    }
+
+    if (ph != NULL) {
+        // a slice whose beginning was overwritten is left out
+        if (*ph == 'E' && *depth == 0)
+            return;
+        *depth += *ph == 'B' ? 1 : -1;
+        fprintf(fp, "%s\n{\"ph\":\"%s\",\"cat\":\"%s\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+                *first ? "" : ",", ph, cat, name, pid, tid, ts);
+        if (e->type == TRACE_TASK_START || e->type == TRACE_TASK_RESUME)
+            fprintf(fp, ",\"args\":{\"task\":\"0x%lx\",\"wait_us\":%u,\"first\":%s}",
+                    (unsigned long)e->id, e->arg, e->type == TRACE_TASK_START ? "true" : "false");
+        else if (e->type == TRACE_TASK_YIELD || e->type == TRACE_TASK_COMPLETE)
+            fprintf(fp, ",\"args\":{\"state\":\"%s\"}", e->type == TRACE_TASK_YIELD ? "yield" : "done");
+        fprintf(fp, "}");
+        *first = false;
+        return;
+    }
+
+    // remote executions are async slices keyed on the task id, they can end on another executor
+    switch (e->type) {
+        case TRACE_REXEC_SEND:
+            ph = "b";
+            break;
+        case TRACE_REXEC_ACK:
+            ph = "n";
+            break;
+        case TRACE_REXEC_RES:
+        case TRACE_REXEC_ERR:
+            ph = "e";
+            break;
+        default:
+            return;
+    }
+    fprintf(fp, "%s\n{\"ph\":\"%s\",\"cat\":\"rexec\",\"name\":\"rexec\",\"id\":\"0x%lx\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+            *first ? "" : ",", ph, (unsigned long)e->id, pid, tid, ts);
+    if (e->type == TRACE_REXEC_SEND)
+        fprintf(fp, ",\"args\":{\"level\":%u}", e->arg);
+    else if (e->type != TRACE_REXEC_ACK)
+        fprintf(fp, ",\"args\":{\"result\":\"%s\"}", e->type == TRACE_REXEC_RES ? "res" : "err");
+    fprintf(fp, "}");
+    *first = false;
+}
+
+void trace_write_chrome(FILE *fp)
+{
+    trace_event_t *buf = (trace_event_t *)malloc(TRACE_RING_SIZE * sizeof(trace_event_t));
+    int pid = getpid(), n, depth;
+    bool first = true;
+
+    assert(buf != NULL);
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (trace_ring_t *r = atomic_load_explicit(&rings, memory_order_acquire); r != NULL; r = r->next) {
+        fprintf(fp, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%.*s\"}}",
+                first ? "" : ",", pid, r->tid, TRACE_NAME_LEN, r->name);
+        first = false;
+        n = trace_ring_snapshot(r, buf);
+        depth = 0;
+        for (int i = 0; i < n; i++)
+            trace_write_event(fp, pid, r->tid, &buf[i], &depth, &first);
+    }
+    fprintf(fp, "\n]}\n");
+    free(buf);
+}
+
+bool trace_dump_chrome(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+        return false;
+    trace_write_chrome(fp);
+    fclose(fp);
+    return true;
+}
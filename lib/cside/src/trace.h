@@ -0,0 +1,122 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Hot path tracing for the executors. Every thread that records an event gets its
+ * own ring of fixed size binary events, written without locks or system calls, and
+ * the oldest events are overwritten when the ring wraps. While tracing is off the
+ * trace points cost one relaxed load. trace_dump_chrome() turns the rings into a
+ * Chrome trace / Perfetto JSON file (chrome://tracing, ui.perfetto.dev).
+ */
+
+#define TRACE_RING_SIZE             8192
+#define TRACE_NAME_LEN              16
+#define TRACE_DEFAULT_FILE          "cside-trace.json"
+/**
+ * Configurable Macros
+ * @TRACE_RING_SIZE:    events kept per thread, a power of two (32 bytes each)
+ * @TRACE_NAME_LEN:     length of a thread name in the trace
+ * @TRACE_DEFAULT_FILE: dump file used when tracing was switched on by signal only
+ */
+
+typedef enum {
+    TRACE_TASK_START = 1,           // first resume of a task, arg: queue wait in us
+    TRACE_TASK_RESUME,              // arg: queue wait in us
+    TRACE_TASK_YIELD,
+    TRACE_TASK_COMPLETE,
+    TRACE_SLOT_ENTER,               // arg: SY or RT execution mode
+    TRACE_SLOT_EXIT,
+    TRACE_EXEC_PARK,
+    TRACE_EXEC_UNPARK,
+    TRACE_REXEC_SEND,               // id: remote task id, arg: level
+    TRACE_REXEC_ACK,
+    TRACE_REXEC_RES,
+    TRACE_REXEC_ERR
+} trace_type_t;
+
+/**
+ * trace_event_t - One binary trace record
+ * @ts:   CLOCK_MONOTONIC time in nanoseconds
+ * @id:   task (its address) or remote task id
+ * @name: function name, must outlive the trace (function_t names do)
+ * @arg:  event specific, see trace_type_t
+ * @type: trace_type_t
+ */
+typedef struct trace_event_t {
+    uint64_t ts;
+    uint64_t id;
+    const char *name;
+    uint32_t arg;
+    uint16_t type;
+    uint16_t pad;
+} trace_event_t;
+
+/**
+ * trace_ring_t - Events of one thread
+ * @head: number of events ever written, only the owning thread moves it
+ * @tid:  kernel thread id
+ * @name: thread name in the trace
+ * @next: next ring in the list of all rings
+ *
+ * Rings are never freed, a reader copies events and then checks @head again to drop
+ * the ones that were overwritten meanwhile.
+ */
+typedef struct trace_ring_t {
+    atomic_ulong head;
+    int tid;
+    char name[TRACE_NAME_LEN];
+    struct trace_ring_t *next;
+    trace_event_t ev[TRACE_RING_SIZE];
+} trace_ring_t;
+
+extern atomic_int trace_enabled;
+
+#define trace_on()                  __builtin_expect(atomic_load_explicit(&trace_enabled, memory_order_relaxed), 0)
+
+#define trace_event(type, id, name, arg) do {                           \
+    if (trace_on())                                                     \
+        trace_emit((type), (uint64_t)(id), (name), (arg));              \
+} while (0)
+
+uint64_t trace_now();
+void trace_emit(trace_type_t type, uint64_t id, const char *name, uint32_t arg);
+/**
+ * trace_emit() - Appends an event to the ring of the calling thread. Use the
+ *                trace_event() macro, which checks whether tracing is on first.
+ *
+ * Context: the ring is allocated on the first event of a thread
+ */
+
+void trace_thread_name(const char *fmt, ...);
+/**
+ * trace_thread_name() - Names the calling thread in the trace (e.g. "sexec-2")
+ */
+
+void trace_enable(bool on);
+void trace_install_signal(int signo);
+/**
+ * trace_enable() - Switches tracing on or off
+ *
+ * trace_install_signal() makes @signo (e.g. SIGUSR2) toggle tracing on a live node.
+ */
+
+bool trace_used();
+void trace_write_chrome(FILE *fp);
+bool trace_dump_chrome(const char *path);
+/**
+ * trace_write_chrome() - Writes the events of all rings to @fp as Chrome trace JSON
+ *
+ * Tasks show up as slices on the executor that ran them, with the queue wait in their
+ * arguments. RT/SY slots and parked executors are slices too, remote executions are
+ * async slices from the REXEC send to the result. trace_used() tells if any event was
+ * ever recorded, trace_dump_chrome() writes to the file @path.
+ *
+ * Context: can run while the executors keep tracing
+ */
+
+#endif
@@ -1,12 +1,14 @@
 #include <time.h>
+#include <assert.h>
 #include "cnode.h"
 #include "timeout.h"
 #include "tboard.h"
 
-// All time allowances are in microseconds
+// All time allowances are in microseconds. The pExecutor parks until the next expiry,
+// so slots only need to cover its wakeup latency, wait_to_slot() sleeps and spins the rest
 #define EARLY_TIME_FOR_SCHEDULE         1000
-#define EARLY_TIME_FOR_RT               1000
-#define EARLY_TIME_FOR_SY               1000
+#define EARLY_TIME_FOR_RT               100
+#define EARLY_TIME_FOR_SY               200
 
 
 
@@ -18,101 +20,230 @@ long int getcurtime()
 }
 
 
-struct timeouts *twheel_init() 
+void twheel_init(tboard_t *tb)
 {
     timeout_error_t err;
-    struct timeouts *tw = timeouts_open(0, &err);
-    return tw;
+    struct timeout *t;
+
+    tb->twheel = timeouts_open(0, &err);
+    assert(tb->twheel != NULL);
+    mpsc_init(&(tb->twinbox));
+    timeout_init(&(tb->schedto), TIMEOUT_ABS);
+    tb->twpool = NULL;
+    for (int i = 0; i < TWHEEL_POOL_SIZE; i++) {
+        t = (struct timeout *)calloc(1, sizeof(struct timeout));
+        assert(t != NULL);
+        twheel_put_event(tb, t);
+    }
+    atomic_init(&(tb->twowned), 0);
 }
 
-void *clone_taskid(long int *task_id) 
+bool twheel_owner(tboard_t *tb)
 {
-    long int *t = (long int *)calloc(1, sizeof(long int));
-    memcpy(t, task_id, sizeof(long int));
-    return t;
-}
+    exec_t *e = current_exec;
 
+    if (e != NULL)
+        return e->tboard == tb && e->type == PRIMARY_EXECUTOR;
+    return atomic_load_explicit(&(tb->twowned), memory_order_acquire) == 0;
+}
 
-bool twheel_add_event(tboard_t *tb, twheel_event_t type, void *arg, long int tval)
+// what the executor does with an expired timeout is picked by its callback function
+static void twheel_set_callback(struct timeout *t, twheel_event_t type, void *arg)
 {
-    // create an timeout event entry - note that just the entry is initialized
-    struct timeout *t = calloc(1, sizeof(struct timeout));
-    timeout_init(t, TIMEOUT_ABS);
-    long int atval = tval;
-    
     switch (type) {
         case TW_EVENT_INSTALL_SCHEDULE:
             t->callback.fn = dummy_next_schedule;
-            t->callback.arg = arg;
-            //atval -= EARLY_TIME_FOR_SCHEDULE;
         break;
         case TW_EVENT_RT_SCHEDULE:
             t->callback.fn = dummy_next_rt_slot;
-            t->callback.arg = arg;
-            atval -= EARLY_TIME_FOR_RT;
         break;
         case TW_EVENT_RT_CLOSE:
             t->callback.fn = dummy_close_rt_slot;
-            t->callback.arg = arg;
         break;
         case TW_EVENT_SY_SCHEDULE:
             t->callback.fn = dummy_next_sy_slot;
-            t->callback.arg = arg;
-            atval -= EARLY_TIME_FOR_SY;
         break;
         case TW_EVENT_BEGIN_JSLEEP:
             t->callback.fn = dummy_next_sleep_event;
-            t->callback.arg = arg;
+        break;
+        case TW_EVENT_LOG_FLUSH:
+            t->callback.fn = dummy_next_log_flush;
+        break;
+        case TW_EVENT_WIRE_FLUSH:
+            t->callback.fn = dummy_next_wire_flush;
+        break;
+        case TW_EVENT_FUTURE_TIMEOUT:
+            t->callback.fn = dummy_next_future_timeout;
         break;
         case TW_EVENT_REXEC_TIMEOUT:
             t->callback.fn = dummy_next_timeout_event;
-            t->callback.arg = arg;
         break;
     }
-    // add the timeout event to the wheel at the adjusted time
-    pthread_mutex_lock(&tb->twmutex);
-    timeouts_add(tb->twheel, t, atval);
-    pthread_mutex_unlock(&tb->twmutex);
+    t->callback.arg = arg;
+}
+
+void twheel_put_event(tboard_t *tb, struct timeout *t)
+{
+    // a free event is on no list, its argument links the pool
+    t->callback.arg = tb->twpool;
+    tb->twpool = t;
+}
+
+bool twheel_add_event(tboard_t *tb, twheel_event_t type, void *arg, long int tval)
+{
+    struct timeout *t = tb->twpool;
 
+    assert(twheel_owner(tb));
+    if (t != NULL)
+        tb->twpool = (struct timeout *)t->callback.arg;
+    else if ((t = (struct timeout *)malloc(sizeof(struct timeout))) == NULL)
+        return false;
+    // create an timeout event entry - note that just the entry is initialized
+    timeout_init(t, TIMEOUT_ABS);
+    twheel_set_callback(t, type, arg);
+    timeouts_add(tb->twheel, t, tval);
     return true;
 }
 
-bool twheel_delete_timeout(tboard_t *tb, long int *id)
+void twheel_arm_slot(tboard_t *tb, twheel_event_t type, long int tval)
 {
-    struct timeouts_it it = TIMEOUTS_IT_INITIALIZER(TIMEOUTS_PENDING);
-    struct timeout *q;
-    
-    pthread_mutex_lock(&tb->twmutex);
-    while ((q = timeouts_next(tb->twheel, &it)) != NULL) {
-        if ((q->callback.fn == dummy_next_timeout_event) && (*(long int *)(q->callback.arg) == *id))
-            break;
+    long int atval = tval;
+
+    assert(twheel_owner(tb));
+    // the real slot start, see wait_to_slot()
+    twheel_set_callback(&(tb->schedto), type, (void *)tval);
+    switch (type) {
+        case TW_EVENT_INSTALL_SCHEDULE:
+            //atval -= EARLY_TIME_FOR_SCHEDULE;
+        break;
+        case TW_EVENT_RT_SCHEDULE:
+            atval -= EARLY_TIME_FOR_RT;
+        break;
+        case TW_EVENT_SY_SCHEDULE:
+            atval -= EARLY_TIME_FOR_SY;
+        break;
+        default:
+        break;
     }
-    if (q != NULL) {
-        timeouts_del(tb->twheel, q);
-        pthread_mutex_unlock(&tb->twmutex);
-        return true;
+    // add the slot timer to the wheel at the adjusted time
+    timeouts_add(tb->twheel, &(tb->schedto), atval);
+}
+
+void twheel_timer_init(twheel_timer_t *tm, twheel_event_t type, void *arg)
+{
+    timeout_init(&(tm->to), TIMEOUT_ABS);
+    twheel_set_callback(&(tm->to), type, arg);
+    atomic_init(&(tm->state), 0);
+    atomic_init(&(tm->tval), 0);
+}
+
+/*
+ * Sets @op on @tm and queues it for the pExecutor unless it is queued already.
+ * The pExecutor clears the state before it reads @tm->tval, so a newer @tval
+ * either makes it in time or comes with a new post.
+ */
+static void twheel_timer_post(tboard_t *tb, twheel_timer_t *tm, int op)
+{
+    int s = atomic_load_explicit(&(tm->state), memory_order_relaxed), n;
+
+    do {
+        n = (op == TW_TIMER_ARM ? (s & ~TW_TIMER_ARM) : s) | op | TW_TIMER_POSTED;
+    } while (!atomic_compare_exchange_weak_explicit(&(tm->state), &s, n, memory_order_acq_rel, memory_order_relaxed));
+    if ((s & TW_TIMER_POSTED) == 0)
+        mpsc_push(&(tb->twinbox), &(tm->node));
+    // a parked pExecutor sleeps until the expiry it knew about, releases can wait for it
+    if (op == TW_TIMER_ARM)
+        tboard_wake_primary(tb);
+}
+
+void twheel_timer_arm(tboard_t *tb, twheel_timer_t *tm, long int tval)
+{
+    atomic_store_explicit(&(tm->tval), tval, memory_order_relaxed);
+    if (twheel_owner(tb) && (atomic_load_explicit(&(tm->state), memory_order_acquire) & TW_TIMER_POSTED) == 0)
+        timeouts_add(tb->twheel, &(tm->to), tval);
+    else
+        twheel_timer_post(tb, tm, TW_TIMER_ARM);
+}
+
+void twheel_timer_cancel(tboard_t *tb, twheel_timer_t *tm)
+{
+    assert(twheel_owner(tb));
+    // a posted arm would bring it back
+    atomic_fetch_and_explicit(&(tm->state), ~TW_TIMER_ARM, memory_order_acq_rel);
+    timeouts_del(tb->twheel, &(tm->to));
+}
+
+void twheel_release_rtask(tboard_t *tb, remote_task_t *rtask)
+{
+    if (twheel_owner(tb) && (atomic_load_explicit(&(rtask->timer.state), memory_order_acquire) & TW_TIMER_POSTED) == 0) {
+        timeouts_del(tb->twheel, &(rtask->timer.to));
+        free(rtask);
+    } else
+        twheel_timer_post(tb, &(rtask->timer), TW_TIMER_RELEASE);
+}
+
+// applies the timers posted by other threads, pExecutor only
+static void twheel_drain_inbox(tboard_t *tb)
+{
+    mpsc_node_t *n;
+    twheel_timer_t *tm;
+    int s;
+
+    while ((n = mpsc_pop(&(tb->twinbox))) != NULL) {
+        tm = mpsc_entry(n, twheel_timer_t, node);
+        s = atomic_exchange_explicit(&(tm->state), 0, memory_order_acq_rel);
+        if (s & TW_TIMER_RELEASE) {
+            // only remote tasks are released through the inbox
+            timeouts_del(tb->twheel, &(tm->to));
+            free(mpsc_entry(tm, remote_task_t, timer));
+        } else if (s & TW_TIMER_ARM)
+            timeouts_add(tb->twheel, &(tm->to), atomic_load_explicit(&(tm->tval), memory_order_relaxed));
     }
-    pthread_mutex_unlock(&tb->twmutex);
-    return false;
 }
 
 struct timeout *twheel_get_next(tboard_t *tb)
 {
-    struct timeout *x = NULL;
-    if (timeouts_expired(tb->twheel)) {
-        pthread_mutex_lock(&tb->twmutex);
-        x = timeouts_get(tb->twheel);
-        pthread_mutex_unlock(&tb->twmutex);
-    }
-    return x;
+    if (timeouts_expired(tb->twheel))
+        return timeouts_get(tb->twheel);
+    return NULL;
 }
 
 void twheel_update_to_now(tboard_t *tb)
 {
-    pthread_mutex_lock(&tb->twmutex);
+    twheel_drain_inbox(tb);
     timeouts_update(tb->twheel, (timeout_t)getcurtime());
-    pthread_mutex_unlock(&tb->twmutex);
 }
 
+long int twheel_timeout(tboard_t *tb)
+{
+    timeout_t t = timeouts_timeout(tb->twheel);
 
+    return t == ~TIMEOUT_C(0) ? -1 : (long int)t;
+}
 
+static bool twheel_is_event(struct timeout *t)
+{
+    return t->callback.fn != dummy_next_sleep_event && t->callback.fn != dummy_next_timeout_event &&
+           t->callback.fn != dummy_next_log_flush && t->callback.fn != dummy_next_wire_flush &&
+           t->callback.fn != dummy_next_future_timeout;
+}
+
+void twheel_destroy(tboard_t *tb)
+{
+    struct timeout *t;
+
+    if (tb->twheel == NULL)
+        return;
+    twheel_drain_inbox(tb);
+    // pending schedule events are ours, embedded timers belong to their objects
+    TIMEOUTS_FOREACH(t, tb->twheel, TIMEOUTS_ALL | TIMEOUTS_CLEAR) {
+        if (t != &(tb->schedto) && twheel_is_event(t))
+            free(t);
+    }
+    timeouts_close(tb->twheel);
+    tb->twheel = NULL;
+    while ((t = tb->twpool) != NULL) {
+        tb->twpool = (struct timeout *)t->callback.arg;
+        free(t);
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ * Batched protocol mode, see wire.h. A batch is built the way it goes out: the
+ * encoded command maps are appended back to back behind room for the array header,
+ * which is only written when the batch is taken and its count is known. A batch of
+ * one goes out as the plain command, so a server sees the batch form only when there
+ * is something to gain.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "wire.h"
+#include "cnode.h"
+
+static long int wire_window = WIRE_WINDOW_US;
+
+void wire_init(long int window)
+{
+    wire_window = window > 0 ? window : 0;
+}
+
+void wire_batch_init(wire_batch_t *b, server_t *serv, char *topic)
+{
+    pthread_mutex_init(&(b->lock), NULL);
+    b->serv = serv;
+    b->topic = topic;
+    b->buf = NULL;
+    b->len = b->size = 0;
+    atomic_init(&(b->count), 0);
+    b->deadline = 0;
+    twheel_timer_init(&(b->timer), TW_EVENT_WIRE_FLUSH, b);
+    atomic_init(&(b->msgs), 0);
+    atomic_init(&(b->batches), 0);
+}
+
+void wire_batch_destroy(wire_batch_t *b)
+{
+    free(b->buf);
+    b->buf = NULL;
+    pthread_mutex_destroy(&(b->lock));
+}
+
+// CBOR array header for @count items, written so that it ends at @end
+static size_t wire_header(unsigned char *end, int count)
+{
+    size_t n = 0;
+
+    if (count < 24) {
+        end[-1] = 0x80 | count;
+        return 1;
+    }
+    for (unsigned int v = count; n == 0 || v > 0; v >>= 8)
+        end[-(++n)] = v & 0xff;
+    if (n == 1)
+        end[-(++n)] = 0x98;
+    else if (n == 2)
+        end[-(++n)] = 0x99;
+    else {
+        while (n < 4)
+            end[-(++n)] = 0;
+        end[-(++n)] = 0x9a;
+    }
+    return n;
+}
+
+// takes the commands out of @b, called with the lock held
+static unsigned char *wire_take(wire_batch_t *b, size_t *len, int *count)
+{
+    unsigned char *msg = b->buf;
+
+    *len = b->len;
+    *count = atomic_load_explicit(&(b->count), memory_order_relaxed);
+    b->buf = NULL;
+    b->len = b->size = 0;
+    atomic_store_explicit(&(b->count), 0, memory_order_relaxed);
+    b->deadline = 0;
+    return msg;
+}
+
+static void wire_publish(wire_batch_t *b, unsigned char *msg, size_t len, int count)
+{
+    server_t *s = b->serv;
+    unsigned char *start = msg + WIRE_HEADER;
+
+    if (count > 1) {
+        start -= wire_header(start, count);
+        len += msg + WIRE_HEADER - start;
+    }
+    if (s->mqtt != NULL) {
+        // mosquitto copies the payload
+        mqtt_publish(s->mqtt, b->topic, start, (int)len, NULL, 0);
+        atomic_fetch_add_explicit(&(b->msgs), count, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(b->batches), 1, memory_order_relaxed);
+    }
+    free(msg);
+}
+
+void wire_send(wire_batch_t *b, command_t *cmd)
+{
+    server_t *s = b->serv;
+    unsigned char *msg = NULL;
+    size_t len, need;
+    int count;
+
+    if (wire_window == 0 || (s->caps & WIRE_CAP_BATCH) == 0) {
+        // the adapter drops our reference once mosquitto is done with the bytes
+        mqtt_publish(s->mqtt, b->topic, cmd->buffer, cmd->length, cmd, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&(b->lock));
+    need = WIRE_HEADER + b->len + cmd->length;
+    if (need > b->size) {
+        b->size = need > 2 * b->size ? need : 2 * b->size;
+        b->buf = (unsigned char *)realloc(b->buf, b->size);
+        assert(b->buf != NULL);
+    }
+    memcpy(b->buf + WIRE_HEADER + b->len, cmd->buffer, cmd->length);
+    b->len += cmd->length;
+    count = atomic_load_explicit(&(b->count), memory_order_relaxed) + 1;
+    atomic_store_explicit(&(b->count), count, memory_order_relaxed);
+    if (count >= WIRE_BATCH_MSGS || b->len >= WIRE_BATCH_BYTES)
+        msg = wire_take(b, &len, &count);
+    else if (count == 1) {
+        // the first command starts the window
+        b->deadline = getcurtime() + wire_window;
+        twheel_timer_arm((tboard_t *)((cnode_t *)s->cnode)->tboard, &(b->timer), b->deadline);
+    }
+    pthread_mutex_unlock(&(b->lock));
+    command_free(cmd);
+    if (msg != NULL)
+        wire_publish(b, msg, len, count);
+}
+
+void wire_flush(wire_batch_t *b)
+{
+    unsigned char *msg;
+    size_t len;
+    int count;
+
+    if (atomic_load_explicit(&(b->count), memory_order_relaxed) == 0)
+        return;
+    pthread_mutex_lock(&(b->lock));
+    msg = wire_take(b, &len, &count);
+    pthread_mutex_unlock(&(b->lock));
+    if (count > 0)
+        wire_publish(b, msg, len, count);
+    else
+        free(msg);
+}
+
+void wire_deadline(void *arg)
+{
+    wire_batch_t *b = (wire_batch_t *)arg;
+    unsigned char *msg = NULL;
+    size_t len;
+    int count = 0;
+
+    pthread_mutex_lock(&(b->lock));
+    // stale deadlines (the batch went out earlier) are ignored
+    if (b->deadline != 0 && b->deadline <= getcurtime())
+        msg = wire_take(b, &len, &count);
+    pthread_mutex_unlock(&(b->lock));
+    if (msg != NULL)
+        wire_publish(b, msg, len, count);
+}
+
+void wire_print_stats(wire_batch_t *b, const char *name, FILE *fptr)
+{
+    long msgs = atomic_load(&(b->msgs));
+    long batches = atomic_load(&(b->batches));
+
+    if (batches == 0)
+        return;
+    fprintf(fptr, "Batched %s: %ld commands in %ld publishes (%.1f per publish) [window %ld us]\n",
+        name, msgs, batches, (double)msgs / batches, wire_window);
+}
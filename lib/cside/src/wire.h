@@ -0,0 +1,110 @@
+#ifndef __WIRE_H__
+#define __WIRE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tboard.h"
+
+/*
+ * Batched protocol mode. Commands to a server that speaks it are not published one
+ * by one: they are appended to a batch of that server and go out together as a
+ * single CBOR array of command maps. There is a batch for the REXECs we issue and one
+ * for the ACK/NAK/RES/ERR replies to the calls we serve. A batch is published when it
+ * is full, when the executors run out of work (REXECs issued in the same pass go out
+ * together), when the message it answers was itself a batch, or at the latest a short
+ * window after its first command, by a timer on the timing wheel.
+ *
+ * Whether a server speaks the batch form is negotiated during registration: REGISTER
+ * offers WIRE_CAPS as its argument, REGISTER_ACK carries what the server accepted in
+ * subcmd. Servers we never registered with (edge, cloud) get single commands.
+ */
+
+#define WIRE_WINDOW_US              500
+#define WIRE_BATCH_MSGS             64
+#define WIRE_BATCH_BYTES            8192
+/**
+ * Configurable Macros
+ * @WIRE_WINDOW_US:     default for how long a command may wait in a batch, in microseconds
+ *                      (-W, 0 turns the batched mode off)
+ * @WIRE_BATCH_MSGS:    a batch goes out when it holds this many commands
+ * @WIRE_BATCH_BYTES:   ... or when the commands it holds take this many bytes
+ */
+
+#define WIRE_CAP_BATCH              0x1
+#define WIRE_CAPS                   WIRE_CAP_BATCH
+/**
+ * WIRE_CAP_BATCH - Accepts commands batched in a CBOR array
+ * WIRE_CAPS - Capabilities this node offers in REGISTER
+ */
+
+#define WIRE_HEADER                 9       // largest CBOR array header
+
+struct _server_t;
+
+/**
+ * wire_batch_t - Commands waiting to go to one server on one topic
+ * @lock:     protects everything below but the counters
+ * @serv:     server the batch goes to
+ * @topic:    topic it is published on
+ * @buf:      WIRE_HEADER bytes for the array header, then the encoded commands
+ * @len:      bytes of commands in @buf
+ * @size:     size of @buf
+ * @count:    commands in @buf, also read without @lock to skip empty batches
+ * @deadline: when the batch has to go out (getcurtime() based), 0 while it is empty
+ * @timer:    @deadline on the timing wheel (TW_EVENT_WIRE_FLUSH)
+ * @msgs:     commands published through the batch
+ * @batches:  publishes they took
+ */
+typedef struct wire_batch_t {
+    pthread_mutex_t lock;
+    struct _server_t *serv;
+    char *topic;
+    unsigned char *buf;
+    size_t len;
+    size_t size;
+    atomic_int count;
+    long int deadline;
+    twheel_timer_t timer;
+    atomic_long msgs;
+    atomic_long batches;
+} wire_batch_t;
+
+void wire_init(long int window);
+/**
+ * wire_init() - Sets the batching window in microseconds, 0 sends every command on
+ *               its own whatever the servers accept
+ */
+
+void wire_batch_init(wire_batch_t *b, struct _server_t *serv, char *topic);
+void wire_batch_destroy(wire_batch_t *b);
+
+void wire_send(wire_batch_t *b, command_t *cmd);
+/**
+ * wire_send() - Sends @cmd to the server of @b, in a batch if the server accepts them
+ *
+ * The encoded bytes are copied into the batch, so the reference to @cmd the caller
+ * passes is dropped right away. Commands go out in the order they were sent.
+ */
+
+void wire_flush(wire_batch_t *b);
+/**
+ * wire_flush() - Publishes what @b holds, from any thread
+ */
+
+void wire_deadline(void *arg);
+/**
+ * wire_deadline() - Publishes the batch @arg whose window ran out
+ *
+ * Context: pExecutor, when the timer of the batch expires
+ */
+
+void wire_print_stats(wire_batch_t *b, const char *name, FILE *fptr);
+/**
+ * wire_print_stats() - Prints how many commands went out in how many publishes, nothing
+ *                      if the batch was never used
+ */
+
+#endif
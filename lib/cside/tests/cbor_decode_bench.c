@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <jam.h>
+
+/*
+ * Microbenchmark for the command decoders: command_from_data() (copies the payload
+ * into command_t and strdup's every arg) against command_view_init() (borrows the
+ * payload). The view is measured twice: header only - what a NAK/ERR or an ACK
+ * without args costs - and with the args materialised the way a REXEC task keeps them.
+ *
+ * Usage: cbor_decode_bench [recording]
+ * A recording is a sequence of <uint32 length><CBOR bytes> records (host byte order).
+ * Without one, REXEC messages shaped like the ones the J side sends are generated.
+ */
+
+#define MAX_MSGS        1024
+#define ROUNDS          2000
+
+unsigned char *msgs[MAX_MSGS];
+int lens[MAX_MSGS];
+int nmsgs = 0;
+
+void add_msg(command_t *c)
+{
+    msgs[nmsgs] = malloc(c->length);
+    memcpy(msgs[nmsgs], c->buffer, c->length);
+    lens[nmsgs++] = c->length;
+    command_free(c);
+}
+
+void generate_traffic()
+{
+    char fname[32];
+    for (int i = 0; i < MAX_MSGS; i++) {
+        sprintf(fname, "remote_fn_%d", i % 16);
+        switch (i % 4) {
+            case 0:
+                add_msg(command_new(CmdNames_REXEC, 0, fname, 1000 + i, "5f0e4dc0-7a1b-4b43-9b7e-3d2c1f0a9e11", "si", "temperature", i));
+                break;
+            case 1:
+                add_msg(command_new(CmdNames_REXEC, 1, fname, 1000 + i, "5f0e4dc0-7a1b-4b43-9b7e-3d2c1f0a9e11", "sif", "humidity", i, 0.5 * i));
+                break;
+            case 2:
+                add_msg(command_new(CmdNames_REXEC, 0, fname, 1000 + i, "5f0e4dc0-7a1b-4b43-9b7e-3d2c1f0a9e11", "ss", "door", "open"));
+                break;
+            default:
+                add_msg(command_new(CmdNames_REXEC, 0, fname, 1000 + i, "5f0e4dc0-7a1b-4b43-9b7e-3d2c1f0a9e11", ""));
+        }
+    }
+}
+
+void load_traffic(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    uint32_t len;
+
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while (nmsgs < MAX_MSGS && fread(&len, sizeof(len), 1, fp) == 1) {
+        msgs[nmsgs] = malloc(len);
+        if (fread(msgs[nmsgs], 1, len, fp) != len)
+            break;
+        lens[nmsgs++] = len;
+    }
+    fclose(fp);
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(char *name, double start, long count, long check)
+{
+    double el = now() - start;
+    printf("%-28s %10.0f msgs/sec  (%ld ns/msg, check %ld)\n", name, count / el, (long)(el * 1e9 / count), check);
+}
+
+int main(int argc, char *argv[])
+{
+    command_view_t v;
+    command_t *c;
+    long check;
+    double start;
+    long count;
+
+    if (argc > 1)
+        load_traffic(argv[1]);
+    else
+        generate_traffic();
+    if (nmsgs == 0) {
+        printf("No messages to decode\n");
+        return 1;
+    }
+    count = (long)ROUNDS * nmsgs;
+    printf("Decoding %d messages %d times\n", nmsgs, ROUNDS);
+
+    check = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < nmsgs; i++) {
+            c = command_from_data(NULL, msgs[i], lens[i]);
+            check += c->task_id;
+            command_free(c);
+        }
+    report("command_from_data", start, count, check);
+
+    check = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < nmsgs; i++) {
+            if (command_view_init(&v, msgs[i], lens[i]))
+                check += v.task_id;
+        }
+    report("command_view_init", start, count, check);
+
+    check = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < nmsgs; i++) {
+            if (command_view_init(&v, msgs[i], lens[i])) {
+                c = command_from_view(&v);
+                check += c->task_id;
+                command_free(c);
+            }
+        }
+    report("command_from_view", start, count, check);
+
+    for (int i = 0; i < nmsgs; i++)
+        free(msgs[i]);
+    return 0;
+}
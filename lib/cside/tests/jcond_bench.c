@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <jam.h>
+
+/*
+ * Microbenchmark for the jcond checks done on every REXEC and local_async_call():
+ * evaluating the expression text (what jcond_evaluate() used to do, a parse and a
+ * compile per check) against the compiled jcond, once with jsys changing before every
+ * check (the function is called each time) and once with the result kept, and against
+ * the C predicates the compiler emits for the same expressions.
+ *
+ * Usage: jcond_bench [checks]
+ */
+
+#define CHECKS          200000
+
+const char *labels[] = {"deviceonly", "fogonly", "tagged", "devtagged"};
+const char *conds[] = {
+    "jsys.type == 'device'",
+    "jsys.type == 'fog'",
+    "jsys.tag == 'sensor'",
+    "(jsys.type == 'device' || jsys.type == 'fog') && jsys.tag != 'actuator'"
+};
+#define NCONDS          (sizeof(labels) / sizeof(labels[0]))
+
+// what jCondTranslator.toC() makes of conds[]
+bool jcond_native_deviceonly() {
+  return jcond_streq(jsys.type, "device");
+}
+bool jcond_native_fogonly() {
+  return jcond_streq(jsys.type, "fog");
+}
+bool jcond_native_tagged() {
+  return jcond_streq(jsys.tag, "sensor");
+}
+bool jcond_native_devtagged() {
+  return (jcond_streq(jsys.type, "device") || jcond_streq(jsys.type, "fog")) && !jcond_streq(jsys.tag, "actuator");
+}
+const char *nlabels[] = {"n_deviceonly", "n_fogonly", "n_tagged", "n_devtagged"};
+jcond_pred_t preds[] = {jcond_native_deviceonly, jcond_native_fogonly, jcond_native_tagged, jcond_native_devtagged};
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(char *name, double start, long count, long check)
+{
+    double el = now() - start;
+    printf("%-28s %10.0f checks/sec  (%ld ns/check, check %ld)\n", name, count / el, (long)(el * 1e9 / count), check);
+}
+
+int main(int argc, char *argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : CHECKS;
+    long check;
+    double start;
+
+    jcond_set_jsys("device", "sensor");
+    for (int i = 0; i < NCONDS; i++) {
+        jcond_define(labels[i], conds[i]);
+        jcond_define_native(nlabels[i], preds[i]);
+    }
+    printf("Checking %d jconds %ld times\n", (int)NCONDS, count);
+
+    check = 0;
+    start = now();
+    for (long i = 0; i < count; i++)
+        check += jcond_eval_bool(conds[i % NCONDS]);
+    report("eval per check", start, count, check);
+
+    check = 0;
+    start = now();
+    for (long i = 0; i < count; i++) {
+        jcond_jsys_changed();
+        check += jcond_evaluate(labels[i % NCONDS]);
+    }
+    report("compiled, jsys changing", start, count, check);
+
+    check = 0;
+    start = now();
+    for (long i = 0; i < count; i++)
+        check += jcond_evaluate(labels[i % NCONDS]);
+    report("compiled, result kept", start, count, check);
+
+    check = 0;
+    start = now();
+    for (long i = 0; i < count; i++)
+        check += jcond_evaluate(nlabels[i % NCONDS]);
+    report("native", start, count, check);
+
+    jcond_free();
+    return 0;
+}
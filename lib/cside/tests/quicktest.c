@@ -110,7 +110,7 @@ int main(int argc, char **argv)
     //}
 
     // Start the taskboard 
-    cn->tboard = tboard_create(cn, cn->args->nexecs);
+    cn->tboard = tboard_create(cn, cn->args->nexecs, READY_QUEUE_TYPE);
     //tboard_t *tb = (tboard_t *)calloc(1, sizeof(tboard_t));
 
  //   timeout_error_t err;
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <jam.h>
+
+/*
+ * Slot start jitter. First the sleeper on its own: a thread sleeps to a deadline every
+ * millisecond, once with a plain absolute clock_nanosleep() and once with sleep_until()
+ * (absolute sleep plus the learned spin). Then a task board runs a schedule with one RT
+ * and one SY slot per epoch while batch tasks keep the pExecutor busy, and we report
+ * how late the executor started its slots (tboard_t.slotlat).
+ *
+ * Usage: slot_jitter_bench [seconds] [load threads] [batch tasks]
+ * The load threads spin on the CPUs the whole time, to show the jitter under load.
+ */
+
+#define SAMPLES         5000
+#define PERIOD          1000000         // ns between sleeper deadlines
+#define BURN            20000           // ns a batch task runs between yields
+
+volatile int stop_load = 0;
+
+void *load_thread(void *arg)
+{
+    volatile uint64_t x = (uintptr_t)arg;
+    while (!stop_load)
+        x = x * 6364136223846793005ULL + 1;
+    return NULL;
+}
+
+void batch_load(context_t ctx)
+{
+    (void)ctx;
+    while (true) {
+        int64_t end = curtime_in_nanosec() + BURN;
+        while (curtime_in_nanosec() < end)
+            ;
+        task_yield();
+    }
+}
+
+void print_hist(const char *name, lathist_t *h)
+{
+    printf("  %-18s p50 %7.1f us  p99 %7.1f us  p999 %7.1f us  max %7.1f us  [%lu samples]\n", name,
+        lathist_percentile(h, 50) / 1000.0, lathist_percentile(h, 99) / 1000.0,
+        lathist_percentile(h, 99.9) / 1000.0, h->max / 1000.0, (unsigned long)h->count);
+}
+
+void bench_sleeper()
+{
+    lathist_t *plain = calloc(1, sizeof(lathist_t)), *spin = calloc(1, sizeof(lathist_t));
+    struct timespec ts;
+    sleeper_t s;
+    int64_t d;
+
+    learn_sleeping(&s, 16);
+    d = curtime_in_nanosec() + PERIOD;
+    for (int i = 0; i < SAMPLES; i++, d += PERIOD) {
+        ts.tv_sec = d / 1000000000;
+        ts.tv_nsec = d % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        lathist_record(plain, curtime_in_nanosec() - d);
+    }
+    d = curtime_in_nanosec() + PERIOD;
+    for (int i = 0; i < SAMPLES; i++, d += PERIOD)
+        lathist_record(spin, sleep_until(&s, d));
+    printf("Sleeper lateness, one deadline per %d us:\n", PERIOD / 1000);
+    print_hist("clock_nanosleep", plain);
+    print_hist("sleep_until", spin);
+    printf("  learned spin window %.1f us\n", s.spin / 1000.0);
+    free(plain);
+    free(spin);
+}
+
+void bench_tboard(int seconds, int ntasks)
+{
+    tboard_t *tb = tboard_create(NULL, 1, READY_QUEUE_TYPE);
+    // 5 ms epochs, an RT slot at 1 ms and an SY slot at 3 ms
+    sched_t s = {.len = 5000, .rtslots = 1, .rtstarts = {1000}, .syslots = 1, .systarts = {3000}};
+    function_t *f;
+
+    tboard_put_schedule(tb, &s);
+    tboard_register_func(tb, TBOARD_FUNC("batch_load", batch_load, "", "", PRI_BATCH_TASK));
+    f = tboard_find_func(tb, "batch_load");
+    for (int i = 0; i < ntasks; i++)
+        task_create(tb, *f, NULL, NULL);
+    tboard_start(tb);
+    sleep(seconds);
+    printf("Slot start lateness, %d batch tasks on the pExecutor:\n", ntasks);
+    print_hist("SY slots", &(tb->slotlat[SLOTLAT_SY]));
+    print_hist("RT slots", &(tb->slotlat[SLOTLAT_RT]));
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int nload = argc > 2 ? atoi(argv[2]) : 0;
+    int ntasks = argc > 3 ? atoi(argv[3]) : 4;
+    pthread_t *load = calloc(nload > 0 ? nload : 1, sizeof(pthread_t));
+
+    for (int i = 0; i < nload; i++)
+        pthread_create(&load[i], NULL, load_thread, (void *)(uintptr_t)(i + 1));
+    printf("%d load threads\n", nload);
+    bench_sleeper();
+    bench_tboard(seconds, ntasks);
+    stop_load = 1;
+    for (int i = 0; i < nload; i++)
+        pthread_join(load[i], NULL);
+    // the task board still runs the load tasks, leave without tearing it down
+    exit(0);
+}
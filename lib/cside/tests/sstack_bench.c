@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <malloc.h>
+#include <jam.h>
+
+/*
+ * Private versus shared coroutine stacks. First @ntasks tasks walk a call chain of
+ * DEPTH frames and park in sleep_task_create(), the way tasks park in a remote call,
+ * and we report the heap and resident memory per parked task. Then 1 and SWITCHERS
+ * tasks keep yielding to each other and we report the cost of a switch: with one task
+ * a shared stack is never copied, with several every switch copies frames out and in.
+ *
+ * Usage: sstack_bench [parked tasks] [yields per task]
+ * The remote task table bounds the parked tasks (RTABLE_SIZE).
+ */
+
+#define DEPTH           8
+#define FRAME           256             // bytes of locals per frame of the chain
+#define PARK_US         1000000         // how long the tasks stay parked
+#define SWITCHERS       8
+
+tboard_t *tb;
+atomic_int parked, done;
+
+int chain(int depth)
+{
+    volatile char frame[FRAME];
+
+    frame[0] = (char)depth;
+    if (depth > 0)
+        return chain(depth - 1) + frame[0];
+    atomic_fetch_add(&parked, 1);
+    sleep_task_create(tb, PARK_US);
+    return frame[0];
+}
+
+void parker(context_t ctx)
+{
+    (void)ctx;
+    chain(DEPTH);
+    atomic_fetch_add(&done, 1);
+}
+
+int yields;
+
+void switcher(context_t ctx)
+{
+    (void)ctx;
+    for (int i = 0; i < yields; i++)
+        task_yield();
+    atomic_fetch_add(&done, 1);
+}
+
+long rss_bytes()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp != NULL) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+long heap_bytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    return (long)(mi.uordblks + mi.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+void wait_for(atomic_int *counter, int n)
+{
+    while (atomic_load(counter) < n)
+        usleep(1000);
+}
+
+void bench_parked(const char *name, int ntasks)
+{
+    function_t *f = tboard_find_func(tb, (char *)name);
+    long heap, rss;
+
+    atomic_store(&parked, 0);
+    atomic_store(&done, 0);
+    heap = heap_bytes();
+    rss = rss_bytes();
+    for (int i = 0; i < ntasks; i++)
+        task_create(tb, *f, NULL, NULL);
+    wait_for(&parked, ntasks);
+    usleep(10000);  // the last ones are yielding now
+    heap = heap_bytes() - heap;
+    rss = rss_bytes() - rss;
+    printf("  %-14s %8.0f bytes heap, %8.0f bytes resident per parked task\n", name,
+        (double)heap / ntasks, (double)rss / ntasks);
+    wait_for(&done, ntasks);
+}
+
+void bench_switch(const char *name, int ntasks)
+{
+    function_t *f = tboard_find_func(tb, (char *)name);
+    int64_t start;
+
+    atomic_store(&done, 0);
+    start = curtime_in_nanosec();
+    for (int i = 0; i < ntasks; i++)
+        task_create(tb, *f, NULL, NULL);
+    wait_for(&done, ntasks);
+    printf("  %-14s %d tasks: %6.1f ns per switch\n", name, ntasks,
+        (double)(curtime_in_nanosec() - start) / ((double)ntasks * yields));
+}
+
+int main(int argc, char *argv[])
+{
+    int ntasks = argc > 1 ? atoi(argv[1]) : 2000;
+
+    yields = argc > 2 ? atoi(argv[2]) : 200000;
+    tb = tboard_create(NULL, 0, READY_QUEUE_TYPE);
+    tboard_register_func(tb, TBOARD_FUNC("private", parker, "", "", PRI_BATCH_TASK));
+    tboard_register_func(tb, TBOARD_FUNC_STACK("shared", parker, "", "", PRI_BATCH_TASK, STACK_SHARED));
+    tboard_register_func(tb, TBOARD_FUNC("private_yield", switcher, "", "", PRI_BATCH_TASK));
+    tboard_register_func(tb, TBOARD_FUNC_STACK("shared_yield", switcher, "", "", PRI_BATCH_TASK, STACK_SHARED));
+    tboard_start(tb);
+
+    printf("Memory, %d tasks parked %d frames of %d bytes deep:\n", ntasks, DEPTH, FRAME);
+    // shared first, the private stacks stay cached in the task pool afterwards
+    bench_parked("shared", ntasks);
+    bench_parked("private", ntasks);
+
+    printf("Switch cost, %d yields per task:\n", yields);
+    bench_switch("private_yield", 1);
+    bench_switch("shared_yield", 1);
+    bench_switch("private_yield", SWITCHERS);
+    bench_switch("shared_yield", SWITCHERS);
+    sstack_print_stats(&(tb->pexect->sstack), stdout);
+    // leave without tearing the task board down
+    exit(0);
+}
@@ -114,6 +114,18 @@ class JAMCore {
         }
     }
 
+    /*
+     * Drops a job that is still waiting for the worker. Returns false if the worker
+     * has it already.
+     */
+    cancelJob(nodeid, taskid) {
+        let i = this.jobQueue.findIndex((j) => j.nodeid === nodeid && j.taskid === taskid);
+        if (i < 0)
+            return false;
+        this.jobQueue.splice(i, 1);
+        return true;
+    }
+
     /*
      * REXEC_ASY and related commands are sending requests to the other side. So, we are 
      * using jclient for that purpose. REXEC_ACK is sending out replies to requests 
@@ -172,8 +184,8 @@ class JAMCore {
             return false;
         });
         sock.on('message', function(topic, buf) {
-            let qmsg = cbor.decode(buf);
-            auxmessageProcessor(that, sock, topic, qmsg);
+            for (let qmsg of JAMP.unbatch(cbor.decode(buf)))
+                auxmessageProcessor(that, sock, topic, qmsg);
         });
     }
 
@@ -198,8 +210,8 @@ class JAMCore {
             return false;
         });
         sock.on('message', function(topic, buf) {
-            let qmsg = cbor.decode(buf);
-            messageProcessor(that, sock, topic, qmsg);
+            for (let qmsg of JAMP.unbatch(cbor.decode(buf)))
+                messageProcessor(that, sock, topic, qmsg);
         });
 
     }
@@ -345,7 +357,9 @@ async function messageProcessor(jcore, sock, topic, msg) {
     switch (topic) {
         case '/' + cmdOpts.app + '/requests/up':
             // the commands are processed with most likely one first..
-            if ((msg.cmd > CmdNames.EXEC_CMDS_BEG) && (msg.cmd < CmdNames.EXEC_CMDS_END)) {
+            if (msg.cmd === CmdNames.REXEC_CANCEL) {
+                jcore.jdaemon.cancelProcessor(msg);
+            } else if ((msg.cmd > CmdNames.EXEC_CMDS_BEG) && (msg.cmd < CmdNames.EXEC_CMDS_END)) {
                 rmsg = await jcore.jdaemon.requestProcessor(msg);
                 sock.publish('/' + cmdOpts.app + '/replies/down', cbor.encode(rmsg));
                 if (rmsg.cmd === CmdNames.MEXEC_ACK || rmsg.cmd === CmdNames.REXEC_ACK) {
@@ -383,6 +397,10 @@ async function auxmessageProcessor(jcore, sock, topic, msg) {
     let rmsg = undefined;
     switch (topic) {
         case '/' + cmdOpts.app + '/requests/down/j':
+            if (msg.cmd === CmdNames.REXEC_CANCEL) {
+                jcore.jdaemon.cancelProcessor(msg);
+                break;
+            }
             rmsg = await jcore.jdaemon.requestProcessor(msg);
             if (rmsg !== undefined) {
                 sock.publish('/' + cmdOpts.app + '/replies/up', cbor.encode(rmsg));
@@ -90,11 +90,17 @@ class OutTaskTable {
         }
     }
 
-    processNak(id, errcode) {
+    processNak(id, errcode, retryafter) {
         let tent = tasktbl.get(id);
         if (tent !== undefined && errcode === CmdNames.COND_FALSE) {
             tent.state = StateNames.CLOSING;
             tent.callback(StateNames.CLOSING, errcode);
+        } else if (tent !== undefined && errcode === CmdNames.OVERLOAD) {
+            // the worker is overloaded and said when to come back, hold the next
+            // retry until then. The retries left are not touched.
+            let ticks = Math.ceil(retryafter / TTConfig.CLOCK_INTERVAL);
+            if (tent.count < ticks)
+                tent.count = ticks;
         }
     }
 
@@ -138,6 +138,7 @@ class JCoreAdmin {
         var rdevid = msg['id'];
         msg['cmd'] = constants.CmdNames.REGISTER_ACK;
         msg['ctrlid'] = [deviceParams.getItem('deviceId')];
+        msg['subcmd'] = JAMP.negotiate(Array.isArray(msg['args']) ? msg['args'][0] : 0);
         if (!this.devTable.has(rdevid)) {
             msg['flag'] =  true;
             this.devTable.set(rdevid, {time: Date.now(), tag: "none"});
@@ -45,7 +45,7 @@ class JCoreDaemon {
                 break;
             case CmdNames.REXEC_NAK:
             case CmdNames.MEXEC_NAK:
-                this.jcore.otasktbl.processNak(msg.nodeid + msg.taskid, msg.args[0]);
+                this.jcore.otasktbl.processNak(msg.nodeid + msg.taskid, msg.args[0], msg.args[1]);
                 break;
             case CmdNames.REXEC_RES:
             case CmdNames.MEXEC_RES:
@@ -154,6 +154,21 @@ class JCoreDaemon {
         return undefined;
     }
 
+    /*
+     * The caller got its result elsewhere first (a hedged ALL_LEVELS request). A task
+     * still waiting for the worker is dropped, its pending request answered with a NAK.
+     * A task the worker started runs to completion.
+     */
+    cancelProcessor(msg) {
+        let id = msg.nodeid + msg.taskid;
+        let ientry = this.jcore.itaskq.get(id);
+        if (ientry === undefined || !this.jcore.cancelJob(msg.nodeid, msg.taskid))
+            return;
+        this.jcore.itaskq.delete(id);
+        if (ientry.callback !== undefined)
+            ientry.callback(INQ_States.ERROR, {cmd: CmdNames.REXEC_NAK, subcmd: CmdNames.REXEC_CANCEL});
+    }
+
     /*
      * This method is used to trigger an new execution at the worker thread. We return a promise which can be later fulfilled. 
      */
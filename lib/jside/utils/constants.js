@@ -39,6 +39,9 @@ module.exports = Object.freeze({
             MQTT: 2,
             MDNS: 1
         },
+        Capabilities: {           // offered by a C node in REGISTER, accepted in REGISTER_ACK
+            BATCH: 0x1            // commands batched in a CBOR array
+        },
         Counts: {
             ACK_TIMEOUTS: 3,
             WAIT_COUNT: 3
@@ -116,6 +119,7 @@ module.exports = Object.freeze({
         REXEC_SYN: 5050,
         GET_REXEC_RES: 5060,
         REXEC_DONE: 5070,
+        REXEC_CANCEL: 5080,
         MEXEC: 5100,
         MEXEC_NAK: 5101,
         MEXEC_ACK: 5301,
@@ -126,6 +130,7 @@ module.exports = Object.freeze({
         DONE: 5800,
         COND_FALSE: 5810,
         FUNC_NOT_FOUND: 5820,
+        OVERLOAD: 5830,
         EXEC_CMDS_END: 5900,
         SET_JSYS: 6000,
         SET_CONF: 6100,
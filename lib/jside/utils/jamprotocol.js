@@ -1,5 +1,6 @@
 'use strict';
-const CmdNames = require('./constants').CmdNames;
+const CmdNames = require('./constants').CmdNames,
+      Capabilities = require('./constants').globals.Capabilities;
 
 /* 
  * JAMProtocol class.
@@ -94,6 +95,21 @@ class JAMProtocol {
     static createPingReq() {
         return {cmd: CmdNames.PING};
     }
+
+    /*
+     * A C node that negotiated the batched mode sends a CBOR array of commands in one
+     * publish. Returns the commands of a decoded publish either way.
+     */
+    static unbatch(msg) {
+        return Array.isArray(msg) ? msg : [msg];
+    }
+
+    /*
+     * The capabilities we accept out of those offered in a REGISTER.
+     */
+    static negotiate(offered) {
+        return (Number.isInteger(offered) ? offered : 0) & Capabilities.BATCH;
+    }
 }
 
 module.exports = JAMProtocol;
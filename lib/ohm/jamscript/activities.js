@@ -279,6 +279,19 @@ module.exports = {
             cOut += `${returnType} rval=a->val.${returnTypeJamLibCode};`;
             cOut += `free(a);`;
             cOut += `return rval;`;
+            cOut += `}\n`;
+            // issue and result halves of the call, for independent calls awaited together
+            cOut += `future_t* ${functionName}_future(futures_t* fs${functionParams.map((v) => `,${v.type} ${v.name}`).join('')}){`;
+            cOut += `return remote_future_call(fs,0,"${functionName}", "${functionSignature}"${functionParams.map(v => `,${v.name}`).join('')});`;
+            cOut += `}\n`;
+            cOut += `${returnType} ${functionName}_value(future_t* f){`;
+            cOut += `arg_t* a=future_value(f);`;
+            cOut += `if(a==NULL)printf("ERROR! Remote execution error %s\\n", "${functionName}");`;
+            // the group owns the result, strings outlive it the way they do for the sync call
+            if (returnType === "char*")
+                cOut += `return a!=NULL?strdup(a->val.sval):NULL;`;
+            else
+                cOut += `return a!=NULL?a->val.${returnTypeJamLibCode}:(${returnType})0;`;
             cOut += `}`;
         }
 
@@ -54,6 +54,41 @@ module.exports = {
   getCallGraph: function () {
     return this.graph;
   },
+  // Worst case stack use of function name: its own frame plus the deepest chain of
+  // callees we know of. frames maps function names to {size, bounded} as read from
+  // the -fstack-usage output. Returns undefined when the chain cannot be bounded:
+  // recursion, a dynamic frame (alloca, VLA) or a callee without a frame size.
+  stackDepth: function (language, name, frames) {
+    var graph = this.graph[language];
+    var onPath = new Set();
+    var known = new Map();
+
+    function depth(fn) {
+      if (known.has(fn)) {
+        return known.get(fn);
+      }
+      var frame = frames.get(fn);
+      if (frame === undefined || !frame.bounded || onPath.has(fn)) {
+        return undefined;
+      }
+      var deepest = 0;
+      var node = graph.get(fn);
+      onPath.add(fn);
+      if (node !== undefined) {
+        for (let callee of node.calls.keys()) {
+          var d = depth(callee);
+          if (d === undefined) {
+            return undefined;
+          }
+          deepest = Math.max(deepest, d);
+        }
+      }
+      onPath.delete(fn);
+      known.set(fn, frame.size + deepest);
+      return frame.size + deepest;
+    }
+    return depth(name);
+  },
   checkCalls: function () {
     // this.graph.js.forEach(function(data, sourceFunction) {
     //   var sourceSymbol = symbolTable.get(sourceFunction);
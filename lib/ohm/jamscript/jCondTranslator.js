@@ -59,10 +59,116 @@ var jCondTranslator = {
     }
 };
 
+// jsys fields a C node has, see jsys_t in jcond.h
+const cJsysFields = new Set(["jsys.type", "jsys.tag"]);
+const jCondToken = /\s*(===|!==|==|!=|<=|>=|&&|\|\||[<>!()]|'[^'\\"\n]*'|"[^'\\"\n]*"|[0-9]+(?:\.[0-9]+)?|[A-Za-z_$][\w$]*(?:\.[A-Za-z_$][\w$]*)*)/y;
+
+// Translates a jcond expression into a C expression over jsys_t, or returns null if it
+// is outside of what a C node can evaluate natively: comparisons of jsys.type, jsys.tag
+// and literals, joined by &&, || and !. Anything else (callbacks, other jsys fields,
+// function calls) stays with mujs.
+function jCondToC(source) {
+    var tokens = [];
+    var pos = 0;
+    var m;
+
+    jCondToken.lastIndex = 0;
+    while (pos < source.length && (m = jCondToken.exec(source)) !== null) {
+        tokens.push(m[1]);
+        pos = jCondToken.lastIndex;
+    }
+    if (source.slice(pos).trim() !== "")
+        return null;
+
+    var i = 0;
+    var peek = () => tokens[i];
+    var next = () => tokens[i++];
+
+    function operand() {
+        var t = next();
+        if (t === undefined)
+            throw "end of jcond";
+        if (cJsysFields.has(t))
+            return {type: "string", c: t};
+        if (t[0] === "'" || t[0] === '"')
+            return {type: "string", c: '"' + t.slice(1, -1) + '"'};
+        if (/^[0-9]/.test(t))
+            return {type: "number", c: t};
+        if (t === "true" || t === "false")
+            return {type: "boolean", c: t};
+        throw "not native: " + t;
+    }
+
+    function comparison() {
+        var left = operand();
+        var op = peek();
+        if (!["==", "!=", "===", "!==", "<", "<=", ">", ">="].includes(op)) {
+            if (left.type !== "boolean")
+                throw "not a condition: " + left.c;
+            return left.c;
+        }
+        next();
+        var right = operand();
+        var eq = op.slice(0, 2);
+        if (left.type === "string" && right.type === "string" && (eq === "==" || eq === "!="))
+            return (eq === "!=" ? "!" : "") + `jcond_streq(${left.c}, ${right.c})`;
+        if (left.type === "number" && right.type === "number")
+            return `(${left.c} ${eq === "==" || eq === "!=" ? eq : op} ${right.c})`;
+        throw "not native: " + op;
+    }
+
+    function unary() {
+        if (peek() === "!") {
+            next();
+            if (peek() === "(" || peek() === "!")
+                return "!" + unary();
+            // ! binds tighter than a comparison: !jsys.tag == 'x' is (!jsys.tag) == 'x'
+            var o = operand();
+            if (o.type !== "boolean" || ["==", "!=", "===", "!==", "<", "<=", ">", ">="].includes(peek()))
+                throw "not native: !" + o.c;
+            return "!" + o.c;
+        }
+        if (peek() === "(") {
+            next();
+            var e = or();
+            if (next() !== ")")
+                throw "unbalanced jcond";
+            return "(" + e + ")";
+        }
+        return comparison();
+    }
+
+    function and() {
+        var e = unary();
+        while (peek() === "&&") {
+            next();
+            e += " && " + unary();
+        }
+        return e;
+    }
+
+    function or() {
+        var e = and();
+        while (peek() === "||") {
+            next();
+            e += " || " + and();
+        }
+        return e;
+    }
+
+    try {
+        var c = or();
+        return i === tokens.length ? c : null;
+    } catch (e) {
+        return null;
+    }
+}
+
 module.exports = {
     set: function(key, value) {
         conditionTable.set(key, value);
     },
     conditionTable: conditionTable,
-    jCondTranslator: jCondTranslator
+    jCondTranslator: jCondTranslator,
+    toC: jCondToC
 };
@@ -5,7 +5,7 @@ var jamJSTranslator = require("./jamJSTranslator");
 var callGraph = require("./callGraph");
 const VarTableFile = require("./VarTable");
 
-function compile(cInput, jsInput, lineNumber, yieldPoint) {
+function compile(cInput, jsInput, lineNumber, yieldPoint, jFutures) {
   let cTableManager = new VarTableFile.TableManager(
     new VarTableFile.VarTable(null)
   );
@@ -35,7 +35,8 @@ function compile(cInput, jsInput, lineNumber, yieldPoint) {
     cTableManager,
     yieldPoint,
     libTable,
-    jsResults.jconds
+    jsResults.jconds,
+    jFutures
   );
 
   callGraph.pruneJSCallGraph();
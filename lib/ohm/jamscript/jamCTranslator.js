@@ -25,6 +25,8 @@ var allFunc = [];
 var tableManager;
 var jCondMap;
 var mainparams = false;
+var futureGroups = 0;
+var jFutures = false;       // group J calls into futures (jamc --futures)
 
 var jamCTranslator = {
   Namespace_spec: function (_, namespace) {
@@ -621,6 +623,57 @@ cTranslator.Compound_stmt = function (_1, stmts, _2, _3) {
     return matches.map((match) => match.substring(0, match.indexOf("(")));
   };
 
+  // A call of a J activity that returns a value, `int a = f(x);` or `a = f(x);`,
+  // with simple arguments. Returns the parts of the statement or null.
+  var getJCall = function (n, code) {
+    if (!isFunctionCall(n)) return null;
+    var m = code
+      .trim()
+      .match(/^((?:[A-Za-z_]\w*[\s*]+)*)([A-Za-z_]\w*)\s*=\s*([A-Za-z_]\w*)\s*\(([^()]*)\)\s*;$/);
+    if (m == null) return null;
+    var taskInfo = symbolTable.getTask(m[3]);
+    var proto = prototypes.get(m[3]);
+    if (!taskInfo || taskInfo.language !== "js" || !proto || proto.return_type === "void")
+      return null;
+    return { decl: m[1].trim(), target: m[2], fn: m[3], args: m[4].trim() };
+  };
+
+  // Consecutive J calls whose arguments do not use the results of the ones before
+  // are issued together as a group of futures and awaited once. Only the data flow is
+  // checked, calls with side effects lose their order, so this is opt-in (jFutures).
+  var run = [];
+  var independent = function (call) {
+    // FUTURES_MAX calls fit in a group
+    return run.length < 16 && run.every(
+      (prev) =>
+        prev.target !== call.target &&
+        !new RegExp("\\b" + prev.target + "\\b").test(call.args)
+    );
+  };
+  var flushRun = function () {
+    if (run.length == 1) {
+      code.push(run[0].code);
+    } else if (run.length > 1) {
+      var group = "jfut_" + futureGroups++;
+      code.push(`futures_t* ${group} = futures_create(cnode->tboard);`);
+      run.forEach((call, j) =>
+        code.push(
+          `future_t* ${group}_${j} = ${call.fn}_future(${group}${
+            call.args.length > 0 ? ", " + call.args : ""
+          });`
+        )
+      );
+      code.push(`await_all(${group}, FUTURE_TIMEOUT_US);`);
+      run.forEach((call, j) =>
+        code.push(
+          `${call.decl.length > 0 ? call.decl + " " : ""}${call.target} = ${call.fn}_value(${group}_${j});`
+        )
+      );
+      code.push(`futures_destroy(${group});`);
+    }
+    run = [];
+  };
+
   tableManager.enterScope();
   var code = [];
   var currMilestone = milestone.getAMilestoneNumber();
@@ -629,6 +682,16 @@ cTranslator.Compound_stmt = function (_1, stmts, _2, _3) {
     var currChild = stmts.child(i);
     var currResult = currChild.cTranslator;
 
+    var jcall = jFutures ? getJCall(currChild, currResult) : null;
+    if (jcall != null) {
+      if (!independent(jcall)) flushRun();
+      jcall.code = currResult;
+      run.push(jcall);
+      milestone.registerFunctionsForMilestone(currMilestone, getFunctionNames(currChild));
+      continue;
+    }
+    flushRun();
+
     // Add task_yield in the case of iteration statement.
     if (isIterationStatement(currChild)) {
       let endBracketLocation = currResult.lastIndexOf("}");
@@ -684,6 +747,7 @@ cTranslator.Compound_stmt = function (_1, stmts, _2, _3) {
       milestone.registerFunctionsForMilestone(currMilestone, functionNames);
     }
   }
+  flushRun();
   tableManager.exitScope();
   return "{\n" + code.join("\n") + "\n}";
 };
@@ -736,29 +800,52 @@ function parseArrayList(list, sep) {
   return code;
 }
 
+// Stack sizes of the activity tasks. The native compile measures them and passes
+// -DJAM_STACK_<name>=<bytes>, a 0 left here gives the task the default STACK_SIZE.
+function generateCStackSizes() {
+  var cout = "";
+  for (const name of symbolTable.activities.c.keys()) {
+    cout += `#ifndef JAM_STACK_${name}\n#define JAM_STACK_${name} 0\n#endif\n`;
+  }
+  return cout;
+}
+
 function generateCActivities() {
   var cout = "";
   for (const [name, values] of symbolTable.activities.c) {
-    cout += `tboard_register_func(cnode->tboard, TBOARD_FUNC("${name}", call_${name}, "${values.codes.join("")}", "${
+    cout += `tboard_register_func(cnode->tboard, TBOARD_FUNC_STACK("${name}", call_${name}, "${values.codes.join("")}", "${
       values.jCond.tag ? values.jCond.tag : ""
-    }", PRI_BATCH_TASK));\n`;
+    }", PRI_BATCH_TASK, JAM_STACK_${name}));\n`;
+  }
+  return cout;
+}
+
+// jconds in the subset jCondTranslator.toC() handles become C predicates, the node
+// only starts mujs for the rest
+function generateCPredicates() {
+  var cout = "";
+  for (const [conditionTag, source] of jCondMap) {
+    const pred = jCondTranslator.toC(source);
+    if (pred !== null) {
+      cout += `bool jcond_native_${conditionTag}() {\n  return ${pred};\n}\n`;
+    }
   }
   return cout;
 }
 
 function generateCConditions() {
   return Array.from(jCondMap.keys())
-    .map(
-      (conditionTag) =>
-        `jcond_define("${conditionTag}", "${jCondMap.get(
-          conditionTag
-        )}");`
+    .map((conditionTag) =>
+      jCondTranslator.toC(jCondMap.get(conditionTag)) !== null
+        ? `jcond_define_native("${conditionTag}", jcond_native_${conditionTag});`
+        : `jcond_define("${conditionTag}", "${jCondMap.get(conditionTag)}");`
     )
     .join("\n");
 }
 
 function generate_setup() {
-  var cout = "\nvoid user_setup() {\n";
+  var cout =
+    "\n" + generateCStackSizes() + generateCPredicates() + "void user_setup() {\n";
   cout += generateCConditions();
   cout += generateCActivities();
   cout += jdata.linkCVariables(symbolTable.getGlobals());
@@ -835,9 +922,10 @@ function formatErrorMessage(err, offset) {
 }
 
 module.exports = {
-  compile: function (input, offset, manager, yieldPoint, libs, jCond) {
+  compile: function (input, offset, manager, yieldPoint, libs, jCond, futures) {
     tableManager = manager;
     jCondMap = jCond;
+    jFutures = futures === true;
     exportLibs = libs;
     if (yieldPoint) {
       cTranslatorFile.enableYieldPoint();
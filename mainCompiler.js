@@ -17,6 +17,14 @@ let preprocessDecls;
 let tmpDir = "/tmp/jam-" + randomValueHex(20);
 let homeDir = os.homedir();
 
+// Task stacks (see STACK_SIZE and STACK_SIZE_MIN in the C runtime). The headroom covers
+// what -fstack-usage does not show us: libc and runtime calls of an activity and the
+// coroutine entry. Stacks have no guard page, so STACK_SIZE_MIN is a floor for the
+// runtime frames on top of that.
+const STACK_SIZE = 57344;
+const STACK_SIZE_MIN = 16384;
+const STACK_HEADROOM = 6144;
+
 // Core of the compiler 
 let args = processArgs();
 validateArgs(args);
@@ -41,7 +49,7 @@ function runMain(cargs) {
             printAndExit(preprocessed);
 
         let results = jam.compile(preprocessed, fs.readFileSync(cargs.jsPath).toString(),
-                                    lineNumber, cargs.yieldPoint);
+                                    lineNumber, cargs.yieldPoint, cargs.jFutures);
         cargs.cSideEffectTable = results.C_SideEffectTable;
         cargs.jsSideEffectTable = results.JS_SideEffectTable;
 
@@ -79,7 +87,8 @@ function runMain(cargs) {
 
 function nativeCompile(code, cargs) {
     return new Promise(function (resolve, reject) {
-        // Set platform options
+        // Set platform options, cflags go into the -fstack-usage compile as well
+        let cflags = "-g";
         let options = "";
         if (process.platform === "darwin") {
             // Mac
@@ -89,7 +98,7 @@ function nativeCompile(code, cargs) {
             options = "-lm";
         }
         if (cargs.debug) {
-            options += " -fno-omit-frame-pointer -fsanitize=address";
+            cflags += " -fno-omit-frame-pointer -fsanitize=address";
         }
 
         const includes = [
@@ -102,9 +111,13 @@ function nativeCompile(code, cargs) {
             `${tmpDir}/jamout.c`,
             includes + preprocessDecls.join("\n") + "\n" + code
         );
+        const incdirs = `-I/usr/local/include -I${homeDir}/.jamruns/clib/include -I${homeDir}/.jamruns/clib/src`;
+
+        // AddressSanitizer grows the frames, debug builds keep the default stacks
+        let stacks = cargs.debug ? [] : stackSizes(incdirs, cflags, cargs);
 
         try {
-            var command = `clang -g ${tmpDir}/jamout.c -o ${tmpDir}/a.out -I/usr/local/include -I${homeDir}/.jamruns/clib/include -I${homeDir}/.jamruns/clib/src ${options} -pthread -ltinycbor -lmosquitto -lmujs  ${homeDir}/.jamruns/clib/libjam.a  ${homeDir}/.jamruns/jamhome/deps/mujs2/build/release/libmujs.a -L/usr/local/lib`;
+            var command = `clang ${cflags} ${tmpDir}/jamout.c -o ${tmpDir}/a.out ${incdirs} ${stacks.join(" ")} ${options} -pthread -ltinycbor -lmosquitto -lmujs  ${homeDir}/.jamruns/clib/libjam.a  ${homeDir}/.jamruns/jamhome/deps/mujs2/build/release/libmujs.a -L/usr/local/lib`;
             console.log("Compiling C code...");
             if (cargs.verbose) {
                 console.log(command);
@@ -120,6 +133,57 @@ function nativeCompile(code, cargs) {
     });
 }
 
+// Compiles jamout.c once with -fstack-usage and turns the frame sizes into a stack
+// size per C activity: the frame of its call_ wrapper plus the deepest call chain of
+// the activity (callGraph.stackDepth), the headroom on top, rounded up to a power of
+// two. Returns the -DJAM_STACK_<name>=<bytes> flags; activities we cannot bound, or
+// that would not fit below STACK_SIZE, keep the default. The frames are measured with
+// the @cflags of the final build.
+function stackSizes(incdirs, cflags, cargs) {
+    let frames = new Map();
+    let flags = [];
+
+    try {
+        child_process.execSync(`clang ${cflags} -c -fstack-usage ${tmpDir}/jamout.c -o ${tmpDir}/jamout.o ${incdirs}`, {
+            stdio: "ignore",
+        });
+        // file:line:col:function <tab> bytes <tab> static | dynamic | dynamic,bounded
+        for (const line of fs.readFileSync(`${tmpDir}/jamout.su`).toString().split("\n")) {
+            let fields = line.split("\t");
+            if (fields.length < 3)
+                continue;
+            frames.set(fields[0].substring(fields[0].lastIndexOf(":") + 1), {
+                size: parseInt(fields[1]),
+                bounded: fields[2] === "static" || fields[2].indexOf("bounded") >= 0,
+            });
+        }
+    } catch (e) {
+        console.log("No stack usage information, tasks get the default stack");
+        return flags;
+    }
+
+    for (const [name, node] of callGraph.getCallGraph().c) {
+        if (node.type === "function")
+            continue;
+        let wrapper = frames.get(`call_${name}`);
+        let depth = callGraph.stackDepth("c", name, frames);
+        if (wrapper === undefined || depth === undefined) {
+            if (cargs.verbose)
+                console.log(`Stack of ${name}: unbounded, using ${STACK_SIZE} bytes`);
+            continue;
+        }
+        let size = STACK_SIZE_MIN;
+        while (size < wrapper.size + depth + STACK_HEADROOM)
+            size *= 2;
+        if (size >= STACK_SIZE)
+            continue;
+        if (cargs.verbose)
+            console.log(`Stack of ${name}: ${wrapper.size + depth} bytes in frames, using ${size} bytes`);
+        flags.push(`-DJAM_STACK_${name}=${size}`);
+    }
+    return flags;
+}
+
 function printAndExit(output) {
     console.log(output);
     process.exit();
@@ -263,6 +327,7 @@ function printHelp() {
     console.log("\t-v\t --version \t Print version information");
     console.log("\t-V\t --verbose \t Turn on verbose mode");
     console.log("\t-a\t --analyze \t Analyze the source and output call graph");
+    console.log("\t-f\t --futures \t Issue consecutive independent J calls together (they may run in any order)");
     console.log("\n");
 }
 
@@ -280,6 +345,7 @@ function processArgs() {
         verbose: false,
         callGraphFlag: false,
         yieldPoint: false,
+        jFutures: false,
         cSideEffectTable: "None",
         jsSideEffectTable: "None"
     };
@@ -312,6 +378,9 @@ function processArgs() {
                 conf.callGraphFlag = true;
             } else if (args[i] === "-y" || args[i] === "yield") {
                 conf.yieldPoint = true;
+            } else if (args[i] === "-f" || args[i] === "--futures") {
+                // Group independent J calls into futures
+                conf.jFutures = true;
             }
         } else {
             let inputPath = args[i];